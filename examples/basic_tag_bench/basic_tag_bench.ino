@@ -0,0 +1,164 @@
+#include <BasicTag.h>
+
+/*
+On target benchmark, prints ns per tag for createTag, readAllBasicTags, getTagByName / getTagByAlias and
+writeBasicTag, the scan jitter and the bytes and allocations per tag. Change the settings below to match
+the application, the host version is extras/bench/basic_tag_bench.c
+*/
+
+#define BENCH_TAGS 200           // Number of tags
+#define BENCH_MIX 0              // 0 mixed, 1 int32, 2 float, 3 bool, 4 string
+#define BENCH_CHANGE_PERCENT 10  // Tags changed before each scan
+#define BENCH_SCANS 500
+#define BENCH_STRING_LEN 16
+
+typedef struct {
+  union {
+    int32_t int32Value;
+    float floatValue;
+    bool boolValue;
+  } value;
+  char string[BENCH_STRING_LEN + 1];
+} BenchSlot;
+
+BenchSlot* slots = NULL;
+FunctionalBasicTag** tags = NULL;
+
+uint64_t millisTimestamp() {
+  return millis();
+}
+
+uint64_t microsTimestamp() {
+  return micros();
+}
+
+SparkplugDataType mixDatatype(size_t i) {
+  switch (BENCH_MIX) {
+    case 1: return spInt32;
+    case 2: return spFloat;
+    case 3: return spBoolean;
+    case 4: return spString;
+    default: {
+      const SparkplugDataType mixed[] = {spInt32, spFloat, spBoolean, spString};
+      return mixed[i % 4];
+    }
+  }
+}
+
+void changeSlot(size_t i) {
+  switch (tags[i]->datatype) {
+    case spInt32: slots[i].value.int32Value++; break;
+    case spFloat: slots[i].value.floatValue += 0.5f; break;
+    case spBoolean: slots[i].value.boolValue = !slots[i].value.boolValue; break;
+    default: slots[i].string[random(BENCH_STRING_LEN)] = 'a' + random(26); break;
+  }
+}
+
+void report(const char* name, unsigned long elapsed_us, size_t operations) {
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(1000.0 * elapsed_us / operations, 1);
+  Serial.println(" ns/op");
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(2000);
+  Serial.println("Serial is now connected!");
+  Serial.println();
+
+  setBasicTagTimestampFunction(millisTimestamp);
+  setBasicTagMicrosFunction(microsTimestamp);
+  setBasicTagInternNames(true);  // Names are built in a temporary buffer
+  randomSeed(1);
+
+  slots = (BenchSlot*)calloc(BENCH_TAGS, sizeof(BenchSlot));
+  tags = (FunctionalBasicTag**)calloc(BENCH_TAGS, sizeof(FunctionalBasicTag*));
+  if (slots == NULL || tags == NULL || !reserveTags(BENCH_TAGS)) {
+    Serial.println("Out of memory!");
+    return;
+  }
+
+  // createTag
+  BasicTagAllocStats before;
+  BasicTagAllocStats after;
+  getBasicTagAllocStats(&before);
+  char name[32];
+  unsigned long start = micros();
+  for (size_t i = 0; i < BENCH_TAGS; i++) {
+    SparkplugDataType datatype = mixDatatype(i);
+    snprintf(name, sizeof(name), "Device%u/Tag%u", (unsigned int)(i / 100), (unsigned int)i);
+    void* address = datatype == spString ? (void*)slots[i].string : (void*)&(slots[i].value);
+    tags[i] = createTag(name, address, i, datatype, true, true, BENCH_STRING_LEN);
+    if (tags[i] == NULL) {
+      Serial.println("createTag FAILED!");
+      return;
+    }
+  }
+  report("createTag", micros() - start, BENCH_TAGS);
+  getBasicTagAllocStats(&after);
+
+  start = micros();
+  readAllBasicTags();
+  report("first readAllBasicTags", micros() - start, BENCH_TAGS);
+
+  // Steady state scans, the jitter is tracked without storing every scan time
+  unsigned long total = 0;
+  unsigned long fastest = 0xFFFFFFFF;
+  unsigned long slowest = 0;
+  double mean = 0;
+  double m2 = 0;
+  for (size_t s = 0; s < BENCH_SCANS; s++) {
+    for (size_t c = 0; c < BENCH_TAGS * BENCH_CHANGE_PERCENT / 100; c++) changeSlot(random(BENCH_TAGS));
+    start = micros();
+    readAllBasicTags();
+    unsigned long elapsed = micros() - start;
+    total += elapsed;
+    if (elapsed < fastest) fastest = elapsed;
+    if (elapsed > slowest) slowest = elapsed;
+    double delta = elapsed - mean;
+    mean += delta / (s + 1);
+    m2 += delta * (elapsed - mean);
+  }
+  report("readAllBasicTags", total, (size_t)BENCH_SCANS * BENCH_TAGS);
+
+  // Lookups
+  start = micros();
+  for (size_t l = 0; l < BENCH_TAGS; l++) getTagByName(tags[random(BENCH_TAGS)]->name);
+  report("getTagByName", micros() - start, BENCH_TAGS);
+  start = micros();
+  for (size_t l = 0; l < BENCH_TAGS; l++) getTagByAlias(random(BENCH_TAGS));
+  report("getTagByAlias", micros() - start, BENCH_TAGS);
+
+  // writeBasicTag
+  start = micros();
+  for (size_t i = 0; i < BENCH_TAGS; i++) {
+    BasicValue value = tags[i]->currentValue;
+    if (tags[i]->datatype == spString) value.value.stringValue = (char*)"written";
+    else value.value.uint64Value ^= 1;
+    writeBasicTag(tags[i], &value);
+  }
+  report("writeBasicTag", micros() - start, BENCH_TAGS);
+
+  Serial.println();
+  Serial.print("Scan jitter (us): min ");
+  Serial.print(fastest);
+  Serial.print(" mean ");
+  Serial.print(mean, 1);
+  Serial.print(" max ");
+  Serial.print(slowest);
+  Serial.print(" stddev ");
+  Serial.println(sqrt(m2 / BENCH_SCANS), 1);
+
+  // The registry and name index are allocated separately and aren't counted
+  Serial.print("Memory: ");
+  Serial.print((double)(after.bytes_in_use - before.bytes_in_use) / BENCH_TAGS, 1);
+  Serial.print(" bytes/tag, ");
+  Serial.print((double)(after.total_allocations - before.total_allocations) / BENCH_TAGS, 2);
+  Serial.println(" allocations/tag");
+  Serial.println("Benchmark complete.");
+}
+
+void loop() {
+  delay(1000);
+}
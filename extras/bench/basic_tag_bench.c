@@ -0,0 +1,232 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Host benchmark for the tag engine, see the README (Benchmarks). Built by the CMakeLists.txt in the repository root:
+  basic_tag_bench --tags=1000 --mix=mixed --change=10 --scans=2000 --workers=0
+Reports ns per tag for createTag, readAllBasicTags, getTagByName / getTagByAlias and writeBasicTag, the scan
+jitter, and the bytes and allocations per tag from getBasicTagAllocStats.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "BasicTag.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_STRING_LEN 16
+
+typedef struct {
+  size_t tags;
+  const char* mix;  // int32, float, double, bool, string or mixed
+  unsigned int change_percent;  // Tags changed before each scan
+  unsigned int scans;
+  unsigned int workers;  // 0 for readAllBasicTags, otherwise readAllBasicTagsParallel
+} BenchConfig;
+
+typedef struct {
+  union {
+    int32_t int32Value;
+    uint16_t uint16Value;
+    float floatValue;
+    double doubleValue;
+    bool boolValue;
+  } value;
+  char string[BENCH_STRING_LEN + 1];
+} BenchSlot;
+
+static uint32_t _rng_state = 0x9E3779B9;
+
+static uint32_t _rng() {
+  // xorshift32, the same sequence on every run
+  _rng_state ^= _rng_state << 13;
+  _rng_state ^= _rng_state >> 17;
+  _rng_state ^= _rng_state << 5;
+  return _rng_state;
+}
+
+static uint64_t _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t _now_ms() {
+  return _now_ns() / 1000000ULL;
+}
+
+static uint64_t _now_us() {
+  return _now_ns() / 1000ULL;
+}
+
+static SparkplugDataType _mix_datatype(const char* mix, size_t i) {
+  static const SparkplugDataType mixed[] = {spInt32, spFloat, spDouble, spBoolean, spUInt16, spString};
+  if (strcmp(mix, "int32") == 0) return spInt32;
+  if (strcmp(mix, "float") == 0) return spFloat;
+  if (strcmp(mix, "double") == 0) return spDouble;
+  if (strcmp(mix, "bool") == 0) return spBoolean;
+  if (strcmp(mix, "string") == 0) return spString;
+  return mixed[i % (sizeof(mixed) / sizeof(mixed[0]))];
+}
+
+static void _change_slot(BenchSlot* slot, SparkplugDataType datatype) {
+  switch (datatype) {
+    case spInt32: slot->value.int32Value++; break;
+    case spUInt16: slot->value.uint16Value++; break;
+    case spFloat: slot->value.floatValue += 0.5f; break;
+    case spDouble: slot->value.doubleValue += 0.25; break;
+    case spBoolean: slot->value.boolValue = !slot->value.boolValue; break;
+    default: slot->string[_rng() % BENCH_STRING_LEN] = (char)('a' + _rng() % 26); break;
+  }
+}
+
+static int _compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void _report(const char* name, uint64_t elapsed_ns, size_t operations) {
+  printf("%-24s %10.1f ns/op\n", name, operations > 0 ? (double)elapsed_ns / (double)operations : 0.0);
+}
+
+static bool _parse_args(int argc, char** argv, BenchConfig* config) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (strncmp(arg, "--tags=", 7) == 0) config->tags = (size_t)strtoul(arg + 7, NULL, 10);
+    else if (strncmp(arg, "--mix=", 6) == 0) config->mix = arg + 6;
+    else if (strncmp(arg, "--change=", 9) == 0) config->change_percent = (unsigned int)strtoul(arg + 9, NULL, 10);
+    else if (strncmp(arg, "--scans=", 8) == 0) config->scans = (unsigned int)strtoul(arg + 8, NULL, 10);
+    else if (strncmp(arg, "--workers=", 10) == 0) config->workers = (unsigned int)strtoul(arg + 10, NULL, 10);
+    else return false;
+  }
+  return config->tags > 0 && config->scans > 0 && config->change_percent <= 100;
+}
+
+int main(int argc, char** argv) {
+  BenchConfig config = {1000, "mixed", 10, 2000, 0};
+  if (!_parse_args(argc, argv, &config)) {
+    fprintf(stderr, "usage: %s [--tags=N] [--mix=int32|float|double|bool|string|mixed] [--change=PERCENT] [--scans=N] [--workers=N]\n", argv[0]);
+    return 1;
+  }
+  setBasicTagTimestampFunction(_now_ms);
+  setBasicTagMicrosFunction(_now_us);
+  setBasicTagInternNames(true);  // Names are built in a temporary buffer
+
+  BenchSlot* slots = calloc(config.tags, sizeof(BenchSlot));
+  FunctionalBasicTag** tags = calloc(config.tags, sizeof(FunctionalBasicTag*));
+  char** names = calloc(config.tags, sizeof(char*));
+  uint64_t* scan_ns = calloc(config.scans, sizeof(uint64_t));
+  if (slots == NULL || tags == NULL || names == NULL || scan_ns == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  printf("tags=%zu mix=%s change=%u%% scans=%u workers=%u\n\n", config.tags, config.mix, config.change_percent, config.scans, config.workers);
+
+  // createTag, the registry is reserved first like a real application would
+  reserveTags(config.tags);
+  BasicTagAllocStats before;
+  getBasicTagAllocStats(&before);
+  char name[sizeof("Device/Tag") + 2 * 20];  // Two size_t of up to 20 digits
+  uint64_t start = _now_ns();
+  for (size_t i = 0; i < config.tags; i++) {
+    SparkplugDataType datatype = _mix_datatype(config.mix, i);
+    snprintf(name, sizeof(name), "Device%zu/Tag%zu", i / 100, i);
+    void* address = datatype == spString ? (void*)slots[i].string : (void*)&(slots[i].value);
+    tags[i] = createTag(name, address, (int)i, datatype, true, true, BENCH_STRING_LEN);
+    if (tags[i] == NULL) {
+      fprintf(stderr, "createTag failed at %zu\n", i);
+      return 1;
+    }
+  }
+  _report("createTag", _now_ns() - start, config.tags);
+  BasicTagAllocStats after;
+  getBasicTagAllocStats(&after);
+  for (size_t i = 0; i < config.tags; i++) names[i] = (char*)tags[i]->name;
+
+  // First scan reports every tag, it also builds the scan plan
+  start = _now_ns();
+  readAllBasicTags();
+  _report("first readAllBasicTags", _now_ns() - start, config.tags);
+
+  // Steady state scans, change_percent of the tags change before each one
+  size_t changes_per_scan = config.tags * config.change_percent / 100;
+  for (unsigned int s = 0; s < config.scans; s++) {
+    for (size_t c = 0; c < changes_per_scan; c++) {
+      size_t i = _rng() % config.tags;
+      _change_slot(&(slots[i]), tags[i]->datatype);
+    }
+    start = _now_ns();
+    if (config.workers > 0) readAllBasicTagsParallel(config.workers);
+    else readAllBasicTags();
+    scan_ns[s] = _now_ns() - start;
+  }
+  uint64_t total = 0;
+  for (unsigned int s = 0; s < config.scans; s++) total += scan_ns[s];
+  double mean = (double)total / config.scans;
+  double variance = 0;
+  for (unsigned int s = 0; s < config.scans; s++) variance += ((double)scan_ns[s] - mean) * ((double)scan_ns[s] - mean);
+  qsort(scan_ns, config.scans, sizeof(uint64_t), _compare_u64);
+  _report("readAllBasicTags", total, (size_t)config.scans * config.tags);
+
+  // Lookups, in a random order so the index isn't walked in insertion order
+  size_t lookups = config.tags * 10;
+  start = _now_ns();
+  for (size_t l = 0; l < lookups; l++) {
+    if (getTagByName(names[_rng() % config.tags]) == NULL) return 1;
+  }
+  _report("getTagByName", _now_ns() - start, lookups);
+  start = _now_ns();
+  for (size_t l = 0; l < lookups; l++) {
+    if (getTagByAlias((int)(_rng() % config.tags)) == NULL) return 1;
+  }
+  _report("getTagByAlias", _now_ns() - start, lookups);
+
+  // writeBasicTag, with values of the tag's own datatype
+  start = _now_ns();
+  for (size_t i = 0; i < config.tags; i++) {
+    BasicValue value = tags[i]->currentValue;
+    if (tags[i]->datatype == spString) value.value.stringValue = "written";
+    else value.value.uint64Value ^= 1;
+    writeBasicTag(tags[i], &value);
+  }
+  _report("writeBasicTag", _now_ns() - start, config.tags);
+
+  printf("\nscan jitter (us): min %.1f  p50 %.1f  p99 %.1f  max %.1f  stddev %.1f\n",
+         scan_ns[0] / 1000.0, scan_ns[config.scans / 2] / 1000.0, scan_ns[(size_t)config.scans * 99 / 100] / 1000.0,
+         scan_ns[config.scans - 1] / 1000.0, sqrt(variance / config.scans) / 1000.0);
+  // The registry and name index are allocated separately and aren't counted
+  printf("memory: %.1f bytes/tag  %.2f allocations/tag  (including %zu bytes of interned names)\n",
+         (double)(after.bytes_in_use - before.bytes_in_use) / config.tags,
+         (double)(after.total_allocations - before.total_allocations) / config.tags, getInternedNamesSize());
+
+#ifdef BASIC_TAG_ENABLE_STATS
+  BasicTagStats stats;
+  getBasicTagStats(&stats);
+  printf("library stats: %u scans  avg %u us  min %u us  max %u us  %u onChange calls  %u write rejections\n",
+         stats.scans, stats.scan_avg_us, stats.scan_min_us, stats.scan_max_us, stats.onchange_calls, stats.write_rejections);
+#endif
+
+  free(scan_ns);
+  free(names);
+  free(tags);
+  free(slots);
+  return 0;
+}
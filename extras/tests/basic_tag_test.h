@@ -0,0 +1,64 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Minimal check macros for the host tests in extras/tests, run by ctest (see the README, Tests).
+CHECK keeps going after a failure so one run reports every broken check, each test returns non-zero if any failed.
+Works in Release builds, unlike assert.
+*/
+
+#ifndef BASIC_TAG_TEST_H
+#define BASIC_TAG_TEST_H
+
+#include "BasicTag.h"
+
+#include <stdio.h>
+
+static int basic_tag_test_failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+      basic_tag_test_failures++; \
+    } \
+  } while (0)
+
+#define RUN_TEST(fn) \
+  do { \
+    int failures_before = basic_tag_test_failures; \
+    fn(); \
+    printf("%s %s\n", basic_tag_test_failures == failures_before ? "ok  " : "FAIL", #fn); \
+  } while (0)
+
+static uint64_t basic_tag_test_clock = 1000;
+
+static uint64_t basic_tag_test_now() {
+  return basic_tag_test_clock;
+}
+
+static void basic_tag_test_clear_tags() {
+  // The library state is global, each test case starts from an empty registry
+  while (getTagsCount() > 0) deleteTag(getTagByIdx(getTagsCount() - 1));
+  reclaimBasicTagMemory();
+}
+
+static int basic_tag_test_result() {
+  if (basic_tag_test_failures > 0) fprintf(stderr, "%d check(s) failed\n", basic_tag_test_failures);
+  return basic_tag_test_failures > 0 ? 1 : 0;
+}
+
+#endif // BASIC_TAG_TEST_H
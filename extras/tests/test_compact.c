@@ -0,0 +1,243 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Compact tags: create / read / write, aliases shared with the FunctionalBasicTags, lookups through the shared index
+and batch writes by alias
+*/
+
+#include "basic_tag_test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static CompactBasicTag pool[64];
+static int changes;
+
+static void count_change(CompactBasicTag* tag) {
+  (void)tag;
+  changes++;
+}
+
+static bool not_negative(BasicValue* value) {
+  return value->value.int32Value >= 0;
+}
+
+static void delete_compact(CompactBasicTag* tag) {
+  deleteCompactTag(tag);
+}
+
+static void clear_all() {
+  iterCompactTags(delete_compact);
+  basic_tag_test_clear_tags();
+  CHECK(getCompactTagsCount() == 0);
+}
+
+static void test_create() {
+  clear_all();
+  static int32_t int_value;
+  static char string_value[8];
+  CHECK(setCompactTagStorage(pool, 4));
+  CHECK(createCompactTag("string", string_value, 1, spString, true, true) == NULL);  // Numeric and boolean only
+  CompactBasicTag* first = createCompactTag("first", &int_value, 5, spInt32, true, true);
+  CHECK(first != NULL && first->alias == 5);
+  CHECK(!setCompactTagStorage(pool, 8));  // Not while there are compact tags
+
+  // Aliases are unique across both kinds of tag
+  CompactBasicTag* next = createCompactTag("next", &int_value, 5, spInt32, true, true);
+  CHECK(next != NULL && next->alias == 6);
+  FunctionalBasicTag* full = createInt32Tag("full", &int_value, 6, true, true);
+  CHECK(full != NULL && full->alias == 7);
+  CHECK(!aliasValid(5) && !aliasValid(6) && !aliasValid(7) && getNextAlias() == 8);
+  CHECK(createCompactTag("negative", &int_value, -5, spInt32, true, true)->alias == -5);
+  CHECK(createCompactTag("last", &int_value, INT16_MAX + 1, spInt32, true, true)->alias == 8);  // Doesn't fit, the next alias
+  CHECK(createCompactTag("full_pool", &int_value, -1, spInt32, true, true) == NULL);
+  CHECK(getCompactTagsCount() == 4);
+
+  // Deleting frees the alias and the slot
+  CHECK(deleteCompactTag(next));
+  CHECK(!deleteCompactTag(next));
+  CHECK(aliasValid(6) && getCompactTagByAlias(6) == NULL && getCompactTagByName("next") == NULL);
+  CompactBasicTag* again = createCompactTag("again", &int_value, 6, spInt32, true, true);
+  CHECK(again == next && again->alias == 6 && getCompactTagByName("again") == again);
+}
+
+static void test_lookup() {
+  clear_all();
+  static int32_t int_value;
+  static float float_value;
+  CHECK(setCompactTagStorage(pool, 64));
+  CompactBasicTag* compact = createCompactTag("shared", &float_value, 1, spFloat, true, true);
+  FunctionalBasicTag* full = createInt32Tag("full", &int_value, 2, true, true);
+  CHECK(getCompactTagByName("shared") == compact && getCompactTagByAlias(1) == compact);
+
+  // The two kinds never resolve to each other
+  CHECK(getTagByName("shared") == NULL && getTagByAlias(1) == NULL);
+  CHECK(getCompactTagByName("full") == NULL && getCompactTagByAlias(2) == NULL);
+  CHECK(getTagByName("full") == full && getTagByAlias(2) == full);
+
+  // The same name is allowed once for each kind
+  FunctionalBasicTag* same_name = createInt32Tag("shared", &int_value, -1, true, true);
+  CHECK(same_name != NULL && getTagByName("shared") == same_name && getCompactTagByName("shared") == compact);
+  CHECK(createCompactTag("full", &int_value, -1, spInt32, true, true) != NULL);
+
+  // Lookups stay correct while the index grows with both kinds in it
+  static int32_t values[400];
+  char names[400][12];
+  for (int i = 0; i < 400; i++) {
+    snprintf(names[i], sizeof(names[i]), "tag_%d", i);
+    if (i % 8 == 0) CHECK(createCompactTag(names[i], &values[i], -1, spInt32, true, true) != NULL);
+    else CHECK(createInt32Tag(names[i], &values[i], -1, true, true) != NULL);
+  }
+  for (int i = 0; i < 400; i++) {
+    if (i % 8 == 0) CHECK(getCompactTagByName(names[i]) != NULL && getTagByName(names[i]) == NULL);
+    else CHECK(getTagByName(names[i]) != NULL && getCompactTagByName(names[i]) == NULL);
+  }
+  CHECK(getCompactTagByName("shared") == compact && getCompactTagByAlias(1) == compact);
+  clear_all();  // The names are on this stack frame
+}
+
+static void test_read_write() {
+  clear_all();
+  basic_tag_test_clock = 5000;
+  static int32_t int_value;
+  static bool bool_value;
+  CHECK(setCompactTagStorage(pool, 64));
+  CompactBasicTag* tag = createCompactTag("int", &int_value, 1, spInt32, true, true);
+  CompactBasicTag* read_only = createCompactTag("bool", &bool_value, 2, spBoolean, false, false);
+  CHECK(addCompactOnChangeCallback(tag, count_change));
+  CHECK(addCompactValidateWriteCallback(tag, not_negative));
+
+  changes = 0;
+  CHECK(readAllCompactTags() && changes == 1);
+  CHECK(!readAllCompactTags());
+  basic_tag_test_clock += 10;
+  int_value = 3;
+  CHECK(readAllCompactTags() && (tag->flags & BASIC_TAG_COMPACT_VALUE_CHANGED));
+  CHECK(getCompactTagTimestamp(tag) == basic_tag_test_clock);
+  BasicValue value;
+  CHECK(getCompactTagValue(tag, &value) && value.value.int32Value == 3 && value.timestamp == basic_tag_test_clock && !value.isNull);
+
+  BasicValue written = {0, spInt32, {.int32Value = -1}, false};
+  CHECK(!writeCompactTag(tag, &written) && int_value == 3);  // Rejected by validateWrite
+  written.value.int32Value = 9;
+  CHECK(writeCompactTag(tag, &written) && int_value == 9);
+  CHECK(!writeCompactTag(read_only, &written));
+
+  // The timestamp epoch rebases once the offset no longer fits in 32 bits
+  basic_tag_test_clock += 0x100000000ULL;
+  int_value = 10;
+  CHECK(readAllCompactTags() && getCompactTagTimestamp(tag) == basic_tag_test_clock);
+
+  // readAllBasicTags reads the compact tags as well
+  basic_tag_test_clock++;
+  int_value = 11;
+  CHECK(readAllBasicTags() && tag->value.int32Value == 11);
+  CHECK(!readAllBasicTags());
+
+  // The callbacks go with a deleted tag, not to the next tag created in the slot
+  CHECK(deleteCompactTag(tag));
+  CompactBasicTag* reused = createCompactTag("reused", &int_value, -1, spInt32, true, true);
+  CHECK(reused == tag);
+  changes = 0;
+  basic_tag_test_clock++;
+  int_value = -4;
+  readAllCompactTags();
+  CHECK(changes == 0);
+  written.value.int32Value = -2;
+  CHECK(writeCompactTag(reused, &written) && int_value == -2);
+}
+
+static void test_batch_by_alias() {
+  clear_all();
+  basic_tag_test_clock = 5000;
+  static double double_value;
+  static int32_t int_value, full_value;
+  static bool bool_value;
+  CHECK(setCompactTagStorage(pool, 64));
+  CompactBasicTag* compact_double = createCompactTag("double", &double_value, -5, spDouble, true, true);
+  CompactBasicTag* compact_int = createCompactTag("int", &int_value, 1, spInt32, true, true);
+  createCompactTag("bool", &bool_value, 2, spBoolean, true, false);  // Not remote writable
+  FunctionalBasicTag* full = createInt32Tag("full", &full_value, 3, true, true);
+  CHECK(addCompactValidateWriteCallback(compact_int, not_negative));
+  readAllBasicTags();
+
+  // One batch mixes both kinds, the REREAD updates the compact values too
+  int aliases[4] = {-5, 3, 2, 1};
+  BasicValue values[4] = {
+    {0, spDouble, {.doubleValue = 2.5}, false},
+    {0, spInt32, {.int32Value = 4}, false},
+    {0, spBoolean, {.boolValue = true}, false},
+    {0, spInt32, {.int32Value = 6}, false}
+  };
+  bool results[4];
+  basic_tag_test_clock++;
+  CHECK(writeBasicTagsBatch(aliases, values, 4, results, BASIC_TAG_WRITE_REREAD) == 3);
+  CHECK(results[0] && results[1] && !results[2] && results[3]);
+  CHECK(double_value == 2.5 && full_value == 4 && !bool_value && int_value == 6);
+  CHECK(compact_double->value.doubleValue == 2.5 && compact_int->value.int32Value == 6 && full->currentValue.value.int32Value == 4);
+
+  // Datatype mismatch and validateWrite rejects, ATOMIC writes nothing
+  BasicValue wrong_type = {0, spFloat, {.floatValue = 1}, false};
+  CHECK(writeBasicTagsBatch(&aliases[3], &wrong_type, 1, results, 0) == 0 && !results[0]);
+  values[0].value.doubleValue = 7.5;
+  values[3].value.int32Value = -1;
+  int atomic_aliases[2] = {-5, 1};
+  BasicValue atomic_values[2] = {values[0], values[3]};
+  CHECK(writeBasicTagsBatch(atomic_aliases, atomic_values, 2, results, BASIC_TAG_WRITE_ATOMIC) == 0);
+  CHECK(results[0] && !results[1] && double_value == 2.5 && int_value == 6);
+
+  // A deleted compact tag no longer takes writes by its alias
+  CHECK(deleteCompactTag(compact_double));
+  CHECK(writeBasicTagsBatch(atomic_aliases, atomic_values, 1, results, 0) == 0 && double_value == 2.5);
+}
+
+static void test_deferred_delete() {
+  // A reader that looked the tag up keeps a slot that reads as deleted, the slot is only reused after it is done
+  clear_all();
+  static int32_t int_value = 4;
+  CHECK(setCompactTagStorage(pool, 1));
+  CompactBasicTag* tag = createCompactTag("held", &int_value, 1, spInt32, true, true);
+  readAllCompactTags();
+  uint32_t token = beginBasicTagRead();
+  CompactBasicTag* held = getCompactTagByName("held");
+  CHECK(held == tag && deleteCompactTag(tag));
+  CHECK(!deleteCompactTag(tag) && getCompactTagByName("held") == NULL && getCompactTagsCount() == 0);
+  BasicValue value;
+  CHECK(!getCompactTagValue(held, &value) && !readCompactTag(held, 1) && getCompactTagBySlot(0) == NULL);
+#ifdef BASIC_TAG_THREAD_SAFE
+  CHECK(strcmp(held->name, "held") == 0 && held->alias == 1 && held->value.int32Value == 4);  // Not cleared under the reader
+  CHECK(createCompactTag("next", &int_value, -1, spInt32, true, true) == NULL);  // The only slot is still retired
+  CHECK(!setCompactTagStorage(pool, 64));
+#endif
+  endBasicTagRead(token);
+  reclaimBasicTagMemory();
+  CHECK(createCompactTag("next", &int_value, -1, spInt32, true, true) == tag);
+  clear_all();
+  reclaimBasicTagMemory();
+  CHECK(setCompactTagStorage(pool, 64));
+}
+
+int main() {
+  setBasicTagTimestampFunction(basic_tag_test_now);
+  RUN_TEST(test_create);
+  RUN_TEST(test_lookup);
+  RUN_TEST(test_read_write);
+  RUN_TEST(test_batch_by_alias);
+  RUN_TEST(test_deferred_delete);
+  clear_all();
+  return basic_tag_test_result();
+}
@@ -0,0 +1,126 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Tag history: records come back oldest first with their timestamps, the oldest are dropped when the ring is full,
+variable length values wrap around the end of the ring and draining stops at the caller's storage
+*/
+
+#include "basic_tag_test.h"
+
+#include <string.h>
+
+static BasicValue values[16];
+
+static void change(uint64_t timestamp) {
+  basic_tag_test_clock = timestamp;
+  readAllBasicTags();
+}
+
+static void test_attach() {
+  basic_tag_test_clear_tags();
+  static int32_t value;
+  static BasicTagHistory history;
+  static uint8_t storage[64];
+  FunctionalBasicTag* tag = createInt32Tag("tag", &value, -1, false, false);
+  CHECK(!attachTagHistory(tag, &history, NULL, sizeof(storage)));
+  CHECK(!attachTagHistory(tag, &history, storage, 11));  // Smaller than the largest numeric record
+  CHECK(!attachTagHistory(NULL, &history, storage, sizeof(storage)));
+  CHECK(attachTagHistory(tag, &history, storage, sizeof(storage)));
+  CHECK(getTagHistoryCount(tag) == 0 && peekTagHistory(tag, values, 16, NULL, 0) == 0);
+  CHECK(attachTagHistory(tag, NULL, NULL, 0));  // Detach
+  change(1000);
+  CHECK(getTagHistoryCount(tag) == 0 && peekTagHistory(tag, values, 16, NULL, 0) == 0);
+}
+
+static void test_numeric_ring() {
+  // 8 records of 8 bytes fit, the scan kernels append to the ring like the generic read
+  basic_tag_test_clear_tags();
+  static int32_t value;
+  static BasicTagHistory history;
+  static uint8_t storage[64];
+  value = 0;
+  FunctionalBasicTag* tag = createInt32Tag("tag", &value, -1, false, false);
+  CHECK(attachTagHistory(tag, &history, storage, sizeof(storage)));
+  change(1000);
+  change(1005);  // Unchanged, not recorded
+  CHECK(tag->_scan_group != 0xFF && getTagHistoryCount(tag) == 1);
+  for (int32_t k = 1; k <= 9; k++) {
+    value = k * 10;
+    change(1000 + (uint64_t)k * 10);
+  }
+  CHECK(getTagHistoryCount(tag) == 8 && history.dropped == 2);
+  CHECK(history.first_timestamp == 1020 && history.last_timestamp == 1090);
+
+  CHECK(peekTagHistory(tag, values, 3, NULL, 0) == 3);
+  for (int k = 0; k < 3; k++) {
+    CHECK(values[k].timestamp == 1020 + (uint64_t)k * 10 && values[k].value.int32Value == 20 + k * 10);
+    CHECK(values[k].datatype == spInt32 && !values[k].isNull);
+  }
+  CHECK(getTagHistoryCount(tag) == 8);
+
+  CHECK(drainTagHistory(tag, values, 5, NULL, 0) == 5 && getTagHistoryCount(tag) == 3);
+  CHECK(values[4].timestamp == 1060 && values[4].value.int32Value == 60);
+  CHECK(history.first_timestamp == 1070);
+
+  // Appending after a drain reuses the freed space
+  value = -5;
+  change(5000);
+  CHECK(drainTagHistory(tag, values, 16, NULL, 0) == 4 && getTagHistoryCount(tag) == 0);
+  CHECK(values[0].timestamp == 1070 && values[3].timestamp == 5000 && values[3].value.int32Value == -5);
+  CHECK(history.dropped == 2);
+}
+
+static void test_variable_length() {
+  basic_tag_test_clear_tags();
+  static char text[16];
+  static BasicTagHistory history;
+  static uint8_t storage[48];
+  static const char* samples[] = {"first", "", "a longer one", "xy", "wraps around"};
+  FunctionalBasicTag* tag = createStringTag("text", text, -1, false, false, 15);
+  CHECK(attachTagHistory(tag, &history, storage, sizeof(storage)));
+  for (size_t k = 0; k < 5; k++) {
+    strcpy(text, samples[k]);
+    change(2000 + k);
+  }
+  // A record is the delta, the length and the content, "first" (11) and the empty string (6) make room for "wraps around" (18)
+  CHECK(getTagHistoryCount(tag) == 3 && history.dropped == 2);
+
+  char strings[64];
+  CHECK(peekTagHistory(tag, values, 16, strings, sizeof(strings)) == 3);
+  CHECK(strcmp(values[0].value.stringValue, "a longer one") == 0 && values[0].timestamp == 2002);
+  CHECK(strcmp(values[1].value.stringValue, "xy") == 0);
+  CHECK(strcmp(values[2].value.stringValue, "wraps around") == 0 && values[2].timestamp == 2004);
+
+  // Stops when the strings don't fit, the rest stay in the ring
+  CHECK(drainTagHistory(tag, values, 16, strings, 16) == 2 && getTagHistoryCount(tag) == 1);
+  CHECK(drainTagHistory(tag, values, 16, NULL, 0) == 0);
+  CHECK(drainTagHistory(tag, values, 16, strings, sizeof(strings)) == 1 && strcmp(values[0].value.stringValue, "wraps around") == 0);
+
+  // Empty strings are Null
+  text[0] = '\0';
+  change(3000);
+  CHECK(drainTagHistory(tag, values, 16, strings, sizeof(strings)) == 1 && values[0].isNull && values[0].value.stringValue == NULL);
+}
+
+int main() {
+  setBasicTagTimestampFunction(basic_tag_test_now);
+  RUN_TEST(test_attach);
+  RUN_TEST(test_numeric_ring);
+  RUN_TEST(test_variable_length);
+  basic_tag_test_clear_tags();
+  return basic_tag_test_result();
+}
@@ -0,0 +1,229 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Change queue: the coalesce, drop oldest and block policies, deleted tags, and switching and resetting queues with
+events pending
+*/
+
+#include "basic_tag_test.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+static int32_t value;
+static FunctionalBasicTag* tag;
+static int changes;
+
+static void count_change(FunctionalBasicTag* changed) {
+  (void)changed;
+  changes++;
+}
+
+static void create_tag() {
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  value = 0;
+  tag = createInt32Tag("tag", &value, -1, false, false);
+  addOnChangeCallback(tag, count_change);
+}
+
+static void change() {
+  value++;
+  basic_tag_test_clock++;
+  readAllBasicTags();
+}
+
+#define TAGS 3
+
+static int32_t values[TAGS];
+static FunctionalBasicTag* tags[TAGS];
+static FunctionalBasicTag* seen_tags[16];
+static int32_t seen_values[16];
+static int seen;
+
+static void record_change(FunctionalBasicTag* changed) {
+  if (seen < 16) {
+    seen_tags[seen] = changed;
+    seen_values[seen] = changed->currentValue.value.int32Value;
+  }
+  seen++;
+}
+
+static void create_tags() {
+  static const char* names[TAGS] = {"a", "b", "c"};
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  for (int i = 0; i < TAGS; i++) {
+    values[i] = 0;
+    tags[i] = createInt32Tag(names[i], &(values[i]), -1, false, false);
+    addOnChangeCallback(tags[i], record_change);
+  }
+  readAllBasicTags();
+  seen = 0;
+}
+
+static void change_tag(int i) {
+  values[i]++;
+  basic_tag_test_clock++;
+  readAllBasicTags();
+}
+
+static void test_coalesce() {
+  create_tags();
+  static BasicTagChangeEvent events[2];
+  BasicTagChangeQueue queue;
+  CHECK(!initBasicTagChangeQueue(&queue, events, 0, BASIC_TAG_QUEUE_COALESCE));
+  CHECK(!initBasicTagChangeQueue(&queue, events, 2, (BasicTagQueuePolicy)3));
+  CHECK(initBasicTagChangeQueue(&queue, events, 2, BASIC_TAG_QUEUE_COALESCE));
+  CHECK(setBasicTagChangeQueue(&queue));
+  for (int k = 0; k < 3; k++) change_tag(0);
+  change_tag(1);
+  CHECK(seen == 0 && queue.coalesced == 2 && queue.dropped == 0);
+
+  // One event per tag, in the order they first changed, onChange sees the latest value
+  CHECK(dispatchBasicTagChanges(0) == 2);
+  CHECK(seen == 2 && seen_tags[0] == tags[0] && seen_values[0] == 3 && seen_tags[1] == tags[1]);
+  CHECK(!tags[0]->_queued && !tags[1]->_queued);
+
+  // More changed tags than events still fills up
+  values[0]++, values[1]++, values[2]++;
+  basic_tag_test_clock++;
+  readAllBasicTags();
+  CHECK(queue.dropped == 1 && dispatchBasicTagChanges(1) == 1 && dispatchBasicTagChanges(0) == 1 && seen == 4);
+  CHECK(dispatchBasicTagChanges(0) == 0);
+  CHECK(setBasicTagChangeQueue(NULL));
+}
+
+static void test_drop_oldest() {
+  create_tags();
+  static BasicTagChangeEvent events[3];
+  BasicTagChangeQueue queue;
+  CHECK(initBasicTagChangeQueue(&queue, events, 3, BASIC_TAG_QUEUE_DROP_OLDEST));
+  CHECK(setBasicTagChangeQueue(&queue));
+  for (int k = 0; k < 5; k++) change_tag(0);
+  CHECK(queue.dropped == 2 && queue.coalesced == 0 && seen == 0);
+
+  // The newest events are kept, popping doesn't call onChange
+  BasicTagChangeEvent event;
+  for (uint64_t timestamp = 1003; timestamp <= 1005; timestamp++) {
+    CHECK(popBasicTagChange(&event) && event.tag == tags[0] && event.timestamp == timestamp);
+  }
+  CHECK(!popBasicTagChange(&event) && seen == 0);
+  CHECK(!popBasicTagChange(NULL));
+  CHECK(setBasicTagChangeQueue(NULL));
+  CHECK(!popBasicTagChange(&event));
+}
+
+static bool consumer_stop;
+
+static void* consume(void* arg) {
+  (void)arg;
+  while (!__atomic_load_n(&consumer_stop, __ATOMIC_ACQUIRE)) {
+    if (dispatchBasicTagChanges(0) == 0) sched_yield();
+  }
+  return NULL;
+}
+
+static void test_block() {
+  // A full queue holds the scan until the consumer makes room, nothing is lost
+  create_tags();
+  static BasicTagChangeEvent events[2];
+  BasicTagChangeQueue queue;
+  CHECK(initBasicTagChangeQueue(&queue, events, 2, BASIC_TAG_QUEUE_BLOCK));
+  CHECK(setBasicTagChangeQueue(&queue));
+  __atomic_store_n(&consumer_stop, false, __ATOMIC_RELEASE);
+  pthread_t consumer;
+  CHECK(pthread_create(&consumer, NULL, consume, NULL) == 0);
+  for (int k = 0; k < 200; k++) change_tag(k % TAGS);
+  while (__atomic_load_n(&(queue.tail), __ATOMIC_ACQUIRE) != queue.head) sched_yield();
+  __atomic_store_n(&consumer_stop, true, __ATOMIC_RELEASE);
+  pthread_join(consumer, NULL);
+  CHECK(seen == 200 && queue.dropped == 0);
+  CHECK(setBasicTagChangeQueue(NULL));
+}
+
+static void test_deleted_tag() {
+  // Its pending events are skipped
+  create_tags();
+  static BasicTagChangeEvent events[4];
+  BasicTagChangeQueue queue;
+  CHECK(initBasicTagChangeQueue(&queue, events, 4, BASIC_TAG_QUEUE_DROP_OLDEST));
+  CHECK(setBasicTagChangeQueue(&queue));
+  change_tag(0);
+  change_tag(1);
+  change_tag(0);
+  CHECK(deleteTag(tags[0]));
+  CHECK(dispatchBasicTagChanges(0) == 1 && seen == 1 && seen_tags[0] == tags[1]);
+  CHECK(setBasicTagChangeQueue(NULL));
+}
+
+static void test_switch_with_pending_events() {
+  // A coalesced tag still waiting in the old queue would otherwise be merged into an event that never comes
+  create_tag();
+  static BasicTagChangeEvent events[4], other_events[4];
+  BasicTagChangeQueue queue, other;
+  CHECK(initBasicTagChangeQueue(&queue, events, 4, BASIC_TAG_QUEUE_COALESCE));
+  CHECK(initBasicTagChangeQueue(&other, other_events, 4, BASIC_TAG_QUEUE_COALESCE));
+  CHECK(setBasicTagChangeQueue(&queue));
+  changes = 0;
+  change();
+  CHECK(changes == 0 && tag->_queued);
+  CHECK(setBasicTagChangeQueue(&other));
+  CHECK(changes == 1 && !tag->_queued);  // Dispatched on the way out
+
+  for (int i = 0; i < 5; i++) {
+    change();
+    CHECK(dispatchBasicTagChanges(0) == 1);
+  }
+  CHECK(changes == 6 && other.coalesced == 0);
+
+  // Back to calling onChange during the read
+  change();
+  CHECK(setBasicTagChangeQueue(NULL));
+  CHECK(changes == 7 && !tag->_queued);
+  change();
+  CHECK(changes == 8);
+  CHECK(!setBasicTagChangeQueue(&(BasicTagChangeQueue){0}));  // Not initialised
+}
+
+static void test_reinit_active_queue() {
+  create_tag();
+  static BasicTagChangeEvent events[4];
+  BasicTagChangeQueue queue;
+  CHECK(initBasicTagChangeQueue(&queue, events, 4, BASIC_TAG_QUEUE_COALESCE));
+  CHECK(setBasicTagChangeQueue(&queue));
+  changes = 0;
+  change();
+  CHECK(initBasicTagChangeQueue(&queue, events, 2, BASIC_TAG_QUEUE_COALESCE));
+  CHECK(changes == 1 && !tag->_queued && queue.head == queue.tail);
+  change();
+  CHECK(dispatchBasicTagChanges(0) == 1 && changes == 2);
+  CHECK(setBasicTagChangeQueue(NULL));
+}
+
+int main() {
+  setBasicTagTimestampFunction(basic_tag_test_now);
+  RUN_TEST(test_coalesce);
+  RUN_TEST(test_drop_oldest);
+  RUN_TEST(test_block);
+  RUN_TEST(test_deleted_tag);
+  RUN_TEST(test_switch_with_pending_events);
+  RUN_TEST(test_reinit_active_queue);
+  basic_tag_test_clear_tags();
+  return basic_tag_test_result();
+}
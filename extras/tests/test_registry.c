@@ -0,0 +1,338 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Registry: batch creation, value versions and snapshots, deferred reclaim, the scan fast path and batch writes.
+Built with BASIC_TAG_THREAD_SAFE it also races lookups against a task creating and deleting tags
+*/
+
+#include "basic_tag_test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef BASIC_TAG_THREAD_SAFE
+#include <pthread.h>
+#endif
+
+#define BATCH 4000
+
+static int32_t batch_values[BATCH];
+static char batch_names[BATCH][12];
+static BasicTagDefinition definitions[BATCH];
+static FunctionalBasicTag* batch_tags[BATCH];
+static int changes;
+
+static void count_change(FunctionalBasicTag* tag) {
+  (void)tag;
+  changes++;
+}
+
+static bool not_negative(BasicValue* value) {
+  return value->value.int32Value >= 0;
+}
+
+static void test_create_batch() {
+  basic_tag_test_clear_tags();
+  for (int i = 0; i < BATCH; i++) {
+    snprintf(batch_names[i], sizeof(batch_names[i]), "batch_%d", i);
+    // The second half asks for an alias that is already taken
+    definitions[i] = (BasicTagDefinition){batch_names[i], &batch_values[i], i < BATCH / 2 ? i + 1 : 5, spInt32, true, false, 0};
+  }
+  CHECK(createTagsBatch(definitions, BATCH, batch_tags) == BATCH);
+  CHECK(getTagsCount() == BATCH);
+  CHECK(batch_tags[BATCH / 2 - 1]->alias == BATCH / 2);
+  CHECK(batch_tags[BATCH / 2]->alias == BATCH / 2 + 1 && batch_tags[BATCH - 1]->alias == BATCH);
+  CHECK(getNextAlias() == BATCH + 1 && !aliasValid(17));
+  for (int i = 0; i < BATCH; i += 97) CHECK(getTagByName(batch_names[i]) == batch_tags[i] && getTagByAlias(batch_tags[i]->alias) == batch_tags[i]);
+
+  // tags_out is optional, aliases repeated within a batch are made unique as well
+  static int32_t more_values[3];
+  BasicTagDefinition more[3] = {
+    {"more_0", &more_values[0], 9000, spInt32, true, false, 0},
+    {"more_1", &more_values[1], 9000, spInt32, true, false, 0},
+    {"more_2", &more_values[2], 9000, spInt32, true, false, 0}
+  };
+  CHECK(createTagsBatch(more, 3, NULL) == 3);
+  CHECK(getTagByName("more_0")->alias == 9000 && getTagByName("more_1")->alias == 9001 && getTagByName("more_2")->alias == 9002);
+  CHECK(getTagsCount() == BATCH + 3);
+
+  deleteTag(batch_tags[BATCH - 1]);
+  CHECK(getTagByName(batch_names[BATCH - 1]) == NULL);
+  basic_tag_test_clear_tags();
+  CHECK(getNextAlias() == 1);
+}
+
+static void test_value_version() {
+  basic_tag_test_clear_tags();
+  static int32_t int_value;
+  static char string_value[17];
+  FunctionalBasicTag* int_tag = createInt32Tag("int", &int_value, -1, true, true);
+  FunctionalBasicTag* string_tag = createStringTag("string", string_value, -1, true, true, 16);
+  uint32_t version = getTagValueVersion(int_tag);
+  readAllBasicTags();
+  CHECK(getTagValueVersion(int_tag) == version + 1);
+  basic_tag_test_clock++;
+  readAllBasicTags();
+  CHECK(getTagValueVersion(int_tag) == version + 1);  // Unchanged
+  int_value = 4;
+  basic_tag_test_clock++;
+  readAllBasicTags();
+  CHECK(getTagValueVersion(int_tag) == version + 2);
+
+  BasicValue snapshot;
+  CHECK(snapshotTagValue(int_tag, &snapshot, NULL, 0));
+  CHECK(snapshot.value.int32Value == 4 && snapshot.timestamp == basic_tag_test_clock && snapshot.datatype == spInt32);
+
+  strcpy(string_value, "sixteen chars ok");
+  readAllBasicTags();
+  static uint8_t storage[BASIC_TAG_VALUE_STORAGE_SIZE(spString, 16)];
+  CHECK(!snapshotTagValue(string_tag, &snapshot, NULL, 0));
+  CHECK(!snapshotTagValue(string_tag, &snapshot, storage, 4));
+  CHECK(snapshotTagValue(string_tag, &snapshot, storage, sizeof(storage)));
+  CHECK(strcmp(snapshot.value.stringValue, "sixteen chars ok") == 0 && (uint8_t*)snapshot.value.stringValue >= storage);
+  strcpy(string_value, "changed");
+  readAllBasicTags();
+  CHECK(strcmp(snapshot.value.stringValue, "sixteen chars ok") == 0);  // A copy, not the tag's storage
+}
+
+static void test_deferred_reclaim() {
+  basic_tag_test_clear_tags();
+  static int32_t value;
+  FunctionalBasicTag* tag = createInt32Tag("reclaim", &value, -1, true, true);
+  uint32_t token = beginBasicTagRead();
+  FunctionalBasicTag* looked_up = getTagByName("reclaim");
+  CHECK(looked_up == tag);
+  deleteTag(tag);
+  CHECK(getTagByName("reclaim") == NULL && getTagsCount() == 0);
+#ifdef BASIC_TAG_THREAD_SAFE
+  // The reader's tag is still allocated until it ends the read
+  CHECK(!reclaimBasicTagMemory());
+  CHECK(looked_up->value_address == &value);
+#endif
+  endBasicTagRead(token);
+  CHECK(reclaimBasicTagMemory());
+}
+
+static void test_fast_path_last_read() {
+  // Unchanged tags are skipped by the fast path, their lastRead still follows each scan
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  static int32_t values[100];
+  FunctionalBasicTag* tags[100];
+  char names[100][8];
+  for (int i = 0; i < 100; i++) {
+    snprintf(names[i], sizeof(names[i]), "fast%d", i);
+    tags[i] = createInt32Tag(names[i], &values[i], -1, true, true);
+  }
+  readAllBasicTags();
+  basic_tag_test_clock = 2000;
+  values[50] = 1;
+  CHECK(readAllBasicTags());
+  for (int i = 0; i < 100; i++) CHECK(tags[i]->lastRead == 2000);
+  CHECK(tags[50]->currentValue.timestamp == 2000 && tags[49]->currentValue.timestamp == 1000);
+  basic_tag_test_clock = 3000;
+  CHECK(!readAllBasicTags());
+  for (int i = 0; i < 100; i++) CHECK(tags[i]->lastRead == 3000);
+  basic_tag_test_clear_tags();  // The names are on this stack frame
+}
+
+static void test_fast_path_with_unread_tags() {
+  // A tag that never gets a timestamp (NULL value address) stays on the generic path without holding the rest back
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  static int32_t values[100];
+  FunctionalBasicTag* tags[100];
+  char names[100][8];
+  for (int i = 0; i < 100; i++) {
+    snprintf(names[i], sizeof(names[i]), "fast%d", i);
+    tags[i] = createInt32Tag(names[i], &values[i], -1, true, true);
+  }
+  FunctionalBasicTag* unread = createInt32Tag("unread", NULL, -1, true, true);
+  readAllBasicTags();
+  basic_tag_test_clock = 2000;
+  readAllBasicTags();
+  for (int i = 0; i < 100; i++) CHECK(tags[i]->_scan_group != 0xFF);
+  CHECK(unread->_scan_group == 0xFF);
+
+  // The plan isn't rebuilt on every scan: it keeps the cached address until invalidateBasicTagScanPlan
+  static int32_t moved = 5;
+  tags[10]->value_address = &moved;
+  basic_tag_test_clock = 3000;
+  readAllBasicTags();
+  CHECK(tags[10]->currentValue.value.int32Value == 0);
+  invalidateBasicTagScanPlan();
+  basic_tag_test_clock = 4000;
+  readAllBasicTags();
+  CHECK(tags[10]->currentValue.value.int32Value == 5);
+  basic_tag_test_clear_tags();  // The names are on this stack frame
+}
+
+static void test_write_batch() {
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  static int32_t a, b, c;
+  static float f;
+  FunctionalBasicTag* tag_a = createInt32Tag("a", &a, 1, true, true);
+  createInt32Tag("b", &b, 2, true, true);
+  FunctionalBasicTag* tag_c = createInt32Tag("c", &c, 3, true, false);
+  createFloatTag("f", &f, 4, false, true);
+  addValidateWriteCallback(tag_a, not_negative);
+  addOnChangeCallback(tag_a, count_change);
+  readAllBasicTags();
+  changes = 0;
+
+  // Remote writes need remote_writable and a matching datatype
+  BasicValue value = {0, spInt32, {.int32Value = 5}, false};
+  CHECK(!writeBasicTagRemote(tag_c, &value) && writeBasicTag(tag_c, &value) && c == 5);
+  BasicValue wrong_type = {0, spFloat, {.floatValue = 1}, false};
+  CHECK(!writeBasicTagRemote(tag_a, &wrong_type));
+
+  int aliases[4] = {1, 2, 3, 4};
+  BasicValue values[4] = {
+    {0, spInt32, {.int32Value = 10}, false},
+    {0, spInt32, {.int32Value = 20}, false},
+    {0, spInt32, {.int32Value = 30}, false},
+    {0, spFloat, {.floatValue = 1.5f}, false}
+  };
+  bool results[4];
+  CHECK(writeBasicTagsBatch(aliases, values, 4, results, BASIC_TAG_WRITE_ATOMIC) == 0);
+  CHECK(results[0] && results[1] && !results[2] && results[3] && a == 0 && b == 0 && f == 0);
+  CHECK(writeBasicTagsBatch(aliases, values, 4, results, 0) == 3);
+  CHECK(a == 10 && b == 20 && c == 5 && f == 1.5f && changes == 0);
+
+  // Unknown aliases fail, REREAD calls onChange before returning
+  int reread_aliases[2] = {1, 99};
+  basic_tag_test_clock++;
+  CHECK(writeBasicTagsBatch(reread_aliases, values, 2, results, BASIC_TAG_WRITE_REREAD) == 1 && results[0] && !results[1]);
+  CHECK(changes == 1 && tag_a->currentValue.value.int32Value == 10);
+
+  // Without results a rejected entry is not reread, so the local change to a stays unreported
+  a = 50;
+  BasicValue rejected[2] = {{0, spInt32, {.int32Value = -3}, false}, {0, spInt32, {.int32Value = 9}, false}};
+  basic_tag_test_clock++;
+  CHECK(writeBasicTagsBatch(aliases, rejected, 2, NULL, BASIC_TAG_WRITE_REREAD) == 1);
+  CHECK(b == 9 && changes == 1 && tag_a->currentValue.value.int32Value == 10);
+
+  // The same for batches bigger than the on-stack result bitmap
+  static int big_aliases[600];
+  static BasicValue big_values[600];
+  for (int i = 0; i < 600; i++) {
+    big_aliases[i] = i == 599 ? 1 : 2;
+    big_values[i] = (BasicValue){0, spInt32, {.int32Value = i == 599 ? -1 : i}, false};
+  }
+  basic_tag_test_clock++;
+  CHECK(writeBasicTagsBatch(big_aliases, big_values, 600, NULL, BASIC_TAG_WRITE_REREAD) == 599);
+  CHECK(b == 598 && changes == 1);
+}
+
+static const char* visited[64];
+static size_t visited_count;
+
+static void delete_visited(FunctionalBasicTag* tag) {
+  // Deleting the tag tagFn is called with is allowed
+  if (visited_count < 64) visited[visited_count++] = tag->name;
+  CHECK(deleteTag(tag));
+}
+
+static void test_prefix_iteration() {
+  basic_tag_test_clear_tags();
+  static int32_t values[40];
+  static char names[40][8];
+  for (int i = 0; i < 40; i++) {
+    // Created out of name order, "P/" for the even ones
+    int n = (i * 7) % 40;
+    snprintf(names[i], sizeof(names[i]), "%s/%02d", n % 2 == 0 ? "P" : "Q", n);
+    createInt32Tag(names[i], &values[i], -1, false, false);
+  }
+  CHECK(iterTagsWithPrefix("P/", NULL) == 20 && iterTagsWithPrefix("R/", NULL) == 0 && iterTagsWithPrefix(NULL, NULL) == 0);
+  FunctionalBasicTag* first[4];
+  CHECK(getTagsWithPrefix("Q/", first, 4) == 20 && strcmp(first[0]->name, "Q/01") == 0 && strcmp(first[3]->name, "Q/07") == 0);
+
+  // More matches than the stack batch, each one deleted by tagFn
+  visited_count = 0;
+  CHECK(iterTagsWithPrefix("P/", delete_visited) == 20 && visited_count == 20);
+  for (size_t i = 1; i < visited_count; i++) CHECK(strcmp(visited[i - 1], visited[i]) < 0);
+  CHECK(getTagsCount() == 20 && iterTagsWithPrefix("P/", NULL) == 0 && iterTagsWithPrefix("Q/", NULL) == 20);
+  visited_count = 0;
+  CHECK(iterTagsWithPrefix("Q/0", delete_visited) == 5 && getTagsCount() == 15);
+  basic_tag_test_clear_tags();
+}
+
+#ifdef BASIC_TAG_THREAD_SAFE
+static bool writer_done;
+static int32_t churn_values[64];
+static char churn_names[64][12];
+
+static void* churn_tags(void* arg) {
+  // Creates and deletes tags while the main thread looks up the stable ones
+  (void)arg;
+  for (int round = 0; round < 200; round++) {
+    FunctionalBasicTag* tags[64];
+    for (int i = 0; i < 64; i++) tags[i] = createInt32Tag(churn_names[i], &churn_values[i], -1, true, true);
+    for (int i = 0; i < 64; i++) deleteTag(tags[i]);
+    reclaimBasicTagMemory();
+  }
+  __atomic_store_n(&writer_done, true, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void test_concurrent_lookups() {
+  basic_tag_test_clear_tags();
+  static int32_t stable_values[32];
+  static char stable_names[32][12];
+  FunctionalBasicTag* stable[32];
+  for (int i = 0; i < 32; i++) {
+    snprintf(stable_names[i], sizeof(stable_names[i]), "stable_%d", i);
+    stable[i] = createInt32Tag(stable_names[i], &stable_values[i], 100 + i, true, true);
+  }
+  for (int i = 0; i < 64; i++) snprintf(churn_names[i], sizeof(churn_names[i]), "churn_%d", i);
+
+  __atomic_store_n(&writer_done, false, __ATOMIC_RELEASE);
+  pthread_t writer;
+  CHECK(pthread_create(&writer, NULL, churn_tags, NULL) == 0);
+  size_t misses = 0;
+  while (!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE)) {
+    uint32_t token = beginBasicTagRead();
+    for (int i = 0; i < 32; i++) {
+      if (getTagByName(stable_names[i]) != stable[i] || getTagByAlias(100 + i) != stable[i]) misses++;
+    }
+    FunctionalBasicTag* churn = getTagByName(churn_names[7]);
+    if (churn != NULL && churn->value_address != &churn_values[7]) misses++;  // Still valid inside the read
+    endBasicTagRead(token);
+  }
+  pthread_join(writer, NULL);
+  CHECK(misses == 0);
+  CHECK(getTagsCount() == 32);
+  basic_tag_test_clear_tags();
+}
+#endif
+
+int main() {
+  setBasicTagTimestampFunction(basic_tag_test_now);
+  RUN_TEST(test_create_batch);
+  RUN_TEST(test_value_version);
+  RUN_TEST(test_deferred_reclaim);
+  RUN_TEST(test_fast_path_last_read);
+  RUN_TEST(test_fast_path_with_unread_tags);
+  RUN_TEST(test_write_batch);
+  RUN_TEST(test_prefix_iteration);
+#ifdef BASIC_TAG_THREAD_SAFE
+  RUN_TEST(test_concurrent_lookups);
+#endif
+  basic_tag_test_clear_tags();
+  return basic_tag_test_result();
+}
@@ -0,0 +1,362 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Scans: the fast path kernels against the generic read, at the 16, 8 and 4 lane and 64 slot boundaries, the
+parallel scan against the serial one, the deadline scheduler, deadband and the minimum report interval
+*/
+
+#include "basic_tag_test.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_TAGS 130
+#define ROUNDS 9
+
+typedef union {
+  int8_t i8;
+  int16_t i16;
+  int32_t i32;
+  int64_t i64;
+  uint8_t u8;
+  uint16_t u16;
+  uint32_t u32;
+  uint64_t u64;
+  float f;
+  double d;
+  bool b;
+} Slot;
+
+static const SparkplugDataType datatypes[] = {
+  spInt8, spInt16, spInt32, spInt64, spUInt8, spUInt16, spUInt32, spUInt64, spDateTime, spFloat, spDouble, spBoolean
+};
+static const size_t counts[] = {1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 130};
+
+static Slot slots[2][MAX_TAGS];  // [0] fast path tags, [1] their generic path twins
+static char names[2][MAX_TAGS][sizeof("f") + 20];
+static size_t changed[2 * MAX_TAGS];
+
+static bool generic_compare(BasicValue* current, BasicValue* next) {
+  // Same result as DefaultCompareFn, but keeps the tag on the generic path
+  return DefaultCompareFn(current, next);
+}
+
+static void set_slot(Slot* slot, SparkplugDataType datatype, int64_t value) {
+  switch (datatype) {
+    case spInt8: slot->i8 = (int8_t)value; break;
+    case spInt16: slot->i16 = (int16_t)value; break;
+    case spInt32: slot->i32 = (int32_t)value; break;
+    case spInt64: slot->i64 = value * 1000000007LL; break;
+    case spUInt8: slot->u8 = (uint8_t)value; break;
+    case spUInt16: slot->u16 = (uint16_t)value; break;
+    case spUInt32: slot->u32 = (uint32_t)value; break;
+    case spUInt64:
+    case spDateTime: slot->u64 = (uint64_t)value * 1000000007ULL; break;
+    case spFloat: slot->f = (float)value / 4; break;
+    case spDouble: slot->d = (double)value / 4; break;
+    case spBoolean: slot->b = value & 1; break;
+    default: break;
+  }
+}
+
+static void bump_slot(Slot* slot, SparkplugDataType datatype) {
+  // Always a different value
+  switch (datatype) {
+    case spInt8: slot->i8 = (int8_t)(slot->i8 + 1); break;
+    case spInt16: slot->i16 = (int16_t)(slot->i16 + 1); break;
+    case spInt32: slot->i32 = (int32_t)((uint32_t)slot->i32 + 1); break;
+    case spInt64: slot->i64 = (int64_t)((uint64_t)slot->i64 + 1); break;
+    case spUInt8: slot->u8++; break;
+    case spUInt16: slot->u16++; break;
+    case spUInt32: slot->u32++; break;
+    case spUInt64:
+    case spDateTime: slot->u64++; break;
+    case spFloat: slot->f = isnan(slot->f) ? 0.5f : slot->f + 1; break;
+    case spDouble: slot->d = isnan(slot->d) ? 0.5 : slot->d + 1; break;
+    case spBoolean: slot->b = !slot->b; break;
+    default: break;
+  }
+}
+
+static bool same_value(FunctionalBasicTag* tag, const Slot* slot) {
+  const Value* value = &(tag->currentValue.value);
+  switch (tag->datatype) {
+    case spInt8: return value->int8Value == slot->i8;
+    case spInt16: return value->int16Value == slot->i16;
+    case spInt32: return value->int32Value == slot->i32;
+    case spInt64: return value->int64Value == slot->i64;
+    case spUInt8: return value->uint8Value == slot->u8;
+    case spUInt16: return value->uint16Value == slot->u16;
+    case spUInt32: return value->uint32Value == slot->u32;
+    case spUInt64:
+    case spDateTime: return value->uint64Value == slot->u64;
+    case spFloat: return isnan(slot->f) ? isnan(value->floatValue) : value->floatValue == slot->f;
+    case spDouble: return isnan(slot->d) ? isnan(value->doubleValue) : value->doubleValue == slot->d;
+    case spBoolean: return value->boolValue == slot->b;
+    default: return false;
+  }
+}
+
+static bool pattern(int round, size_t i, size_t count) {
+  // Which slots change in a round, chosen to hit the first and last lanes of each step and the remainders
+  switch (round) {
+    case 0: return i == count - 1;
+    case 1: return i == 0;
+    case 2: return true;
+    case 3: return i % 3 == 1;
+    case 4: return i % 16 == 15 || i % 8 == 0 || i % 4 == 3;
+    case 5: return false;
+    case 6: return i >= count - count % 4;
+    case 7: return i % 64 == 63 || i % 64 == 0;
+    default: return i % 16 >= 12;
+  }
+}
+
+static void check_masks(SparkplugDataType datatype, size_t count) {
+  basic_tag_test_clear_tags();
+  FunctionalBasicTag* tags[2][MAX_TAGS];
+  for (int path = 0; path < 2; path++) {
+    for (size_t i = 0; i < count; i++) {
+      snprintf(names[path][i], sizeof(names[path][i]), "%c%zu", path == 0 ? 'f' : 'g', i);
+      set_slot(&(slots[path][i]), datatype, (int64_t)(i * 37));
+      tags[path][i] = createTag(names[path][i], &(slots[path][i]), -1, datatype, false, false, 0);
+      if (path == 1) setCompareFunction(tags[path][i], generic_compare);
+    }
+  }
+  basic_tag_test_clock++;
+  readAllBasicTags();  // First reads go through the generic path, the plan is rebuilt for the next scan
+  basic_tag_test_clock++;
+  CHECK(!readAllBasicTags());
+  CHECK(tags[0][count - 1]->_scan_group != 0xFF && tags[1][0]->_scan_group == 0xFF);
+
+  bool is_float = datatype == spFloat || datatype == spDouble;
+  bool nan_slots[MAX_TAGS] = {false};
+  for (int round = 0; round < ROUNDS + (is_float ? 2 : 0); round++) {
+    bool expected[MAX_TAGS];
+    for (size_t i = 0; i < count; i++) {
+      if (round == ROUNDS) {
+        // NaN always counts as changed, also on the scan after it was read
+        nan_slots[i] = i % 2 == 0;
+        if (datatype == spFloat && nan_slots[i]) slots[0][i].f = NAN;
+        if (datatype == spDouble && nan_slots[i]) slots[0][i].d = NAN;
+        slots[1][i] = slots[0][i];
+      } else if (round < ROUNDS && pattern(round, i, count)) {
+        bump_slot(&(slots[0][i]), datatype);
+        bump_slot(&(slots[1][i]), datatype);
+      }
+      expected[i] = (round < ROUNDS && pattern(round, i, count)) || (round >= ROUNDS && nan_slots[i]);
+    }
+    basic_tag_test_clock++;
+    size_t changes = readAllBasicTagsChanged(changed, 2 * MAX_TAGS);
+    bool reported[2][MAX_TAGS] = {{false}};
+    size_t expected_changes = 0;
+    for (size_t k = 0; k < changes; k++) {
+      if (changed[k] < 2 * count) reported[changed[k] / count][changed[k] % count] = true;
+    }
+    bool masks_match = true;
+    bool values_match = true;
+    for (size_t i = 0; i < count; i++) {
+      if (expected[i]) expected_changes += 2;
+      if (reported[0][i] != expected[i] || reported[1][i] != expected[i]) masks_match = false;
+      if (!same_value(tags[0][i], &(slots[0][i])) || !same_value(tags[1][i], &(slots[1][i]))) values_match = false;
+    }
+    if (!masks_match || !values_match || changes != expected_changes) {
+      fprintf(stderr, "datatype %d, %zu tags, round %d\n", (int)datatype, count, round);
+    }
+    CHECK(masks_match && values_match && changes == expected_changes);
+  }
+}
+
+static void test_masks_match_generic() {
+  basic_tag_test_clock = 1000;
+  for (size_t d = 0; d < sizeof(datatypes) / sizeof(datatypes[0]); d++) {
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) check_masks(datatypes[d], counts[c]);
+  }
+}
+
+#define PARALLEL_TAGS 600
+
+static Slot parallel_slots[PARALLEL_TAGS];
+static char parallel_names[PARALLEL_TAGS][sizeof("p") + 20];
+static size_t serial_changed[PARALLEL_TAGS];
+static size_t parallel_changed[PARALLEL_TAGS];
+static int change_calls;
+
+static void count_change(FunctionalBasicTag* tag) {
+  (void)tag;
+  change_calls++;
+}
+
+static SparkplugDataType parallel_datatype(size_t i) {
+  return datatypes[i % (sizeof(datatypes) / sizeof(datatypes[0]))];
+}
+
+static void change_parallel_tags(int round) {
+  for (size_t i = 0; i < PARALLEL_TAGS; i++) {
+    if ((i * 7 + (size_t)round) % 5 < 2) bump_slot(&(parallel_slots[i]), parallel_datatype(i));
+  }
+}
+
+static void test_parallel_matches_serial() {
+  // Same changes in the same order, and onChange called for each of them
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  for (size_t i = 0; i < PARALLEL_TAGS; i++) {
+    snprintf(parallel_names[i], sizeof(parallel_names[i]), "p%zu", i);
+    set_slot(&(parallel_slots[i]), parallel_datatype(i), (int64_t)i);
+    FunctionalBasicTag* tag = createTag(parallel_names[i], &(parallel_slots[i]), -1, parallel_datatype(i), false, false, 0);
+    addOnChangeCallback(tag, count_change);
+    if (i % 50 == 0) setCompareFunction(tag, generic_compare);
+  }
+  readAllBasicTags();
+  basic_tag_test_clock++;
+  readAllBasicTags();
+
+  for (int round = 0; round < 3; round++) {
+    change_parallel_tags(round);
+    basic_tag_test_clock++;
+    size_t serial_count = readAllBasicTagsChanged(serial_changed, PARALLEL_TAGS);
+    change_parallel_tags(round);
+    basic_tag_test_clock++;
+    change_calls = 0;
+    size_t parallel_count = readAllBasicTagsParallelChanged(4, parallel_changed, PARALLEL_TAGS);
+    CHECK(serial_count > 0 && parallel_count == serial_count && change_calls == (int)parallel_count);
+    CHECK(memcmp(serial_changed, parallel_changed, serial_count * sizeof(size_t)) == 0);
+    for (size_t k = 0; k < parallel_count; k++) CHECK(same_value(getTagByIdx(parallel_changed[k]), &(parallel_slots[parallel_changed[k]])));
+  }
+  basic_tag_test_clock++;
+  CHECK(!readAllBasicTagsParallel(3));
+  CHECK(readAllBasicTagsParallelChanged(16, parallel_changed, 2) == 0);
+  // Only the first max_changes indexes are written, the count and the reads cover all of them
+  change_parallel_tags(2);
+  basic_tag_test_clock++;
+  size_t serial_count = readAllBasicTagsChanged(serial_changed, PARALLEL_TAGS);
+  change_parallel_tags(2);
+  basic_tag_test_clock++;
+  CHECK(readAllBasicTagsParallelChanged(4, parallel_changed, 2) == serial_count);
+  CHECK(parallel_changed[0] == serial_changed[0] && parallel_changed[1] == serial_changed[1]);
+  CHECK(!readAllBasicTags());
+}
+
+static void test_deadline_scheduler() {
+  basic_tag_test_clear_tags();
+  CHECK(getNextBasicTagDeadline() == UINT64_MAX);
+  static int32_t fast, slow, every;
+  FunctionalBasicTag* fast_tag = createInt32Tag("fast", &fast, -1, false, false);
+  FunctionalBasicTag* slow_tag = createInt32Tag("slow", &slow, -1, false, false);
+  FunctionalBasicTag* every_tag = createInt32Tag("every", &every, -1, false, false);
+  CHECK(setTagScanPeriod(fast_tag, 100) && setTagScanPeriod(slow_tag, 250));
+  CHECK(!setTagScanPeriod(NULL, 100));
+  CHECK(getNextBasicTagDeadline() == 0);  // Never read tags are due straight away
+
+  size_t due[4];
+  CHECK(readDueBasicTagsChanged(1000, due, 4) == 3);
+  CHECK(getNextBasicTagDeadline() == 1000);  // A period of 0 is read on every call
+
+  fast++, slow++, every++;
+  CHECK(readDueBasicTagsChanged(1050, due, 4) == 1 && due[0] == 2);
+  CHECK(readDueBasicTagsChanged(1100, due, 4) == 1 && due[0] == 0);
+  CHECK(getTagLastRead(slow_tag) == 1000 && getTagLastRead(fast_tag) == 1100);
+  CHECK(readDueBasicTags(1249) == false);  // Reads fast and every, neither changed
+  CHECK(readDueBasicTagsChanged(1250, due, 4) == 1 && due[0] == 1);
+
+  // Changing a period rebuilds the heap from the last reads
+  CHECK(deleteTag(every_tag));
+  CHECK(getNextBasicTagDeadline() == 1349);
+  CHECK(setTagScanPeriod(fast_tag, 1000));
+  CHECK(getNextBasicTagDeadline() == 1500);
+  fast++;
+  CHECK(readDueBasicTagsChanged(2099, due, 4) == 0);  // slow is read and now due at 2349
+  CHECK(readDueBasicTagsChanged(2249, due, 4) == 1 && due[0] == 0);
+  CHECK(getNextBasicTagDeadline() == 2349);
+}
+
+static void check_deadband(bool fast_path) {
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  static float absolute;
+  static int32_t percent;
+  static double interval;
+  absolute = 10.0f;
+  percent = 100;
+  interval = 1.0;
+  FunctionalBasicTag* absolute_tag = createFloatTag("absolute", &absolute, -1, false, false);
+  FunctionalBasicTag* percent_tag = createInt32Tag("percent", &percent, -1, false, false);
+  FunctionalBasicTag* interval_tag = createDoubleTag("interval", &interval, -1, false, false);
+  CHECK(setTagDeadband(absolute_tag, BASIC_TAG_DEADBAND_ABSOLUTE, 0.5));
+  CHECK(setTagDeadband(percent_tag, BASIC_TAG_DEADBAND_PERCENT, 10));
+  CHECK(setTagMinReportInterval(interval_tag, 100));
+  CHECK(!setTagDeadband(absolute_tag, BASIC_TAG_DEADBAND_ABSOLUTE, -1));
+  if (!fast_path) {
+    setCompareFunction(absolute_tag, generic_compare);
+    setCompareFunction(percent_tag, generic_compare);
+    setCompareFunction(interval_tag, generic_compare);
+  }
+  readAllBasicTags();
+  basic_tag_test_clock = 1010;
+  readAllBasicTags();
+  CHECK((absolute_tag->_scan_group != 0xFF) == fast_path);
+
+  // Held back values are compared with the last reported one, so small steps add up
+  absolute = 10.3f;
+  percent = 105;
+  interval = 2.0;
+  basic_tag_test_clock = 1050;
+  CHECK(!readAllBasicTags());
+  CHECK(absolute_tag->currentValue.value.floatValue == 10.0f && percent_tag->currentValue.value.int32Value == 100);
+  CHECK(interval_tag->currentValue.value.doubleValue == 1.0);
+  absolute = 10.6f;
+  percent = 111;
+  basic_tag_test_clock = 1099;
+  size_t reported[4];
+  CHECK(readAllBasicTagsChanged(reported, 4) == 2 && reported[0] != 2 && reported[1] != 2);
+  CHECK(absolute_tag->currentValue.value.floatValue == 10.6f && percent_tag->currentValue.value.int32Value == 111);
+  basic_tag_test_clock = 1100;  // 100 ms after the tag's last reported change
+  CHECK(readAllBasicTagsChanged(reported, 4) == 1 && reported[0] == 2 && interval_tag->currentValue.value.doubleValue == 2.0);
+  interval = 3.0;
+  basic_tag_test_clock = 1150;
+  CHECK(!readAllBasicTags());
+
+  // NaN is always reported
+  absolute = NAN;
+  basic_tag_test_clock = 1200;
+  CHECK(readAllBasicTagsChanged(reported, 4) == 2);
+  CHECK(isnan(absolute_tag->currentValue.value.floatValue) && interval_tag->currentValue.value.doubleValue == 3.0);
+
+  CHECK(setTagDeadband(percent_tag, BASIC_TAG_DEADBAND_NONE, 0));
+  percent = 112;
+  basic_tag_test_clock = 1300;
+  CHECK(readAllBasicTagsChanged(reported, 4) == 2 && percent_tag->currentValue.value.int32Value == 112);
+}
+
+static void test_deadband() {
+  check_deadband(true);
+  check_deadband(false);
+  static char text[8];
+  CHECK(!setTagDeadband(createStringTag("text", text, -1, false, false, 7), BASIC_TAG_DEADBAND_ABSOLUTE, 1));
+}
+
+int main() {
+  setBasicTagTimestampFunction(basic_tag_test_now);
+  RUN_TEST(test_masks_match_generic);
+  RUN_TEST(test_parallel_matches_serial);
+  RUN_TEST(test_deadline_scheduler);
+  RUN_TEST(test_deadband);
+  basic_tag_test_clear_tags();
+  return basic_tag_test_result();
+}
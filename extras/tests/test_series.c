@@ -0,0 +1,169 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Compressed series: every sample decodes to the exact value and timestamp that was encoded, including the integer
+extremes, irregular and very large timestamp gaps, reuse of the oldest block and range queries
+*/
+
+#include "basic_tag_test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SAMPLES 3000
+
+static uint64_t timestamps[SAMPLES];
+static int64_t int_samples[SAMPLES];
+static float float_samples[SAMPLES];
+static double double_samples[SAMPLES];
+static BasicValue decoded[SAMPLES];
+
+static void next_timestamp(size_t k) {
+  // Mostly regular with some jitter, so delta-of-delta has both the 0 and the wider cases
+  basic_tag_test_clock += 100 + (rand() % 5 == 0 ? (uint64_t)(rand() % 50) : 0);
+  if (k == SAMPLES / 2) basic_tag_test_clock += 10000000000ULL;  // Gap of about 4 months
+  timestamps[k] = basic_tag_test_clock;
+}
+
+static void test_attach() {
+  basic_tag_test_clear_tags();
+  static char string_value[8];
+  static int32_t int_value;
+  static BasicTagSeries series;
+  static uint8_t storage[1024];
+  FunctionalBasicTag* string_tag = createStringTag("string", string_value, -1, true, true, 7);
+  FunctionalBasicTag* int_tag = createInt32Tag("int", &int_value, -1, true, true);
+  CHECK(!attachTagSeries(string_tag, &series, storage, sizeof(storage), 256));  // Numeric and boolean only
+  CHECK(!attachTagSeries(int_tag, &series, storage, 16, 256));  // Smaller than a block
+  CHECK(attachTagSeries(int_tag, &series, storage, sizeof(storage), 256));
+  CHECK(attachTagSeries(int_tag, NULL, NULL, 0, 0));  // Detach
+  CHECK(readTagSeries(int_tag, 0, UINT64_MAX, decoded, SAMPLES) == 0);
+}
+
+static void test_round_trip() {
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1700000000000ULL;
+  static int64_t int_value;
+  static float float_value;
+  static double double_value;
+  static BasicTagSeries int_series, float_series, double_series;
+  static uint8_t int_storage[64 * 1024], float_storage[64 * 1024], double_storage[64 * 1024];
+  FunctionalBasicTag* int_tag = createInt64Tag("int", &int_value, -1, true, true);
+  FunctionalBasicTag* float_tag = createFloatTag("float", &float_value, -1, true, true);
+  FunctionalBasicTag* double_tag = createDoubleTag("double", &double_value, -1, true, true);
+  CHECK(attachTagSeries(int_tag, &int_series, int_storage, sizeof(int_storage), 512));
+  CHECK(attachTagSeries(float_tag, &float_series, float_storage, sizeof(float_storage), 512));
+  CHECK(attachTagSeries(double_tag, &double_series, double_storage, sizeof(double_storage), 1024));
+
+  srand(3);
+  float_value = 20;
+  double_value = 1;
+  for (size_t k = 0; k < SAMPLES; k++) {
+    next_timestamp(k);
+    int64_t delta = rand() % 2000 - 1000;
+    if (k == 77) int_value = INT64_MIN;
+    else if (k == 78) int_value = INT64_MAX;
+    else if (k == 79) int_value = 0;
+    else int_value += delta != 0 ? delta : 1;  // Changes on every sample
+    float_value += (float)(rand() % 21 - 10) * 0.01f;
+    double_value = double_value * 1.0001 + (double)(k % 3) + 0.5;
+    readAllBasicTags();
+    int_samples[k] = int_value;
+    float_samples[k] = float_value;
+    double_samples[k] = double_value;
+  }
+
+  size_t count = readTagSeries(int_tag, 0, UINT64_MAX, decoded, SAMPLES);
+  CHECK(count == SAMPLES && int_series.samples == SAMPLES && int_series.dropped == 0);
+  for (size_t k = 0; k < count; k++) {
+    CHECK(decoded[k].timestamp == timestamps[k] && decoded[k].datatype == spInt64);
+    CHECK(decoded[k].value.int64Value == int_samples[k]);
+  }
+
+  count = readTagSeries(double_tag, 0, UINT64_MAX, decoded, SAMPLES);
+  CHECK(count == SAMPLES);
+  for (size_t k = 0; k < count; k++) CHECK(decoded[k].value.doubleValue == double_samples[k] && decoded[k].timestamp == timestamps[k]);
+
+  // Floats only get a sample when the value changed, each one matches the value recorded at its timestamp
+  count = readTagSeries(float_tag, 0, UINT64_MAX, decoded, SAMPLES);
+  CHECK(count == float_series.samples && count > 0);
+  size_t k = 0;
+  for (size_t i = 0; i < count; i++) {
+    while (k < SAMPLES && timestamps[k] != decoded[i].timestamp) k++;
+    CHECK(k < SAMPLES);
+    if (k < SAMPLES) CHECK(decoded[i].value.floatValue == float_samples[k]);
+  }
+
+  // Compression, the regular int64 deltas fit in well under the 16 bytes of a raw sample
+  CHECK((size_t)int_series.blocks_used * 512 < SAMPLES * 16);
+
+  // Range queries are inclusive and stop at max_values
+  count = readTagSeries(int_tag, timestamps[100], timestamps[199], decoded, SAMPLES);
+  CHECK(count == 100 && decoded[0].timestamp == timestamps[100] && decoded[99].timestamp == timestamps[199]);
+  count = readTagSeries(int_tag, timestamps[100], timestamps[199], decoded, 10);
+  CHECK(count == 10 && decoded[9].timestamp == timestamps[109]);
+  CHECK(readTagSeries(int_tag, timestamps[SAMPLES - 1] + 1, UINT64_MAX, decoded, SAMPLES) == 0);
+}
+
+static void test_block_reuse() {
+  // A small ring keeps the newest samples, in order, and counts the dropped ones
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  static int8_t value;
+  static BasicTagSeries series;
+  static uint8_t storage[256];
+  FunctionalBasicTag* tag = createInt8Tag("small", &value, -1, true, true);
+  CHECK(attachTagSeries(tag, &series, storage, sizeof(storage), 128));
+  for (size_t k = 0; k < SAMPLES; k++) {
+    next_timestamp(k);
+    value = (int8_t)(k % 7) - 3;
+    readAllBasicTags();
+  }
+  size_t count = readTagSeries(tag, 0, UINT64_MAX, decoded, SAMPLES);
+  CHECK(count == series.samples && series.dropped > 0 && count + series.dropped == SAMPLES);
+  for (size_t i = 0; i < count; i++) {
+    size_t k = SAMPLES - count + i;
+    CHECK(decoded[i].timestamp == timestamps[k] && decoded[i].value.int8Value == (int8_t)((int8_t)(k % 7) - 3));
+  }
+}
+
+static void test_boolean() {
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  static bool value;
+  static BasicTagSeries series;
+  static uint8_t storage[4096];
+  FunctionalBasicTag* tag = createBoolTag("bool", &value, -1, true, true);
+  CHECK(attachTagSeries(tag, &series, storage, sizeof(storage), 256));
+  for (size_t k = 0; k < 200; k++) {
+    next_timestamp(k);
+    value = (k / 10) % 2;
+    readAllBasicTags();
+  }
+  size_t count = readTagSeries(tag, 0, UINT64_MAX, decoded, SAMPLES);
+  CHECK(count == 20);  // A sample per change, the first read included
+  for (size_t i = 0; i < count; i++) CHECK(decoded[i].value.boolValue == (i % 2 == 1) && decoded[i].timestamp == timestamps[i * 10]);
+}
+
+int main() {
+  setBasicTagTimestampFunction(basic_tag_test_now);
+  RUN_TEST(test_attach);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_block_reuse);
+  RUN_TEST(test_boolean);
+  return basic_tag_test_result();
+}
@@ -0,0 +1,253 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Tag snapshots: save / restore round trips, rejected images (CRC mismatch, truncation, bad magic) and value only restores
+*/
+
+#include "basic_tag_test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int32_t int_value;
+static double double_value;
+static char string_value[17];
+static uint8_t bytes_content[8];
+static BufferValue bytes_value;
+static int changes;
+
+static void count_change(FunctionalBasicTag* tag) {
+  (void)tag;
+  changes++;
+}
+
+static void* resolve(const char* name, int alias, SparkplugDataType datatype, void* arg) {
+  (void)alias;
+  (void)datatype;
+  (void)arg;
+  if (name == NULL) return NULL;
+  if (strcmp(name, "int") == 0) return &int_value;
+  if (strcmp(name, "double") == 0) return &double_value;
+  if (strcmp(name, "string") == 0) return string_value;
+  if (strcmp(name, "bytes") == 0) return &bytes_value;
+  return NULL;  // "gone" is no longer in the application
+}
+
+static void create_tags() {
+  static int32_t gone_value = 9;
+  bytes_value.buffer = bytes_content;
+  bytes_value.written_length = 3;
+  bytes_value.allocated_length = sizeof(bytes_content);
+  bytes_content[0] = 1;
+  bytes_content[1] = 2;
+  bytes_content[2] = 3;
+  int_value = 5;
+  double_value = 1.5;
+  strcpy(string_value, "hello");
+  createTag("int", &int_value, 1, spInt32, true, false, 0);
+  createTag("double", &double_value, 2, spDouble, true, true, 0);
+  createTag("string", string_value, 3, spString, true, false, 16);
+  createTag("bytes", &bytes_value, 4, spBytes, true, false, 8);
+  createTag("gone", &gone_value, 5, spInt32, false, false, 0);
+  setTagScanPeriod(getTagByAlias(2), 250);
+  readAllBasicTags();
+}
+
+static uint8_t* save(size_t* length) {
+  *length = saveBasicTagSnapshot(NULL, 0);
+  uint8_t* buffer = (uint8_t*)malloc(*length);
+  CHECK(buffer != NULL);
+  CHECK(saveBasicTagSnapshot(buffer, *length - 1) == 0);  // Doesn't fit
+  CHECK(saveBasicTagSnapshot(buffer, *length) == *length);
+  return buffer;
+}
+
+static void test_crc32() {
+  CHECK(basicTagCrc32("123456789", 9, 0) == 0xCBF43926u);
+  // Chunked gives the same result
+  CHECK(basicTagCrc32("6789", 4, basicTagCrc32("12345", 5, 0)) == 0xCBF43926u);
+}
+
+static void test_round_trip() {
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  create_tags();
+  size_t length;
+  uint8_t* snapshot = save(&length);
+  CHECK(length > 20);
+
+  basic_tag_test_clear_tags();
+  CHECK(restoreBasicTagSnapshot(snapshot, length, resolve, NULL) == 4);
+  CHECK(getTagsCount() == 4);
+  CHECK(getTagByName("gone") == NULL);
+
+  FunctionalBasicTag* tag = getTagByName("int");
+  CHECK(tag != NULL && tag->alias == 1 && tag->currentValue.value.int32Value == 5 && tag->currentValue.timestamp == 1000);
+  CHECK(tag != NULL && tag->local_writable && !tag->remote_writable);
+  tag = getTagByAlias(2);
+  CHECK(tag != NULL && tag->currentValue.value.doubleValue == 1.5 && tag->remote_writable && tag->scan_period == 250);
+  tag = getTagByName("string");
+  CHECK(tag != NULL && strcmp(tag->currentValue.value.stringValue, "hello") == 0);
+  tag = getTagByName("bytes");
+  CHECK(tag != NULL && tag->currentValue.value.bytesValue->written_length == 3 && tag->currentValue.value.bytesValue->buffer[2] == 3);
+
+  // The first scan after a restore only reports what changed while the device was down
+  for (size_t i = 0; i < getTagsCount(); i++) addOnChangeCallback(getTagByIdx(i), count_change);
+  changes = 0;
+  basic_tag_test_clock = 2000;
+  readAllBasicTags();
+  CHECK(changes == 0);
+  double_value = 2.5;
+  readAllBasicTags();
+  CHECK(changes == 1);
+  basic_tag_test_clear_tags();  // The restored names point into the snapshot
+  free(snapshot);
+}
+
+static void test_restore_over_existing_tags() {
+  // Aliases stay unique and the restored tags shadow the existing names
+  basic_tag_test_clear_tags();
+  create_tags();
+  size_t length;
+  uint8_t* snapshot = save(&length);
+  CHECK(restoreBasicTagSnapshot(snapshot, length, resolve, NULL) == 4);
+  CHECK(getTagsCount() == 9);
+  for (size_t i = 0; i < getTagsCount(); i++) {
+    FunctionalBasicTag* tag = getTagByIdx(i);
+    CHECK(tag->_idx == i);
+    for (size_t j = i + 1; j < getTagsCount(); j++) CHECK(tag->alias != getTagByIdx(j)->alias);
+  }
+  FunctionalBasicTag* restored = getTagByName("int");
+  CHECK(restored != NULL && restored->alias > 5);
+  CHECK(aliasValid(getNextAlias()));
+  deleteTag(restored);
+  CHECK(getTagByName("int") != NULL && getTagByName("int")->alias == 1);
+  basic_tag_test_clear_tags();  // The restored names point into the snapshot
+  free(snapshot);
+}
+
+static void test_rejected_images() {
+  basic_tag_test_clear_tags();
+  create_tags();
+  size_t length;
+  uint8_t* snapshot = save(&length);
+  basic_tag_test_clear_tags();
+
+  // CRC mismatch, a flipped bit anywhere in the body rejects the whole image
+  snapshot[length - 1] ^= 0x01;
+  CHECK(restoreBasicTagSnapshot(snapshot, length, resolve, NULL) == 0);
+  CHECK(restoreBasicTagValues(snapshot, length) == 0);
+  CHECK(getTagsCount() == 0);
+  snapshot[length - 1] ^= 0x01;
+
+  // Truncated
+  CHECK(restoreBasicTagSnapshot(snapshot, length - 1, resolve, NULL) == 0);
+  CHECK(restoreBasicTagSnapshot(snapshot, 10, resolve, NULL) == 0);
+  // Bad magic
+  snapshot[0] ^= 0xFF;
+  CHECK(restoreBasicTagSnapshot(snapshot, length, resolve, NULL) == 0);
+  snapshot[0] ^= 0xFF;
+  // No resolve callback or no data
+  CHECK(restoreBasicTagSnapshot(snapshot, length, NULL, NULL) == 0);
+  CHECK(restoreBasicTagSnapshot(NULL, length, resolve, NULL) == 0);
+  CHECK(getTagsCount() == 0);
+
+  // Still restores once it is intact
+  CHECK(restoreBasicTagSnapshot(snapshot, length, resolve, NULL) == 4);
+  basic_tag_test_clear_tags();  // The restored names point into the snapshot
+  free(snapshot);
+}
+
+static CompactBasicTag pool[4];
+static float compact_value;
+
+static void* resolve_compact(const char* name, int alias, SparkplugDataType datatype, void* arg) {
+  if (name != NULL && strcmp(name, "compact") == 0) return &compact_value;
+  return resolve(name, alias, datatype, arg);
+}
+
+static void delete_compact(CompactBasicTag* tag) {
+  deleteCompactTag(tag);
+}
+
+static void test_compact_tags() {
+  // Compact tags are saved with their own flag and come back as compact tags
+  basic_tag_test_clear_tags();
+  CHECK(setCompactTagStorage(pool, 4));
+  basic_tag_test_clock = 1000;
+  compact_value = 0.25f;
+  createTag("int", &int_value, 1, spInt32, true, false, 0);
+  createCompactTag("compact", &compact_value, 7, spFloat, true, false);
+  readAllBasicTags();
+  size_t length;
+  uint8_t* snapshot = save(&length);
+
+  iterCompactTags(delete_compact);
+  basic_tag_test_clear_tags();
+  CHECK(restoreBasicTagSnapshot(snapshot, length, resolve_compact, NULL) == 2);
+  CHECK(getTagsCount() == 1 && getCompactTagsCount() == 1 && getTagByName("compact") == NULL);
+  CompactBasicTag* compact = getCompactTagByName("compact");
+  CHECK(compact != NULL && compact->alias == 7 && compact->datatype == spFloat && compact->value.floatValue == 0.25f);
+  CHECK((compact->flags & BASIC_TAG_COMPACT_LOCAL_WRITABLE) && !(compact->flags & BASIC_TAG_COMPACT_REMOTE_WRITABLE));
+  CHECK(getCompactTagTimestamp(compact) == 1000);
+  basic_tag_test_clock = 2000;
+  CHECK(!readAllBasicTags());  // Restored values aren't reported as a first read
+
+  // Value only restores match compact tags by name and datatype
+  compact_value = 3.5f;
+  readAllBasicTags();
+  CHECK(restoreBasicTagValues(snapshot, length) == 2);
+  CHECK(compact->value.floatValue == 0.25f && getCompactTagTimestamp(compact) == 1000);
+  iterCompactTags(delete_compact);
+  basic_tag_test_clear_tags();  // The restored names point into the snapshot
+  free(snapshot);
+}
+
+static void test_restore_values() {
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  create_tags();
+  size_t length;
+  uint8_t* snapshot = save(&length);
+
+  // Values only go into existing tags with the same name and datatype
+  BasicValue written = {0, spInt32, {.int32Value = 77}, false};
+  int_value = 99;
+  writeBasicTag(getTagByName("int"), &written);
+  CHECK(restoreBasicTagValues(snapshot, length) == 5);
+  CHECK(getTagByName("int")->currentValue.value.int32Value == 5);
+  int_value = 5;
+  CHECK(!readBasicTag(getTagByName("int"), 2000));
+
+  deleteTag(getTagByName("double"));
+  static float float_value;
+  createTag("double", &float_value, -1, spFloat, false, false, 0);  // Same name, another datatype
+  CHECK(restoreBasicTagValues(snapshot, length) == 4);
+  basic_tag_test_clear_tags();
+  free(snapshot);
+}
+
+int main() {
+  setBasicTagTimestampFunction(basic_tag_test_now);
+  RUN_TEST(test_crc32);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_restore_over_existing_tags);
+  RUN_TEST(test_rejected_images);
+  RUN_TEST(test_restore_values);
+  RUN_TEST(test_compact_tags);
+  return basic_tag_test_result();
+}
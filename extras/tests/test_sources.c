@@ -0,0 +1,198 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Value sources: one fetch per scan for the span the tags use, failed fetches keep the last values, writes are
+stored back. Zero copy bytes tags: a publish is a change, the tag points at the producer's buffers
+*/
+
+#include "basic_tag_test.h"
+
+#include <string.h>
+
+typedef struct {
+  uint64_t registers[4];  // The device, 32 bytes
+  int fetches;
+  int stores;
+  size_t offset;
+  size_t length;
+  bool fail;
+} Device;
+
+static Device device;
+
+static bool fetch(void* arg, uint8_t* data, size_t offset, size_t length) {
+  Device* from = (Device*)arg;
+  from->fetches++;
+  from->offset = offset;
+  from->length = length;
+  if (from->fail) return false;
+  memcpy(data, (uint8_t*)(from->registers) + offset, length);
+  return true;
+}
+
+static bool store(void* arg, uint8_t* data, size_t offset, size_t length) {
+  Device* to = (Device*)arg;
+  to->stores++;
+  to->offset = offset;
+  to->length = length;
+  memcpy((uint8_t*)(to->registers) + offset, data, length);
+  return true;
+}
+
+static void device_write(size_t offset, const void* data, size_t length) {
+  memcpy((uint8_t*)(device.registers) + offset, data, length);
+}
+
+static void test_block_source() {
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  memset(&device, 0, sizeof(device));
+  static uint64_t block[4];
+  static BasicTagSource source;
+  CHECK(!initBasicTagSource(&source, block, 0, fetch, store, &device));
+  CHECK(initBasicTagSource(&source, block, sizeof(block), fetch, store, &device));
+  int32_t count = 41;
+  uint16_t status = 7;
+  float level = 2.5f;
+  device_write(8, &count, sizeof(count));
+  device_write(4, &status, sizeof(status));
+  device_write(16, &level, sizeof(level));
+  device_write(20, "pump", 5);
+
+  FunctionalBasicTag* count_tag = createSourceTag("count", &source, 8, -1, spInt32, true, false, 0);
+  FunctionalBasicTag* status_tag = createSourceTag("status", &source, 4, -1, spUInt16, false, false, 0);
+  FunctionalBasicTag* level_tag = createSourceTag("level", &source, 16, -1, spFloat, false, false, 0);
+  FunctionalBasicTag* name_tag = createSourceTag("name", &source, 20, -1, spString, false, false, 7);
+  CHECK(count_tag != NULL && status_tag != NULL && level_tag != NULL && name_tag != NULL && source.tags == 4);
+  CHECK(createSourceTag("misaligned", &source, 2, -1, spInt32, false, false, 0) == NULL);
+  CHECK(createSourceTag("outside", &source, 30, -1, spInt32, false, false, 0) == NULL);
+  CHECK(createSourceTag("bytes", &source, 0, -1, spBytes, false, false, 8) == NULL);
+
+  // Fetched once per scan, only the span the tags cover (4 to the end of the string)
+  CHECK(readAllBasicTags());
+  CHECK(device.fetches == 1 && device.offset == 4 && device.length == 24 && source.fetches == 1);
+  CHECK(count_tag->currentValue.value.int32Value == 41 && status_tag->currentValue.value.uint16Value == 7);
+  CHECK(level_tag->currentValue.value.floatValue == 2.5f && strcmp(name_tag->currentValue.value.stringValue, "pump") == 0);
+  count = 42;
+  device_write(8, &count, sizeof(count));
+  basic_tag_test_clock++;
+  size_t changed[4];
+  CHECK(readAllBasicTagsChanged(changed, 4) == 1 && changed[0] == 0 && device.fetches == 2);
+  CHECK(count_tag->_scan_group != 0xFF && count_tag->currentValue.value.int32Value == 42);
+
+  // A failed fetch leaves the block alone, the tags keep their values
+  device.fail = true;
+  count = 43;
+  device_write(8, &count, sizeof(count));
+  basic_tag_test_clock++;
+  CHECK(!readAllBasicTags() && source.errors == 1 && count_tag->currentValue.value.int32Value == 42);
+  CHECK(!fetchBasicTagSources() && source.errors == 2);
+  device.fail = false;
+  CHECK(fetchBasicTagSources() && source.fetches == 3);
+
+  // Writes go to the block, then to the device
+  BasicValue write = {0, spInt32, {.int32Value = -8}, false};
+  CHECK(writeBasicTag(count_tag, &write));
+  CHECK(device.stores == 1 && device.offset == 8 && device.length == 4);
+  memcpy(&count, (uint8_t*)(device.registers) + 8, sizeof(count));
+  CHECK(count == -8);
+
+  // readDueBasicTags only fetches when one of the source's tags is due
+  for (size_t i = 0; i < getTagsCount(); i++) setTagScanPeriod(getTagByIdx(i), 100);
+  int fetches = device.fetches;
+  uint64_t last_read = getTagLastRead(count_tag);
+  CHECK(!readDueBasicTags(last_read + 99) && device.fetches == fetches);
+  CHECK(readDueBasicTags(last_read + 100) && device.fetches == fetches + 1);  // count changed to -8 since the last read
+  CHECK(count_tag->currentValue.value.int32Value == -8);
+  CHECK(!readDueBasicTags(last_read + 150) && device.fetches == fetches + 1);
+  CHECK(!readDueBasicTags(last_read + 200) && device.fetches == fetches + 2);
+
+  // The source leaves the scan with its last tag
+  basic_tag_test_clear_tags();
+  CHECK(source.tags == 0);
+  readAllBasicTags();
+  CHECK(device.fetches == fetches + 2);
+}
+
+static void test_read_in_place() {
+  // Without a fetch function the block is read as it is, eg. DMA
+  basic_tag_test_clear_tags();
+  static uint32_t block[2];
+  static BasicTagSource source;
+  CHECK(initBasicTagSource(&source, block, sizeof(block), NULL, NULL, NULL));
+  FunctionalBasicTag* tag = createSourceTag("dma", &source, 4, -1, spUInt32, true, true, 0);
+  block[1] = 9;
+  readAllBasicTags();
+  CHECK(tag->currentValue.value.uint32Value == 9 && source.fetches == 0);
+  BasicValue write = {0, spUInt32, {.uint32Value = 10}, false};
+  CHECK(writeBasicTag(tag, &write) && block[1] == 10);
+}
+
+static void test_zero_copy_bytes() {
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  static uint8_t buffer_a[16], buffer_b[16];
+  static BasicTagBytesSource source, single;
+  CHECK(!initBasicTagBytesSource(&source, NULL, buffer_b, 16));
+  CHECK(initBasicTagBytesSource(&single, buffer_a, NULL, 16));
+  CHECK(createZeroCopyBytesTag("single", &single, -1, false, false, true) == NULL);  // The previous value needs two buffers
+  CHECK(beginBasicTagBytesWrite(&single) == &(single.buffers[0]));
+
+  CHECK(initBasicTagBytesSource(&source, buffer_a, buffer_b, 16));
+  FunctionalBasicTag* tag = createZeroCopyBytesTag("frame", &source, -1, true, false, true);
+  CHECK(tag != NULL && readAllBasicTags());
+  CHECK(tag->currentValue.value.bytesValue == &(source.buffers[0]) && tag->previousValue.isNull);
+
+  // Nothing is a change until it is published
+  BufferValue* next = beginBasicTagBytesWrite(&source);
+  CHECK(next == &(source.buffers[1]));
+  memcpy(next->buffer, "abc", 3);
+  next->written_length = 3;
+  basic_tag_test_clock++;
+  CHECK(!readAllBasicTags());
+  CHECK(publishBasicTagBytes(&source) && source.generation == 1);
+  size_t changed[1];
+  CHECK(readAllBasicTagsChanged(changed, 1) == 1 && changed[0] == 0);
+  CHECK(tag->currentValue.value.bytesValue->buffer == buffer_b && tag->currentValue.value.bytesValue->written_length == 3);
+  CHECK(tag->currentValue.timestamp == 1001 && tag->previousValue.value.bytesValue == &(source.buffers[0]));
+  basic_tag_test_clock++;
+  CHECK(!readAllBasicTags());
+
+  // Publishing the same content is still a change
+  CHECK(publishBasicTagBytes(&source));
+  basic_tag_test_clock++;
+  CHECK(readAllBasicTags() && tag->currentValue.value.bytesValue->buffer == buffer_a);
+
+  // Writes go through the source like the producer's
+  uint8_t data[2] = {1, 2};
+  BufferValue bytes = {data, 2, 2};
+  BasicValue write = {0, spBytes, {.bytesValue = &bytes}, false};
+  CHECK(writeBasicTag(tag, &write) && source.generation == 3);
+  basic_tag_test_clock++;
+  CHECK(readAllBasicTags());
+  CHECK(tag->currentValue.value.bytesValue->buffer == buffer_b && tag->currentValue.value.bytesValue->written_length == 2);
+  CHECK(memcmp(buffer_b, data, 2) == 0);
+}
+
+int main() {
+  setBasicTagTimestampFunction(basic_tag_test_now);
+  RUN_TEST(test_block_source);
+  RUN_TEST(test_read_in_place);
+  RUN_TEST(test_zero_copy_bytes);
+  basic_tag_test_clear_tags();
+  return basic_tag_test_result();
+}
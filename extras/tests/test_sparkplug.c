@@ -0,0 +1,387 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Sparkplug B encoder: the payloads are decoded again with a minimal protobuf reader and checked field by field,
+the value encoding of every datatype, Null values, and data payloads split to fit the buffer
+*/
+
+#include "basic_tag_test.h"
+#include "BasicTagSparkplug.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_METRICS 64
+
+typedef struct {
+  char name[32];
+  bool has_name;
+  int64_t alias;  // -1 when not sent
+  uint64_t timestamp;
+  uint32_t datatype;
+  bool is_null;
+  uint32_t value_field;  // Field number of the value, 0 for none
+  uint64_t value;  // Varint or fixed bits
+  char text[32];  // String and bytes values
+  size_t text_length;
+} Metric;
+
+typedef struct {
+  uint64_t timestamp;
+  uint64_t seq;
+  size_t count;
+  Metric metrics[MAX_METRICS];
+} Payload;
+
+static uint8_t buffer[4096];
+static Payload payload;
+
+static bool read_varint(const uint8_t** cursor, const uint8_t* end, uint64_t* value) {
+  *value = 0;
+  for (unsigned int shift = 0; shift < 64; shift += 7) {
+    if (*cursor >= end) return false;
+    uint8_t byte = *(*cursor)++;
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+static bool read_field(const uint8_t** cursor, const uint8_t* end, uint32_t* field, uint64_t* value, const uint8_t** data) {
+  // value is the varint or fixed bits, or the length of a LEN field whose bytes start at data
+  uint64_t key;
+  if (!read_varint(cursor, end, &key)) return false;
+  *field = (uint32_t)(key >> 3);
+  switch (key & 7) {
+    case 0:
+      return read_varint(cursor, end, value);
+    case 1:
+    case 5: {
+      size_t size = (key & 7) == 1 ? 8 : 4;
+      if ((size_t)(end - *cursor) < size) return false;
+      *value = 0;
+      for (size_t i = 0; i < size; i++) *value |= (uint64_t)(*cursor)[i] << (8 * i);
+      *cursor += size;
+      return true;
+    }
+    case 2:
+      if (!read_varint(cursor, end, value) || *value > (uint64_t)(end - *cursor)) return false;
+      *data = *cursor;
+      *cursor += *value;
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool decode_metric(const uint8_t* cursor, const uint8_t* end, Metric* metric) {
+  memset(metric, 0, sizeof(Metric));
+  metric->alias = -1;
+  while (cursor < end) {
+    uint32_t field;
+    uint64_t value = 0;
+    const uint8_t* data = NULL;
+    if (!read_field(&cursor, end, &field, &value, &data)) return false;
+    switch (field) {
+      case 1:
+        if (value >= sizeof(metric->name)) return false;
+        memcpy(metric->name, data, (size_t)value);
+        metric->has_name = true;
+        break;
+      case 2: metric->alias = (int64_t)value; break;
+      case 3: metric->timestamp = value; break;
+      case 4: metric->datatype = (uint32_t)value; break;
+      case 7: metric->is_null = value != 0; break;
+      case 15:
+      case 16:
+        if (value > sizeof(metric->text)) return false;
+        memcpy(metric->text, data, (size_t)value);
+        metric->text_length = (size_t)value;
+        metric->value_field = field;
+        break;
+      default:
+        if (field < 10 || field > 14) return false;
+        metric->value_field = field;
+        metric->value = value;
+        break;
+    }
+  }
+  return true;
+}
+
+static bool decode(const uint8_t* data, size_t length) {
+  memset(&payload, 0, sizeof(payload));
+  const uint8_t* cursor = data;
+  const uint8_t* end = data + length;
+  while (cursor < end) {
+    uint32_t field;
+    uint64_t value = 0;
+    const uint8_t* body = NULL;
+    if (!read_field(&cursor, end, &field, &value, &body)) return false;
+    if (field == 1) payload.timestamp = value;
+    else if (field == 3) payload.seq = value;
+    else if (field == 2) {
+      if (payload.count == MAX_METRICS || !decode_metric(body, body + value, &(payload.metrics[payload.count]))) return false;
+      payload.count++;
+    } else return false;
+  }
+  return true;
+}
+
+static Metric* find_metric(const char* name, int64_t alias) {
+  for (size_t i = 0; i < payload.count; i++) {
+    Metric* metric = &(payload.metrics[i]);
+    if (name != NULL ? metric->has_name && strcmp(metric->name, name) == 0 : metric->alias == alias) return metric;
+  }
+  return NULL;
+}
+
+static size_t changed[64];
+
+static uint64_t int_bits(int32_t value) {
+  // int_value is a uint32 on the wire, signed values are sign extended to 32 bits
+  return (uint32_t)value;
+}
+
+static void test_birth_datatypes() {
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  static int8_t int8_value = -5;
+  static int16_t int16_value = -300;
+  static uint32_t uint32_value = 4000000000u;
+  static int64_t int64_value = -3;
+  static uint64_t datetime_value = 1700000000000ULL;
+  static float float_value = 1.25f;
+  static double double_value = -2.5;
+  static bool bool_value = true;
+  static char string_value[16] = "hello";
+  static char empty_value[16] = "";
+  static uint8_t bytes_data[4] = {1, 2, 3};
+  static BufferValue bytes_value = {bytes_data, 3, 4};
+  static uint64_t bd_seq = 7;
+  createInt8Tag("int8", &int8_value, 1, false, false);
+  createInt16Tag("int16", &int16_value, 2, false, false);
+  createUInt32Tag("uint32", &uint32_value, 3, false, false);
+  createInt64Tag("int64", &int64_value, 4, false, false);
+  createDateTimeTag("datetime", &datetime_value, 5, false, false);
+  createFloatTag("float", &float_value, 6, false, false);
+  createDoubleTag("double", &double_value, 7, false, false);
+  createBoolTag("bool", &bool_value, 8, false, false);
+  createStringTag("string", string_value, 9, false, false, 15);
+  createStringTag("empty", empty_value, 10, false, false, 15);
+  createBytesTag("bytes", &bytes_value, 11, false, false, 4);
+  createUInt64Tag("bdSeq", &bd_seq, -1000, false, false);
+  readAllBasicTags();
+
+  size_t length = encodeSparkplugBirth(buffer, sizeof(buffer), 1000, 0);
+  CHECK(length > 0 && decode(buffer, length) && payload.count == 12 && payload.timestamp == 1000 && payload.seq == 0);
+  for (size_t i = 0; i < payload.count; i++) {
+    // Births describe every metric with its name, datatype and the timestamp of its value
+    Metric* metric = &(payload.metrics[i]);
+    FunctionalBasicTag* tag = getTagByName(metric->name);
+    CHECK(tag != NULL && metric->datatype == (uint32_t)tag->datatype && metric->timestamp == 1000);
+    CHECK(metric->alias == (tag->alias >= 0 ? tag->alias : -1));
+  }
+
+  Metric* metric = find_metric("int8", 0);
+  CHECK(metric != NULL && metric->value_field == 10 && metric->value == int_bits(-5));
+  metric = find_metric("int16", 0);
+  CHECK(metric != NULL && metric->value_field == 10 && metric->value == int_bits(-300));
+  metric = find_metric("uint32", 0);
+  CHECK(metric != NULL && metric->value_field == 10 && metric->value == 4000000000u);
+  metric = find_metric("int64", 0);
+  CHECK(metric != NULL && metric->value_field == 11 && metric->value == (uint64_t)(int64_t)-3);
+  metric = find_metric("datetime", 0);
+  CHECK(metric != NULL && metric->value_field == 11 && metric->value == 1700000000000ULL);
+  metric = find_metric("float", 0);
+  uint32_t float_bits;
+  memcpy(&float_bits, &float_value, sizeof(float_bits));
+  CHECK(metric != NULL && metric->value_field == 12 && metric->value == float_bits);
+  metric = find_metric("double", 0);
+  uint64_t double_bits;
+  memcpy(&double_bits, &double_value, sizeof(double_bits));
+  CHECK(metric != NULL && metric->value_field == 13 && metric->value == double_bits);
+  metric = find_metric("bool", 0);
+  CHECK(metric != NULL && metric->value_field == 14 && metric->value == 1);
+  metric = find_metric("string", 0);
+  CHECK(metric != NULL && metric->value_field == 15 && metric->text_length == 5 && memcmp(metric->text, "hello", 5) == 0);
+  metric = find_metric("empty", 0);
+  CHECK(metric != NULL && metric->is_null && metric->value_field == 0);  // Empty strings are Null
+  metric = find_metric("bytes", 0);
+  CHECK(metric != NULL && metric->value_field == 16 && metric->text_length == 3 && memcmp(metric->text, bytes_data, 3) == 0);
+  metric = find_metric("bdSeq", 0);
+  CHECK(metric != NULL && metric->alias == -1 && metric->value_field == 11 && metric->value == 7);
+  CHECK(find_metric(NULL, 11) != NULL && strcmp(find_metric(NULL, 11)->name, "bytes") == 0);
+}
+
+static void test_data_split() {
+  // Data payloads carry only the alias of each metric, the changes are split over payloads that fit
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  static int32_t values[6];
+  static const char* names[6] = {"a", "b", "c", "d", "e", "by name"};
+  for (int i = 0; i < 6; i++) {
+    values[i] = 0;
+    createInt32Tag(names[i], &(values[i]), i < 5 ? 10 + i : -1, false, false);
+  }
+  readAllBasicTags();
+  for (int i = 0; i < 6; i++) values[i] = 100 + i;
+  basic_tag_test_clock = 2000;
+  size_t count = readAllBasicTagsChanged(changed, 64);
+  CHECK(count == 6);
+
+  size_t encoded = 0;
+  size_t needed = encodeSparkplugData(NULL, 0, 2000, 5, changed, count, &encoded);
+  CHECK(needed > 0 && encoded == 6);
+  size_t length = encodeSparkplugData(buffer, needed, 2000, 5, changed, count, &encoded);
+  CHECK(length == needed && encoded == 6 && decode(buffer, length) && payload.count == 6 && payload.seq == 5);
+  for (int i = 0; i < 5; i++) {
+    Metric* metric = &(payload.metrics[i]);
+    CHECK(!metric->has_name && metric->alias == 10 + i && metric->datatype == 0 && metric->timestamp == 2000);
+    CHECK(metric->value_field == 10 && metric->value == (uint64_t)(100 + i));
+  }
+  CHECK(payload.metrics[5].has_name && strcmp(payload.metrics[5].name, "by name") == 0 && payload.metrics[5].alias == -1);
+
+  // Resume with changed + encoded until every change is sent
+  size_t capacity = needed / 2;
+  size_t sent = 0;
+  int payloads = 0;
+  int64_t next_alias = 10;
+  while (sent < count && payloads < 10) {
+    length = encodeSparkplugData(buffer, capacity, 2000, (uint64_t)payloads, changed + sent, count - sent, &encoded);
+    CHECK(length > 0 && length <= capacity && encoded > 0);
+    CHECK(decode(buffer, length) && payload.count == encoded);
+    for (size_t k = 0; k < payload.count && next_alias < 15; k++) CHECK(payload.metrics[k].alias == next_alias++);
+    sent += encoded;
+    payloads++;
+  }
+  CHECK(sent == count && payloads >= 2 && next_alias == 15);
+  CHECK(encodeSparkplugData(buffer, 8, 2000, 0, changed, count, &encoded) == 0 && encoded == 0);  // Not even one metric fits
+  length = encodeSparkplugData(buffer, sizeof(buffer), 2000, 0, changed, 0, &encoded);
+  CHECK(length > 0 && decode(buffer, length) && payload.count == 0);  // Header only, eg. a keep alive
+}
+
+static void test_data_bitmap() {
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  static int32_t values[40];
+  static char names[40][8];
+  for (int i = 0; i < 40; i++) {
+    snprintf(names[i], sizeof(names[i]), "t%d", i);
+    values[i] = 0;
+    createInt32Tag(names[i], &(values[i]), 10 + i, false, false);  // One byte aliases, every metric is the same size
+  }
+  readAllBasicTags();
+  values[3] = values[31] = values[32] = values[39] = 1;
+  basic_tag_test_clock = 2000;
+  uint32_t bitmap[2];
+  CHECK(readAllBasicTagsBitmap(bitmap, 2) == 4);
+  CHECK(bitmap[0] == ((1u << 3) | (1u << 31)) && bitmap[1] == ((1u << 0) | (1u << 7)));
+
+  // Room for two metrics, the second payload starts at the first tag that didn't fit
+  size_t pair[2] = {3, 31};
+  size_t capacity = encodeSparkplugData(NULL, 0, 2000, 0, pair, 2, NULL);
+  size_t next_idx = 0;
+  size_t length = encodeSparkplugDataBitmap(buffer, capacity, 2000, 0, bitmap, 2, &next_idx);
+  CHECK(length > 0 && next_idx == 32 && decode(buffer, length) && payload.count == 2);
+  CHECK(payload.metrics[0].alias == 13 && payload.metrics[1].alias == 41);
+  length = encodeSparkplugDataBitmap(buffer, capacity, 2000, 1, bitmap, 2, &next_idx);
+  CHECK(length > 0 && next_idx == 64 && decode(buffer, length) && payload.count == 2);
+  CHECK(payload.metrics[0].alias == 42 && payload.metrics[1].alias == 49);
+  next_idx = 0;
+  CHECK(encodeSparkplugDataBitmap(NULL, 0, 2000, 0, bitmap, 2, &next_idx) > capacity && next_idx == 64);
+  CHECK(encodeSparkplugDataBitmap(buffer, capacity, 2000, 0, NULL, 2, &next_idx) == 0);
+}
+
+static CompactBasicTag pool[8];
+
+static void delete_compact(CompactBasicTag* tag) {
+  deleteCompactTag(tag);
+}
+
+static void clear_all() {
+  iterCompactTags(delete_compact);
+  basic_tag_test_clear_tags();
+}
+
+static void test_compact_tags() {
+  // Compact tags share the alias namespace, a birth has to describe them and their changes have to reach NDATA
+  clear_all();
+  basic_tag_test_clock = 1000;
+  static int32_t x;
+  static float y;
+  static bool z;
+  CHECK(setCompactTagStorage(pool, 8));
+  createInt32Tag("x", &x, 1, true, true);
+  CompactBasicTag* compact_y = createCompactTag("y", &y, 2, spFloat, true, true);
+  createCompactTag("z", &z, -1000, spBoolean, false, false);
+  CHECK(!aliasValid(2));
+  readAllBasicTags();
+
+  size_t length = encodeSparkplugBirth(buffer, sizeof(buffer), 1000, 0);
+  CHECK(length > 0 && length == encodeSparkplugBirth(NULL, 0, 1000, 0));
+  CHECK(decode(buffer, length) && payload.count == 3);
+  Metric* metric = find_metric("y", 0);
+  CHECK(metric != NULL && metric->alias == 2 && metric->datatype == spFloat && metric->timestamp == 1000 && metric->value_field == 12);
+  metric = find_metric("z", 0);
+  CHECK(metric != NULL && metric->alias == -1 && metric->datatype == spBoolean && metric->value_field == 14 && metric->value == 0);
+  CHECK(encodeSparkplugBirth(buffer, length - 1, 1000, 0) == 0);  // A birth is all or nothing
+
+  // The changed indexes only cover FunctionalBasicTags, the compact changes are encoded from their flags
+  basic_tag_test_clock = 2000;
+  y = 1.5f;
+  size_t changed[4];
+  CHECK(readAllBasicTagsChanged(changed, 4) == 0);
+  CHECK(compact_y->flags & BASIC_TAG_COMPACT_VALUE_CHANGED);
+  size_t slot = 0;
+  length = encodeSparkplugCompactData(buffer, sizeof(buffer), 2000, 1, &slot);
+  CHECK(length > 0 && slot == getCompactTagsCapacity());
+  CHECK(decode(buffer, length) && payload.count == 1 && payload.seq == 1);
+  metric = &(payload.metrics[0]);
+  float value;
+  uint32_t bits = (uint32_t)metric->value;
+  memcpy(&value, &bits, sizeof(value));
+  CHECK(!metric->has_name && metric->alias == 2 && metric->timestamp == 2000 && value == 1.5f);
+
+  // Nothing changed, nothing to publish
+  basic_tag_test_clock = 3000;
+  readAllBasicTagsBitmap(NULL, 0);
+  slot = 0;
+  CHECK(encodeSparkplugCompactData(buffer, sizeof(buffer), 3000, 2, &slot) == 0 && slot == getCompactTagsCapacity());
+
+  // Split across payloads when they don't fit, compact tags with a negative alias go by name
+  y = 2.5f;
+  z = true;
+  basic_tag_test_clock = 4000;
+  readAllBasicTags();
+  slot = 0;
+  length = encodeSparkplugCompactData(buffer, 20, 4000, 3, &slot);
+  CHECK(length > 0 && decode(buffer, length) && payload.count == 1 && slot < getCompactTagsCapacity());
+  length = encodeSparkplugCompactData(buffer, 20, 4000, 4, &slot);
+  CHECK(length > 0 && decode(buffer, length) && payload.count == 1 && slot == getCompactTagsCapacity());
+  CHECK(payload.metrics[0].has_name && strcmp(payload.metrics[0].name, "z") == 0 && payload.metrics[0].value == 1);
+  clear_all();
+}
+
+int main() {
+  setBasicTagTimestampFunction(basic_tag_test_now);
+  RUN_TEST(test_birth_datatypes);
+  RUN_TEST(test_data_split);
+  RUN_TEST(test_data_bitmap);
+  RUN_TEST(test_compact_tags);
+  return basic_tag_test_result();
+}
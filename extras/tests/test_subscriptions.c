@@ -0,0 +1,225 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+Subscriptions: each consumer drains its own dirty bitmap, deletes keep the bits on the right tags and every
+kind of scan marks the changed tags. Built with BASIC_TAG_THREAD_SAFE it also subscribes by prefix while another
+task creates and deletes tags
+*/
+
+#include "basic_tag_test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef BASIC_TAG_THREAD_SAFE
+#include <pthread.h>
+#endif
+
+#define TAGS 40
+
+static int32_t values[TAGS];
+static char names[TAGS][8];
+static FunctionalBasicTag* tags[TAGS];
+static char string_value[9];
+static FunctionalBasicTag* string_tag;
+static FunctionalBasicTag* drained[64];
+
+static void create_tags() {
+  // "A/0" to "A/19", "B/20" to "B/39" and the string "A/s"
+  basic_tag_test_clear_tags();
+  basic_tag_test_clock = 1000;
+  for (int i = 0; i < TAGS; i++) {
+    values[i] = 0;
+    snprintf(names[i], sizeof(names[i]), "%s/%d", i < 20 ? "A" : "B", i);
+    tags[i] = createTag(names[i], &values[i], -1, spInt32, false, false, 0);
+  }
+  strcpy(string_value, "a");
+  string_tag = createTag("A/s", string_value, -1, spString, false, false, 8);
+}
+
+static bool was_drained(FunctionalBasicTag* tag, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (drained[i] == tag) return true;
+  }
+  return false;
+}
+
+static void test_create() {
+  basic_tag_test_clear_tags();
+  static uint32_t dirty[1];
+  BasicTagSubscription subscription;
+  CHECK(!createBasicTagSubscription(&subscription, NULL, 1));
+  CHECK(!createBasicTagSubscription(&subscription, dirty, 0));
+  CHECK(createBasicTagSubscription(&subscription, dirty, 1));
+  static int32_t value;
+  FunctionalBasicTag* tag = createInt32Tag("tag", &value, -1, false, false);
+  CHECK(subscribeTag(&subscription, tag));
+  CHECK(getBasicTagSubscriptionPending(&subscription) == 0);  // Never read
+  readAllBasicTags();
+  CHECK(getBasicTagSubscriptionPending(&subscription) == 1);
+  CHECK(deleteBasicTagSubscription(&subscription));
+  CHECK(!subscribeTag(&subscription, tag));
+  CHECK(!unsubscribeTag(&subscription, tag));
+
+  // Already read tags are marked dirty straight away
+  CHECK(createBasicTagSubscription(&subscription, dirty, 1));
+  CHECK(subscribeTag(&subscription, tag));
+  CHECK(getBasicTagSubscriptionPending(&subscription) == 1);
+  CHECK(deleteBasicTagSubscription(&subscription));
+}
+
+static void test_consumer_isolation() {
+  create_tags();
+  uint32_t cloud_dirty[2], hmi_dirty[2];
+  BasicTagSubscription cloud, hmi;
+  CHECK(createBasicTagSubscription(&cloud, cloud_dirty, 2));
+  CHECK(createBasicTagSubscription(&hmi, hmi_dirty, 2));
+  CHECK(subscribeTagsWithPrefix(&cloud, "") == TAGS + 1);
+  CHECK(subscribeTagsWithPrefix(&hmi, "A/") == 21);
+  CHECK(subscribeTagsWithPrefix(&hmi, "C/") == 0);
+  CHECK(getBasicTagSubscriptionPending(&cloud) == 0);
+
+  readAllBasicTags();  // The first read changes every tag
+  CHECK(getBasicTagSubscriptionPending(&cloud) == TAGS + 1 && getBasicTagSubscriptionPending(&hmi) == 21);
+  CHECK(drainBasicTagSubscription(&hmi, drained, 10) == 10);
+  CHECK(getBasicTagSubscriptionPending(&hmi) == 11);
+  CHECK(drainBasicTagSubscription(&hmi, drained, 64) == 11);
+  CHECK(getBasicTagSubscriptionPending(&hmi) == 0);
+  CHECK(getBasicTagSubscriptionPending(&cloud) == TAGS + 1);  // Draining one consumer leaves the other pending
+
+  basic_tag_test_clock = 2000;
+  values[3] = 1;
+  values[25] = 1;
+  strcpy(string_value, "b");
+  readAllBasicTags();
+  size_t count = drainBasicTagSubscription(&hmi, drained, 64);
+  CHECK(count == 2 && was_drained(tags[3], count) && was_drained(string_tag, count));
+  CHECK(drainBasicTagSubscription(&cloud, drained, 64) == TAGS + 1);
+  CHECK(drainBasicTagSubscription(&cloud, drained, 64) == 0);
+
+  CHECK(unsubscribeTag(&hmi, tags[6]));
+  CHECK(unsubscribeTag(&hmi, tags[30]));  // Never subscribed, nothing to clear
+  values[6] = 5;
+  basic_tag_test_clock = 3000;
+  readAllBasicTags();
+  CHECK(getBasicTagSubscriptionPending(&hmi) == 0 && getBasicTagSubscriptionPending(&cloud) == 1);
+  CHECK(deleteBasicTagSubscription(&cloud));
+  CHECK(deleteBasicTagSubscription(&hmi));
+}
+
+static void test_delete_tag() {
+  // Deleting swaps the last tag into the free index, its dirty bit moves with it
+  create_tags();
+  uint32_t dirty[2];
+  BasicTagSubscription subscription;
+  CHECK(createBasicTagSubscription(&subscription, dirty, 2));
+  CHECK(subscribeTagsWithPrefix(&subscription, "") == TAGS + 1);
+  readAllBasicTags();
+  drainBasicTagSubscription(&subscription, drained, 64);
+
+  basic_tag_test_clock = 2000;
+  strcpy(string_value, "c");
+  readAllBasicTags();
+  CHECK(getBasicTagSubscriptionPending(&subscription) == 1);
+  deleteTag(tags[5]);
+  CHECK(string_tag->_idx == 5);
+  CHECK(getBasicTagSubscriptionPending(&subscription) == 1);
+  CHECK(drainBasicTagSubscription(&subscription, drained, 64) == 1 && drained[0] == string_tag);
+
+  // A deleted dirty tag is no longer reported
+  values[7] = 3;
+  basic_tag_test_clock = 3000;
+  readAllBasicTags();
+  deleteTag(tags[7]);
+  CHECK(getBasicTagSubscriptionPending(&subscription) == 0);
+  CHECK(deleteBasicTagSubscription(&subscription));
+}
+
+static void test_scans_mark_dirty() {
+  // readDueBasicTags and readAllBasicTagsParallel mark the changed tags the same as readAllBasicTags
+  create_tags();
+  uint32_t dirty[2];
+  BasicTagSubscription subscription;
+  CHECK(createBasicTagSubscription(&subscription, dirty, 2));
+  CHECK(subscribeTagsWithPrefix(&subscription, "B/") == 20);
+  readAllBasicTags();
+  drainBasicTagSubscription(&subscription, drained, 64);
+
+  values[21] = 1;
+  values[2] = 1;
+  basic_tag_test_clock = 4000;
+  readDueBasicTags(4000);
+  CHECK(drainBasicTagSubscription(&subscription, drained, 64) == 1 && drained[0] == tags[21]);
+
+  values[22] = 1;
+  values[39] = 1;
+  basic_tag_test_clock = 5000;
+  readAllBasicTagsParallel(4);
+  size_t count = drainBasicTagSubscription(&subscription, drained, 64);
+  CHECK(count == 2 && was_drained(tags[22], count) && was_drained(tags[39], count));
+  CHECK(deleteBasicTagSubscription(&subscription));
+}
+
+#ifdef BASIC_TAG_THREAD_SAFE
+static bool writer_done;
+static int32_t churn_values[32];
+static char churn_names[32][8];
+
+static void* churn_tags(void* arg) {
+  (void)arg;
+  for (int round = 0; round < 200; round++) {
+    FunctionalBasicTag* churn[32];
+    for (int i = 0; i < 32; i++) churn[i] = createInt32Tag(churn_names[i], &churn_values[i], -1, false, false);
+    for (int i = 0; i < 32; i++) deleteTag(churn[i]);
+  }
+  __atomic_store_n(&writer_done, true, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void test_prefix_while_writing() {
+  // subscribeTagsWithPrefix takes the writer lock itself, it must not hold up or wait on the churning writer
+  create_tags();
+  for (int i = 0; i < 32; i++) snprintf(churn_names[i], sizeof(churn_names[i]), "C/%d", i);
+  uint32_t dirty[4];
+  BasicTagSubscription subscription;
+  CHECK(createBasicTagSubscription(&subscription, dirty, 4));
+  __atomic_store_n(&writer_done, false, __ATOMIC_RELEASE);
+  pthread_t writer;
+  CHECK(pthread_create(&writer, NULL, churn_tags, NULL) == 0);
+  size_t wrong = 0;
+  while (!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE)) {
+    if (subscribeTagsWithPrefix(&subscription, "A/") != 21) wrong++;
+  }
+  pthread_join(writer, NULL);
+  CHECK(wrong == 0);
+  CHECK(subscribeTagsWithPrefix(&subscription, "C/") == 0);
+  CHECK(deleteBasicTagSubscription(&subscription));
+}
+#endif
+
+int main() {
+  setBasicTagTimestampFunction(basic_tag_test_now);
+  RUN_TEST(test_create);
+  RUN_TEST(test_consumer_isolation);
+  RUN_TEST(test_delete_tag);
+  RUN_TEST(test_scans_mark_dirty);
+#ifdef BASIC_TAG_THREAD_SAFE
+  RUN_TEST(test_prefix_while_writing);
+#endif
+  basic_tag_test_clear_tags();
+  return basic_tag_test_result();
+}
@@ -16,8 +16,187 @@ Copyright 2024 Michael Keras
 
 #include "BasicTag.h"
 
+#include <stdlib.h>
+
 static TimestampFunction _timestamp_function = NULL;  // New v1.3.0
 
+/*
+Scan Clock (v1.4.0)
+With BASIC_TAG_CLOCK_PER_SCAN or BASIC_TAG_CLOCK_PER_GROUP the timestamp (and micros) function is sampled
+once per scan or once per scan group, and every tag read in that scan or group is stamped with it.
+Outside a scan, and with BASIC_TAG_CLOCK_PER_TAG, the clocks are called directly.
+*/
+
+static MicrosFunction _micros_function = NULL;
+static BasicTagClockMode _clock_mode = BASIC_TAG_CLOCK_PER_TAG;
+static bool _clock_cached = false;
+static uint64_t _clock_ms = 0;
+static uint64_t _clock_us = 0;
+
+static uint64_t _clock_now_ms() {
+  if (_clock_cached) return _clock_ms;
+  return _timestamp_function != NULL ? _timestamp_function() : 0;
+}
+
+static uint64_t _clock_now_us() {
+  if (_clock_cached) return _clock_us;
+  return _micros_function != NULL ? _micros_function() : 0;
+}
+
+static void _clock_sample(bool cache) {
+  // Called at the start of a scan (and of each group), cache is false to go back to reading the clocks directly
+  _clock_cached = false;
+  if (!cache) return;
+  _clock_ms = _clock_now_ms();
+  _clock_us = _clock_now_us();
+  _clock_cached = true;
+}
+
+bool setBasicTagMicrosFunction(MicrosFunction fn) {
+  // NULL is allowed, changeMicros is then always 0
+  _micros_function = fn;
+  return true;
+}
+
+bool setBasicTagClockMode(BasicTagClockMode mode) {
+  if (mode != BASIC_TAG_CLOCK_PER_TAG && mode != BASIC_TAG_CLOCK_PER_SCAN && mode != BASIC_TAG_CLOCK_PER_GROUP) return false;
+  _clock_mode = mode;
+  return true;
+}
+
+/*
+Scan Statistics (v1.4.0)
+Built with BASIC_TAG_ENABLE_STATS, the scans record their duration and changes, and the calls to compareFunc,
+onChange and validateWrite are timed and counted into a BasicTagStats (getBasicTagStats). Each tag also keeps
+the longest compareFunc and onChange call it made, to find slow callbacks. Durations come from the micros
+function (setBasicTagMicrosFunction) and are 0 without one. createBasicTagStatsTags publishes the main counters
+as tags with aliases of -1000 and below, so they are never reported by exception.
+BASIC_TAG_SCAN_HOOK(duration_us, changes) can be defined to be called at the end of every scan.
+Without BASIC_TAG_ENABLE_STATS the macros below are empty and none of this is compiled.
+*/
+
+#ifdef BASIC_TAG_ENABLE_STATS
+
+#ifndef BASIC_TAG_SCAN_HOOK
+#define BASIC_TAG_SCAN_HOOK(duration_us, changes)
+#endif
+
+#if defined(__GNUC__)
+#define _STATS_ADD(var, amount) __atomic_fetch_add(&(var), (amount), __ATOMIC_RELAXED)  // Workers of a parallel scan time compareFunc too
+#define _STATS_STORE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELAXED)
+#else
+#define _STATS_ADD(var, amount) ((var) += (amount))
+#define _STATS_STORE(var, value) ((var) = (value))
+#endif
+
+static inline bool _stats_raise(uint32_t* var, uint32_t value) {
+  // Raises *var to value, returns false if it was already at least value. A compare and swap so a larger maximum
+  // from another worker or a dispatching task isn't overwritten
+#if defined(__GNUC__)
+  uint32_t current = __atomic_load_n(var, __ATOMIC_RELAXED);
+  while (value > current) {
+    if (__atomic_compare_exchange_n(var, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return true;
+  }
+  return false;
+#else
+  if (value <= *var) return false;
+  *var = value;
+  return true;
+#endif
+}
+
+static BasicTagStats _stats = {0};
+
+static inline uint64_t _stats_now_us() {
+  // Always the real clock, the scan clock may be cached
+  return _micros_function != NULL ? _micros_function() : 0;
+}
+
+static void _stats_callback(FunctionalBasicTag* tag, uint32_t* tag_max, uint64_t* total, uint32_t* calls, uint64_t elapsed) {
+  uint32_t us = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+  _STATS_ADD(*total, elapsed);
+  _STATS_ADD(*calls, 1);
+  if (tag_max != NULL) _stats_raise(tag_max, us);
+  // The alias goes with whichever call raised the maximum last, it can trail the maximum briefly
+  if (_stats_raise(&(_stats.callback_max_us), us)) _STATS_STORE(_stats.callback_max_alias, tag != NULL ? tag->alias : 0);
+}
+
+static void _stats_scan_end(uint64_t start, size_t changes) {
+  uint64_t elapsed = _stats_now_us() - start;
+  uint32_t us = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+  uint32_t changed = changes > UINT32_MAX ? UINT32_MAX : (uint32_t)changes;
+  _stats.scans++;
+  _stats.scan_total_us += elapsed;
+  _stats.scan_last_us = us;
+  if (_stats.scans == 1 || us < _stats.scan_min_us) _stats.scan_min_us = us;
+  if (us > _stats.scan_max_us) _stats.scan_max_us = us;
+  _stats.scan_avg_us = (uint32_t)(_stats.scan_total_us / _stats.scans);
+  _stats.changes_last_scan = changed;
+  if (changed > _stats.changes_max_scan) _stats.changes_max_scan = changed;
+  _stats.changes_total += changed;
+  BASIC_TAG_SCAN_HOOK(us, changed);
+}
+
+// Times a call made for a tag, kind is compare or onchange
+#define _STATS_TIMED(tag, kind, ...) do { \
+  uint64_t _stats_start = _stats_now_us(); \
+  __VA_ARGS__; \
+  _stats_callback((tag), &((tag)->stats_##kind##_max_us), &(_stats.kind##_total_us), &(_stats.kind##_calls), _stats_now_us() - _stats_start); \
+} while (0)
+#define _STATS_TIMED_UNTRACKED(kind, ...) do { \
+  uint64_t _stats_start = _stats_now_us(); \
+  __VA_ARGS__; \
+  _stats_callback(NULL, NULL, &(_stats.kind##_total_us), &(_stats.kind##_calls), _stats_now_us() - _stats_start); \
+} while (0)
+#define _STATS_SCAN_BEGIN(ctx) uint64_t _stats_scan_start = _stats_now_us(); size_t _stats_scan_count = (ctx)->count
+#define _STATS_SCAN_END(ctx) _stats_scan_end(_stats_scan_start, (ctx)->count - _stats_scan_count)
+#define _STATS_WRITE_REJECTED() _STATS_ADD(_stats.write_rejections, 1)
+
+bool getBasicTagStats(BasicTagStats* stats) {
+  if (stats == NULL) return false;
+  *stats = _stats;
+  return true;
+}
+
+void resetBasicTagStats() {
+  memset(&_stats, 0, sizeof(BasicTagStats));
+}
+
+size_t createBasicTagStatsTags() {
+  // Tags for the main counters at aliases -1001 to -1008, returns the number created
+  static const struct {
+    const char* name;
+    uint32_t* value;
+  } counters[] = {
+    {"BasicTag/Stats/Scans", &_stats.scans},
+    {"BasicTag/Stats/Scan Last us", &_stats.scan_last_us},
+    {"BasicTag/Stats/Scan Min us", &_stats.scan_min_us},
+    {"BasicTag/Stats/Scan Max us", &_stats.scan_max_us},
+    {"BasicTag/Stats/Scan Avg us", &_stats.scan_avg_us},
+    {"BasicTag/Stats/Changes Last Scan", &_stats.changes_last_scan},
+    {"BasicTag/Stats/Write Rejections", &_stats.write_rejections},
+    {"BasicTag/Stats/Callback Max us", &_stats.callback_max_us},
+  };
+  size_t created = 0;
+  for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+    int alias = -1001 - (int)i;
+    if (getTagByAlias(alias) != NULL) continue;  // Already created
+    if (createTag(counters[i].name, counters[i].value, alias, spUInt32, false, false, 0) != NULL) created++;
+  }
+  return created;
+}
+
+#else
+
+#define _STATS_TIMED(tag, kind, ...) do { __VA_ARGS__; } while (0)
+#define _STATS_TIMED_UNTRACKED(kind, ...) do { __VA_ARGS__; } while (0)
+#define _STATS_SCAN_BEGIN(ctx)
+#define _STATS_SCAN_END(ctx)
+#define _STATS_WRITE_REJECTED()
+
+#endif  // BASIC_TAG_ENABLE_STATS
+
+
 bool DefaultCompareFn(BasicValue* currentValue, BasicValue* newValue) {
   /* Return true if values have changed, false if not
   false: new value ignored; true: current becomes previous and new value becomes current
@@ -57,10 +236,9 @@ bool DefaultCompareFn(BasicValue* currentValue, BasicValue* newValue) {
         // New to v1.3.2
         // if they aren't the same length, it has changed
         if (currentValue->value.bytesValue->written_length != newValue->value.bytesValue->written_length) return true;
-        for (size_t i = 0; i < currentValue->value.bytesValue->written_length; i++) {
-          if (currentValue->value.bytesValue->buffer[i] != newValue->value.bytesValue->buffer[i]) return true;
-        }
-        return false;
+        if (currentValue->value.bytesValue->written_length == 0) return false;
+        // v1.4.0 memcmp instead of a byte loop, the C library compares a word (or vector) at a time
+        return memcmp(currentValue->value.bytesValue->buffer, newValue->value.bytesValue->buffer, currentValue->value.bytesValue->written_length) != 0;
       default:
         // For unknown types, you might not need to do anything
         return true;
@@ -68,101 +246,686 @@ bool DefaultCompareFn(BasicValue* currentValue, BasicValue* newValue) {
 }
 
 /*
-Tag Linked List Functions
+Tag Registry Functions
 Tag allocation deallocation handled elsewhere, these are designed to be called after a creation or deletion of tag
+v1.4.0 replaced the linked list with a growable array of tag pointers. Capacity doubles when full (or can be set
+up front with reserveTags), appending is O(1) and deleting is an O(1) swap-remove: the last tag is moved into the
+freed index, each tag keeps track of its own index in _idx.
 */
 
-static FunctionalBasicTagNode* _head = NULL;
-static unsigned int _NodeCount = 0;
-// v1.2.0 maintain array of tags for quick indexing
 static FunctionalBasicTag** _tags_array = NULL;
+static size_t _tags_count = 0;
+static size_t _tags_capacity = 0;
+static BasicTagStaticTable* _static_table = NULL;  // When set _tags_array is the table's RAM array and can't grow
+static bool _scan_plan_dirty = true;  // Set when tags are created or deleted, see Scan Plan
+static bool _schedule_dirty = true;  // Same for the readDueBasicTags schedule, see Deadline Scheduler
+static bool _sorted_dirty = true;  // Same for the name order used by iterTagsWithPrefix, see Name Prefixes
+
+#define BASIC_TAG_MIN_CAPACITY 8
+
+static inline unsigned int _lowest_bit(uint64_t mask) {
+  // Index of the lowest set bit, mask must not be 0. Used to walk change masks and subscription bitmaps
+#if defined(__GNUC__)
+  return (unsigned int)__builtin_ctzll(mask);
+#else
+  unsigned int bit = 0;
+  while (!(mask & 1)) {
+    mask >>= 1;
+    bit++;
+  }
+  return bit;
+#endif
+}
+
+/*
+Thread Safe Registry (v1.4.0)
+With BASIC_TAG_THREAD_SAFE defined tags can be created and deleted while other tasks iterate or look up tags.
+Writers (createTag, deleteTag, reserveTags, registerStaticTagTable) are serialised by a spinlock, readers never
+lock. Memory a reader could still be using (old arrays, old index tables, deleted tags) is retired instead of
+freed, and reclaimed by a later writer once every reader that started before it was retired has finished.
+Readers announce themselves in one of two counters picked by the current epoch, a writer advances the epoch
+once the counter of the previous epoch is empty (RCU style grace periods, nothing ever waits on a reader).
+Appends are published in place: the tag pointer is stored before the count. Deleting copies the array, and
+index updates are wrapped in a sequence counter so getTagByName/getTagByAlias retry instead of seeing a
+half updated table. Without BASIC_TAG_THREAD_SAFE all of this compiles away.
+*/
+
+#ifndef BASIC_TAG_YIELD
+#if defined(ESP_PLATFORM)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#define BASIC_TAG_YIELD() vTaskDelay(1)
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#define BASIC_TAG_YIELD() sched_yield()
+#else
+#define BASIC_TAG_YIELD()  // Define BASIC_TAG_YIELD to let a lower priority task run while waiting (writer lock, blocking change queue)
+#endif
+#endif
+
+#ifdef BASIC_TAG_THREAD_SAFE
+#if !defined(__GNUC__)
+#error "BASIC_TAG_THREAD_SAFE needs the GCC __atomic builtins"
+#endif
+
+#define _TS_LOAD(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define _TS_STORE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELEASE)
+
+#define _RETIRED_MEMORY 0  // Freed with free
+#define _RETIRED_TAG 1  // Freed with _bt_free
+#define _RETIRED_COMPACT 2  // A compact tag slot, cleared so it can be reused
+
+typedef struct {
+  void* ptr;
+  uint32_t epoch;  // Epoch it was retired in
+  uint8_t kind;
+} _RetiredBlock;
+
+static void _bt_free(void* ptr);  // See Library Allocator
+static void _compact_free_slot(CompactBasicTag* tag);  // See Compact Tags
+
+static bool _writer_flag = false;
+static uint32_t _rcu_epoch = 0;
+static uint32_t _rcu_readers[2] = {0, 0};
+static uint32_t _registry_seq = 0;  // Odd while the hash index is being changed
+static _RetiredBlock* _retired = NULL;
+static size_t _retired_count = 0;
+static size_t _retired_capacity = 0;
+
+static void _writer_lock() {
+  while (__atomic_test_and_set(&_writer_flag, __ATOMIC_ACQUIRE)) BASIC_TAG_YIELD();
+}
+
+static void _writer_unlock() {
+  __atomic_clear(&_writer_flag, __ATOMIC_RELEASE);
+}
+
+static uint32_t _rcu_read_begin() {
+  while (true) {
+    uint32_t epoch = __atomic_load_n(&_rcu_epoch, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&(_rcu_readers[epoch & 1]), 1, __ATOMIC_SEQ_CST);
+    // The epoch moved on before the counter was visible, try again in the new epoch
+    if (__atomic_load_n(&_rcu_epoch, __ATOMIC_SEQ_CST) == epoch) return epoch;
+    __atomic_fetch_sub(&(_rcu_readers[epoch & 1]), 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+static void _rcu_read_end(uint32_t token) {
+  __atomic_fetch_sub(&(_rcu_readers[token & 1]), 1, __ATOMIC_SEQ_CST);
+}
+
+static void _free_retired(_RetiredBlock* block) {
+  if (block->kind == _RETIRED_TAG) _bt_free(block->ptr);
+  else if (block->kind == _RETIRED_COMPACT) _compact_free_slot((CompactBasicTag*)block->ptr);
+  else free(block->ptr);
+}
+
+static bool _rcu_try_advance() {
+  // Writer lock held. Once the previous epoch's readers are gone, everything retired before the current epoch is unused
+  uint32_t epoch = __atomic_load_n(&_rcu_epoch, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&(_rcu_readers[(epoch + 1) & 1]), __ATOMIC_SEQ_CST) != 0) return false;
+  size_t kept = 0;
+  for (size_t i = 0; i < _retired_count; i++) {
+    if (_retired[i].epoch != epoch) _free_retired(&(_retired[i]));
+    else _retired[kept++] = _retired[i];
+  }
+  _retired_count = kept;
+  __atomic_store_n(&_rcu_epoch, epoch + 1, __ATOMIC_SEQ_CST);
+  return true;
+}
+
+static void _rcu_reclaim() {
+  // Two advances free everything retired so far if no reader is in the way
+  if (_rcu_try_advance()) _rcu_try_advance();
+}
+
+static void _rcu_synchronize() {
+  /*
+  Writer lock held. Returns once every reader that was in a read section when it was called has left it: the
+  second advance needs the counter of the epoch they started in to be empty. Deadlocks if this thread is a reader
+  */
+  while (!_rcu_try_advance()) BASIC_TAG_YIELD();
+  while (!_rcu_try_advance()) BASIC_TAG_YIELD();
+}
+
+static void _retire(void* ptr, uint8_t kind) {
+  // ptr must already be unreachable for new readers (unpublished), only readers already using it are waited for
+  if (ptr == NULL) return;
+  if (_retired_count == _retired_capacity) {
+    size_t new_capacity = _retired_capacity > 0 ? _retired_capacity * 2 : BASIC_TAG_MIN_CAPACITY;
+    _RetiredBlock* grown = realloc(_retired, new_capacity * sizeof(_RetiredBlock));
+    if (grown == NULL) {
+      // Out of memory, wait for a full grace period instead so it can be freed straight away
+      _rcu_synchronize();
+      _RetiredBlock block = {ptr, 0, kind};
+      _free_retired(&block);
+      return;
+    }
+    _retired = grown;
+    _retired_capacity = new_capacity;
+  }
+  _RetiredBlock block = {ptr, __atomic_load_n(&_rcu_epoch, __ATOMIC_SEQ_CST), kind};
+  _retired[_retired_count++] = block;
+}
+
+static void _registry_write_begin() {
+  __atomic_store_n(&_registry_seq, _registry_seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void _registry_write_end() {
+  __atomic_store_n(&_registry_seq, _registry_seq + 1, __ATOMIC_RELEASE);
+}
+
+static uint32_t _registry_read_begin() {
+  uint32_t seq;
+  while ((seq = __atomic_load_n(&_registry_seq, __ATOMIC_ACQUIRE)) & 1) BASIC_TAG_YIELD();
+  return seq;
+}
+
+static bool _registry_read_retry(uint32_t seq) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&_registry_seq, __ATOMIC_RELAXED) != seq;
+}
+#else
+#define _TS_LOAD(var) (var)
+#define _TS_STORE(var, value) ((var) = (value))
+#define _writer_lock()
+#define _writer_unlock()
+#define _rcu_read_begin() 0
+#define _rcu_read_end(token) ((void)(token))
+#define _rcu_reclaim()
+#define _registry_write_begin()
+#define _registry_write_end()
+#define _registry_read_begin() 0
+#define _registry_read_retry(seq) ((void)(seq), false)
+#endif
+
+uint32_t beginBasicTagRead() {
+  // Tags returned between begin and end stay valid even if another task deletes them
+  return _rcu_read_begin();
+}
+
+void endBasicTagRead(uint32_t token) {
+  _rcu_read_end(token);
+}
+
+bool reclaimBasicTagMemory() {
+  // Frees retired memory no reader can still be using, returns true when nothing is left to free
+#ifdef BASIC_TAG_THREAD_SAFE
+  _writer_lock();
+  _rcu_reclaim();
+  bool done = _retired_count == 0;
+  _writer_unlock();
+  return done;
+#else
+  return true;
+#endif
+}
 
 unsigned int getTagsCount() {
-    return _NodeCount;
+    return _TS_LOAD(_tags_count);
 }
 
-// New addition in v1.2.0
-static bool _update_tags_array() {
-    if (_NodeCount == 0) {
-      if (_tags_array != NULL) free(_tags_array);
-      _tags_array = NULL;
-      return true;
+static bool _grow_tags_array(size_t min_capacity) {
+    if (min_capacity <= _tags_capacity) return true;
+    if (_static_table != NULL) return false;  // A static table has a fixed size
+
+    // Double the capacity until it fits, this keeps the number of realloc calls logarithmic
+    size_t new_capacity = _tags_capacity > 0 ? _tags_capacity : BASIC_TAG_MIN_CAPACITY;
+    while (new_capacity < min_capacity) new_capacity *= 2;
+
+#ifdef BASIC_TAG_THREAD_SAFE
+    // Readers may still be using the old array, so copy it and retire it instead of realloc
+    FunctionalBasicTag** new_array = malloc(new_capacity * sizeof(FunctionalBasicTag*));
+    if (new_array == NULL) return false;
+    if (_tags_count > 0) memcpy(new_array, _tags_array, _tags_count * sizeof(FunctionalBasicTag*));
+    // A reader holding a stale count can index past _tags_count, the tail must read as empty
+    memset(new_array + _tags_count, 0, (new_capacity - _tags_count) * sizeof(FunctionalBasicTag*));
+    FunctionalBasicTag** old_array = _tags_array;
+    _TS_STORE(_tags_array, new_array);
+    _retire(old_array, _RETIRED_MEMORY);  // Only after the new array is published, readers can't load the old one any more
+#else
+    FunctionalBasicTag** new_array = realloc(_tags_array, new_capacity * sizeof(FunctionalBasicTag*));
+    // Check if memory operation failed, the old array is still valid in that case
+    if (new_array == NULL) return false;
+    _tags_array = new_array;
+#endif
+
+    _tags_capacity = new_capacity;
+    return true;
+}
+
+/*
+Tag Hash Index (v1.4.0)
+Open addressing tables used by getTagByName and getTagByAlias, kept in sync by createTag/deleteTag.
+Linear probing, the tables are kept at most half full and removal uses backward shift deletion so
+no tombstones are needed. Both tables share the same power of two capacity.
+*/
+
+typedef struct {
+    uint32_t hash;  // For the alias table this is the mixed alias, which is unique per alias
+    void* tag;  // FunctionalBasicTag or CompactBasicTag, NULL for an empty slot
+} _TagIndexSlot;
+
+// Compact tag storage (see Compact Tags), compact tags share the index and are told apart by address
+static CompactBasicTag* _compact_tags = NULL;
+static size_t _compact_capacity = 0;
+static size_t _compact_count = 0;
+
+static _TagIndexSlot* _name_index = NULL;
+static _TagIndexSlot* _alias_index = NULL;
+static size_t _index_capacity = 0;
+static size_t _name_shadowed = 0;  // Number of tags hidden behind a newer tag with the same name
+
+// Largest alias in use (never below 0, matching getNextAlias), recalculated lazily after the max alias tag is deleted
+static int _max_alias = 0;
+static bool _max_alias_stale = false;
+
+static uint32_t _hash_name(const char* name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*name != '\0') {
+        hash ^= (uint8_t)(*name++);
+        hash *= 16777619u;
     }
+    return hash;
+}
 
-    // Allocate to the number of Nodes
-    if (_tags_array == NULL) {
-      // malloc
-      _tags_array = malloc(_NodeCount * sizeof(FunctionalBasicTag*));
-    } else {
-      // realloc
-      _tags_array = realloc(_tags_array, _NodeCount * sizeof(FunctionalBasicTag*));
+static uint32_t _hash_alias(int alias) {
+    // Multiplying by an odd constant is a bijection, so equal hashes always mean equal aliases
+    return (uint32_t)alias * 2654435761u;
+}
+
+static bool _index_is_compact(const void* entry) {
+    // The compact storage can't change while it holds tags, so the range check is stable for indexed entries
+    uintptr_t offset = (uintptr_t)entry - (uintptr_t)_compact_tags;
+    return _compact_tags != NULL && offset < _compact_capacity * sizeof(CompactBasicTag);
+}
+
+static const char* _index_entry_name(const void* entry) {
+    return _index_is_compact(entry) ? ((const CompactBasicTag*)entry)->name : ((const FunctionalBasicTag*)entry)->name;
+}
+
+static bool _index_name_matches(const void* entry, const char* name, bool compact) {
+    // Names are only unique within a kind, a compact tag never shadows a FunctionalBasicTag or the other way round
+    return _index_is_compact(entry) == compact && strcmp(_index_entry_name(entry), name) == 0;
+}
+
+static _TagIndexSlot* _index_find_slot(_TagIndexSlot* table, size_t capacity, uint32_t hash, const char* name, bool compact) {
+    // name and compact are only checked for the name table, pass NULL for the alias table
+    size_t mask = capacity - 1;
+    size_t pos = hash & mask;
+    // The probe limit only matters for a thread safe reader racing a resize, the table is never full otherwise
+    for (size_t probes = 0; probes < capacity && table[pos].tag != NULL; probes++) {
+        if (table[pos].hash == hash && (name == NULL || _index_name_matches(table[pos].tag, name, compact))) return &(table[pos]);
+        pos = (pos + 1) & mask;
+    }
+    return NULL;
+}
+
+static void _index_insert(_TagIndexSlot* table, uint32_t hash, void* tag, bool is_name) {
+    size_t mask = _index_capacity - 1;
+    size_t pos = hash & mask;
+    while (table[pos].tag != NULL) {
+        if (table[pos].hash == hash && (!is_name || _index_name_matches(table[pos].tag, _index_entry_name(tag), _index_is_compact(tag)))) {
+            // The most recently created tag wins for duplicate names
+            if (is_name) _name_shadowed += 1;
+            table[pos].tag = tag;
+            return;
+        }
+        pos = (pos + 1) & mask;
+    }
+    table[pos].hash = hash;
+    table[pos].tag = tag;
+}
+
+static void _index_remove_slot(_TagIndexSlot* table, _TagIndexSlot* slot) {
+    // Backward shift deletion, move any following entries that would be unreachable into the gap
+    size_t mask = _index_capacity - 1;
+    size_t gap = slot - table;
+    size_t pos = gap;
+    while (true) {
+        pos = (pos + 1) & mask;
+        if (table[pos].tag == NULL) break;
+        size_t home = table[pos].hash & mask;
+        // Only shift the entry if its home slot is not between the gap and its current position
+        bool shift = (gap <= pos) ? (home <= gap || home > pos) : (home <= gap && home > pos);
+        if (shift) {
+            table[gap] = table[pos];
+            gap = pos;
+        }
+    }
+    table[gap].tag = NULL;
+}
+
+static void _index_add_tag(FunctionalBasicTag* tag) {
+    if (_index_capacity == 0) return;  // Static tables don't use the hash index
+    if (tag->name != NULL) _index_insert(_name_index, _hash_name(tag->name), tag, true);
+    _index_insert(_alias_index, _hash_alias(tag->alias), tag, false);
+}
+
+static bool _compact_live(CompactBasicTag* tag);  // See Compact Tags
+
+static void _index_add_compact(CompactBasicTag* tag) {
+    if (_index_capacity == 0) return;
+    if (tag->name != NULL) _index_insert(_name_index, _hash_name(tag->name), tag, true);
+    _index_insert(_alias_index, _hash_alias(tag->alias), tag, false);
+}
+
+static bool _grow_index(size_t min_entries) {
+    // Keep the load factor at or below 0.5, min_entries counts FunctionalBasicTags and the compact tags are added
+    min_entries += _compact_count;
+    if (min_entries * 2 <= _index_capacity) return true;
+    if (_static_table != NULL) return true;  // Static tables use their own alias lookup and never allocate
+    size_t new_capacity = _index_capacity > 0 ? _index_capacity : BASIC_TAG_MIN_CAPACITY * 2;
+    while (new_capacity < min_entries * 2) new_capacity *= 2;
+
+    _TagIndexSlot* new_names = calloc(new_capacity, sizeof(_TagIndexSlot));
+    _TagIndexSlot* new_aliases = calloc(new_capacity, sizeof(_TagIndexSlot));
+    if (new_names == NULL || new_aliases == NULL) {
+        free(new_names);
+        free(new_aliases);
+        return false;
     }
 
-    // Check if memory operation failed
-    if (_tags_array == NULL) return false;
+    // The tables are stored before the capacity, a reader loading the capacity first never indexes past its table
+    _TagIndexSlot* old_names = _name_index;
+    _TagIndexSlot* old_aliases = _alias_index;
+    _registry_write_begin();
+    _TS_STORE(_name_index, new_names);
+    _TS_STORE(_alias_index, new_aliases);
+    _TS_STORE(_index_capacity, new_capacity);
+    _name_shadowed = 0;
+#ifdef BASIC_TAG_THREAD_SAFE
+    // Retired once the new tables are published
+    _retire(old_names, _RETIRED_MEMORY);
+    _retire(old_aliases, _RETIRED_MEMORY);
+#else
+    free(old_names);
+    free(old_aliases);
+#endif
 
-    // Walk list and add addresses to _tags_array
-    FunctionalBasicTagNode* current = _head;
-    size_t count = _NodeCount - 1; // start at end and work backwards
-    while (current != NULL) {
-        _tags_array[count] = current->tag_ptr;
-        current = current->next_node;
-        count--;
+    // Rehash, oldest first so the newest tag wins for duplicate names
+    for (size_t i = 0; i < _tags_count; i++) _index_add_tag(_tags_array[i]);
+    for (size_t i = 0; i < _compact_capacity; i++) {
+        if (_compact_live(&(_compact_tags[i]))) _index_add_compact(&(_compact_tags[i]));
     }
+    _registry_write_end();
     return true;
 }
 
-static FunctionalBasicTagNode* _add_tag_to_list(FunctionalBasicTag* tag) {
-    FunctionalBasicTagNode* new = malloc(sizeof(FunctionalBasicTagNode));
-    if (new == NULL)
-        return NULL;
-    new->tag_ptr = tag;
+static void _index_remove_tag(FunctionalBasicTag* tag) {
+    if (_index_capacity == 0) return;
+    _TagIndexSlot* slot = _index_find_slot(_alias_index, _index_capacity, _hash_alias(tag->alias), NULL, false);
+    if (slot != NULL && slot->tag == tag) _index_remove_slot(_alias_index, slot);
 
-    if (_head == NULL) {
-        new->next_node = NULL;
-    } else {
-        new->next_node = _head;
+    if (tag->name == NULL) return;
+    slot = _index_find_slot(_name_index, _index_capacity, _hash_name(tag->name), tag->name, false);
+    if (slot == NULL) return;
+    if (slot->tag != tag) {
+        // This tag was shadowed by a newer tag with the same name
+        if (_name_shadowed > 0) _name_shadowed -= 1;
+        return;
+    }
+    _index_remove_slot(_name_index, slot);
+    if (_name_shadowed == 0) return;
+
+    // Expose another remaining tag with the same name, only needed when names have been reused
+    for (size_t i = _tags_count; i > 0; i--) {
+        FunctionalBasicTag* other = _tags_array[i - 1];
+        if (other != tag && other->name != NULL && strcmp(other->name, tag->name) == 0) {
+            _name_shadowed -= 1;
+            _index_insert(_name_index, _hash_name(other->name), other, true);
+            return;
+        }
+    }
+}
+
+static void _index_remove_compact(CompactBasicTag* tag) {
+    // Same as _index_remove_tag, another compact tag with the same name is searched for in the compact storage
+    if (_index_capacity == 0) return;
+    _TagIndexSlot* slot = _index_find_slot(_alias_index, _index_capacity, _hash_alias(tag->alias), NULL, true);
+    if (slot != NULL && slot->tag == tag) _index_remove_slot(_alias_index, slot);
+
+    if (tag->name == NULL) return;
+    slot = _index_find_slot(_name_index, _index_capacity, _hash_name(tag->name), tag->name, true);
+    if (slot == NULL) return;
+    if (slot->tag != tag) {
+        if (_name_shadowed > 0) _name_shadowed -= 1;
+        return;
     }
+    _index_remove_slot(_name_index, slot);
+    if (_name_shadowed == 0) return;
 
-    _head = new;
-    _NodeCount += 1;
-    
-    _update_tags_array();
+    for (size_t i = 0; i < _compact_capacity; i++) {
+        CompactBasicTag* other = &(_compact_tags[i]);
+        if (other != tag && _compact_live(other) && other->name != NULL && strcmp(other->name, tag->name) == 0) {
+            _name_shadowed -= 1;
+            _index_insert(_name_index, _hash_name(other->name), other, true);
+            return;
+        }
+    }
+}
 
-    return new;
+bool reserveTags(size_t count) {
+    _writer_lock();
+    bool reserved = _grow_tags_array(count) && _grow_index(count);
+    _writer_unlock();
+    return reserved;
 }
 
-static bool _remove_tag_from_list(FunctionalBasicTag* tag) {
-    FunctionalBasicTagNode* current = _head;
-    FunctionalBasicTagNode* prev = _head;
-     while (current != NULL) {
-        if (current->tag_ptr == tag) {
-            if (current == _head) {
-                // remove current reference from head
-                _head = current->next_node;
-            } else {
-                // Remove current reference from list
-                prev->next_node = current->next_node;
-            }
+static bool _add_tag_to_registry(FunctionalBasicTag* tag) {
+    if (!_grow_tags_array(_tags_count + 1) || !_grow_index(_tags_count + 1)) return false;
+
+    // The tag pointer is stored before the count, so readers never see an unset entry
+    tag->_idx = _tags_count;
+    _tags_array[_tags_count] = tag;
+    _TS_STORE(_tags_count, _tags_count + 1);
+    _registry_write_begin();
+    _index_add_tag(tag);
+    _registry_write_end();
+    if (tag->alias > _max_alias) _max_alias = tag->alias;
+    _TS_STORE(_scan_plan_dirty, true);
+    _TS_STORE(_schedule_dirty, true);
+    _TS_STORE(_sorted_dirty, true);
+    return true;
+}
+
+static bool _index_insert_alias(FunctionalBasicTag* tag) {
+    // Inserts into the alias table unless the alias is taken, aliasValid and the insert in a single probe
+    uint32_t hash = _hash_alias(tag->alias);
+    size_t mask = _index_capacity - 1;
+    size_t pos = hash & mask;
+    while (_alias_index[pos].tag != NULL) {
+        if (_alias_index[pos].hash == hash) return false;
+        pos = (pos + 1) & mask;
+    }
+    _alias_index[pos].hash = hash;
+    _alias_index[pos].tag = tag;
+    return true;
+}
+
+static int _next_alias();  // getNextAlias without the writer lock
 
-            free(current);
-            _NodeCount -= 1;
-            _update_tags_array();
-            return true;
+static void _add_tags_to_registry(size_t added) {
+    /*
+    Registers the tags already stored in _tags_array after _tags_count in one pass, the array and the index must
+    have been grown for them. Used to build the registry in bulk: each tag costs one alias probe and a name insert,
+    taken aliases are replaced like createTag does, and the count and dirty flags are published once
+    */
+    size_t first = _tags_count;
+    int next_alias = _next_alias();
+    for (size_t i = first; i < first + added; i++) {
+        if (_tags_array[i]->alias >= next_alias) next_alias = _tags_array[i]->alias + 1;
+    }
+    _registry_write_begin();
+    for (size_t i = first; i < first + added; i++) {
+        FunctionalBasicTag* tag = _tags_array[i];
+        tag->_idx = i;
+        if (!_index_insert_alias(tag)) {
+            tag->alias = next_alias++;
+            _index_insert_alias(tag);
         }
-        prev = current;
-        current = current->next_node;
-     }
-    return false;
+        if (tag->name != NULL) _index_insert(_name_index, _hash_name(tag->name), tag, true);
+        if (tag->alias > _max_alias) _max_alias = tag->alias;
+    }
+    _registry_write_end();
+    // The tags are only visible in the array once they are all indexed
+    _TS_STORE(_tags_count, first + added);
+    _TS_STORE(_scan_plan_dirty, true);
+    _TS_STORE(_schedule_dirty, true);
+    _TS_STORE(_sorted_dirty, true);
+}
+
+static void _subscriptions_move(FunctionalBasicTag* tag, FunctionalBasicTag* last, size_t idx, size_t last_idx);  // See Subscriptions
+
+static bool _remove_tag_from_registry(FunctionalBasicTag* tag) {
+    size_t idx = tag->_idx;
+    if (idx >= _tags_count || _tags_array[idx] != tag) return false;  // Not a registered tag
+    size_t last_idx = _tags_count - 1;
+    FunctionalBasicTag* last = _tags_array[last_idx];
+
+#ifdef BASIC_TAG_THREAD_SAFE
+    // Readers may be iterating the array, the swap-remove is done on a copy
+    FunctionalBasicTag** new_array = malloc(_tags_capacity * sizeof(FunctionalBasicTag*));
+    if (new_array == NULL) return false;
+    memcpy(new_array, _tags_array, _tags_count * sizeof(FunctionalBasicTag*));
+    memset(new_array + _tags_count, 0, (_tags_capacity - _tags_count) * sizeof(FunctionalBasicTag*));  // Same as _grow_tags_array
+#else
+    FunctionalBasicTag** new_array = _tags_array;
+#endif
+
+    _registry_write_begin();
+    _index_remove_tag(tag);
+    _registry_write_end();
+    if (tag->alias == _max_alias) _max_alias_stale = true;
+    if ((tag->_subscribers | last->_subscribers) != 0) _subscriptions_move(tag, last, idx, last_idx);
+
+    // Swap the last tag into the freed index
+    new_array[idx] = last;
+    last->_idx = idx;
+    new_array[last_idx] = NULL;  // A reader that still has the old count skips it
+#ifdef BASIC_TAG_THREAD_SAFE
+    FunctionalBasicTag** old_array = _tags_array;
+    _TS_STORE(_tags_array, new_array);
+    _retire(old_array, _RETIRED_MEMORY);
+#endif
+    _TS_STORE(_tags_count, last_idx);
+    _TS_STORE(_scan_plan_dirty, true);
+    _TS_STORE(_schedule_dirty, true);
+    _TS_STORE(_sorted_dirty, true);
+    return true;
 }
 
 void iterTags(TagFunction tagFn) {
-    if (_head == NULL) return;  // If there are no tags return right away
-    FunctionalBasicTagNode* current = _head;
-    while (current != NULL) {
-        tagFn(current->tag_ptr);
-        current = current->next_node;
+    // Most recently created tags first, same order as the linked list used before v1.4.0
+    // Safe to delete the current tag from tagFn, only tags that were already visited get moved
+    uint32_t token = _rcu_read_begin();
+    for (size_t i = _TS_LOAD(_tags_count); i > 0; i--) {
+        FunctionalBasicTag* tag = _TS_LOAD(_tags_array)[i - 1];
+        if (tag != NULL) tagFn(tag);
+    }
+    _rcu_read_end(token);
+}
+
+
+/*
+Library Allocator (v1.4.0)
+Every allocation made for tags and values goes through _bt_alloc/_bt_free. When an arena has been set with
+setBasicTagArena the memory is carved from the arena, otherwise it is malloc'd. A small header in front of
+each block records where it came from, so blocks can always be freed correctly even if the arena is changed.
+*/
+
+#define _BT_ALIGN_UP(size) BASIC_TAG_ALIGN_UP(size)
+
+typedef struct {
+  BasicTagArena* arena;  // NULL when the block was malloc'd
+  size_t size;  // Requested size, excluding the header
+} _AllocHeader;
+
+#define _ALLOC_HEADER_SIZE _BT_ALIGN_UP(sizeof(_AllocHeader))
+
+static BasicTagArena* _arena = NULL;
+static BasicTagAllocStats _alloc_stats = {0};
+
+bool initBasicTagArena(BasicTagArena* arena, void* buffer, size_t capacity) {
+  if (arena == NULL || buffer == NULL) return false;
+  // Align the start of the buffer, the capacity shrinks by whatever was skipped
+  size_t skip = _BT_ALIGN_UP((uintptr_t)buffer) - (uintptr_t)buffer;
+  if (skip > capacity) return false;
+  arena->buffer = (uint8_t*)buffer + skip;
+  arena->capacity = capacity - skip;
+  arena->used = 0;
+  arena->high_water = 0;
+  arena->allocations = 0;
+  arena->failed_allocations = 0;
+  return true;
+}
+
+bool setBasicTagArena(BasicTagArena* arena) {
+  // NULL switches back to malloc, blocks already carved from an arena stay valid
+  if (arena != NULL && arena->buffer == NULL) return false;
+  _arena = arena;
+  return true;
+}
+
+BasicTagArena* getBasicTagArena() {
+  return _arena;
+}
+
+bool getBasicTagAllocStats(BasicTagAllocStats* stats) {
+  if (stats == NULL) return false;
+  *stats = _alloc_stats;
+  return true;
+}
+
+static void* _bt_alloc(size_t size) {
+  size_t total = _ALLOC_HEADER_SIZE + _BT_ALIGN_UP(size);
+  _AllocHeader* header = NULL;
+
+  if (_arena != NULL) {
+    if (_arena->capacity - _arena->used < total) {
+      _arena->failed_allocations += 1;
+      _alloc_stats.failed_allocations += 1;
+      return NULL;
+    }
+    header = (_AllocHeader*)(_arena->buffer + _arena->used);
+    _arena->used += total;
+    _arena->allocations += 1;
+    if (_arena->used > _arena->high_water) _arena->high_water = _arena->used;
+  } else {
+    header = (_AllocHeader*)malloc(total);
+    if (header == NULL) {
+      _alloc_stats.failed_allocations += 1;
+      return NULL;
     }
+  }
+
+  header->arena = _arena;
+  header->size = size;
+  _alloc_stats.allocations += 1;
+  _alloc_stats.total_allocations += 1;
+  _alloc_stats.bytes_in_use += total;
+  if (_alloc_stats.bytes_in_use > _alloc_stats.high_water) _alloc_stats.high_water = _alloc_stats.bytes_in_use;
+  return (uint8_t*)header + _ALLOC_HEADER_SIZE;
+}
+
+static void _bt_free(void* ptr) {
+  if (ptr == NULL) return;
+  _AllocHeader* header = (_AllocHeader*)((uint8_t*)ptr - _ALLOC_HEADER_SIZE);
+  size_t total = _ALLOC_HEADER_SIZE + _BT_ALIGN_UP(header->size);
+  _alloc_stats.allocations -= 1;
+  _alloc_stats.bytes_in_use -= total;
+
+  BasicTagArena* arena = header->arena;
+  if (arena == NULL) {
+    free(header);
+    return;
+  }
+  // Arena memory is only reclaimed when the most recent block is freed
+  arena->allocations -= 1;
+  if ((uint8_t*)header + total == arena->buffer + arena->used) arena->used -= total;
 }
 
 
@@ -178,15 +941,15 @@ static bool _init_string_value(Value* value, size_t max_str_length) {
     return true;
   }
 
-  value->stringValue = (char*)malloc(max_str_length + 1);
-  if (!value->stringValue) return false; // Check for malloc failure
+  value->stringValue = (char*)_bt_alloc(max_str_length + 1);
+  if (!value->stringValue) return false; // Check for allocation failure
   memset(value->stringValue, '\0', max_str_length + 1);
   return true;
 }
 
 static bool _deallocate_string_value(Value* value) {
   if (value->stringValue == NULL) return false;  // If it's already NULL there's nothing to free
-  free(value->stringValue);
+  _bt_free(value->stringValue);
   value->stringValue = NULL;
   return true;
 }
@@ -194,46 +957,33 @@ static bool _deallocate_string_value(Value* value) {
 
 // BufferValue allocate/deallocate
 
+static void _layout_buffer_value(BufferValue* buffer_value, size_t buffer_size) {
+  // The buffer sits directly after the BufferValue struct
+  buffer_value->buffer = buffer_size > 0 ? (uint8_t*)buffer_value + _BT_ALIGN_UP(sizeof(BufferValue)) : NULL;
+  buffer_value->written_length = 0;
+  buffer_value->allocated_length = buffer_size;
+  if (buffer_size > 0) memset(buffer_value->buffer, 0x0, buffer_size);
+}
+
 static bool _init_buffer_value(Value* value, size_t buffer_size) {
   /*
-  Allocates both a ValueBuffer and it's corresponding uint8_t* buffer
+  Allocates both a ValueBuffer and it's corresponding uint8_t* buffer, as a single block since v1.4.0
+  0 Length would be a useless tag and indicative of config error, only the BufferValue is allocated in that case
   */
   if (value->bytesValue != NULL) return false; // Don't allocate to an already allocated
 
-  // Allocate the BufferValue
-  value->bytesValue = (BufferValue*)malloc(sizeof(BufferValue));
+  value->bytesValue = (BufferValue*)_bt_alloc(_BT_ALIGN_UP(sizeof(BufferValue)) + buffer_size);
   if (value->bytesValue == NULL) {
     return false; // Allocation failed
   }
-
-  // 0 Length case, no need to allocate; this would be a useless tag and indicative of config error
-  if (buffer_size < 1) {
-    value->bytesValue->buffer = NULL;
-    value->bytesValue->written_length = 0;
-    value->bytesValue->allocated_length = 0;
-    return true;
-  }
-
-  value->bytesValue->buffer = (uint8_t*)malloc(buffer_size);
-  // Handle allocation failure
-  if (value->bytesValue->buffer == NULL) {
-    free(value->bytesValue);
-    value->bytesValue = NULL;
-    return false;
-  }
-
-  // Successfully initialized the buffer
-  value->bytesValue->written_length = 0;
-  value->bytesValue->allocated_length = buffer_size;
+  _layout_buffer_value(value->bytesValue, buffer_size);
   return true;
 }
 
 static bool _deallocate_buffer_value(Value* value) {
   if (value->bytesValue == NULL) return false; // There is no buffer value allocated
 
-  if (value->bytesValue->buffer != NULL) free(value->bytesValue->buffer);  // If it's already NULL there's nothing to free
-
-  free(value->bytesValue);  // free the BufferValue instance
+  _bt_free(value->bytesValue);  // frees the BufferValue instance along with its buffer
   value->bytesValue = NULL; // Reset pointer to NULL
 
   return true;
@@ -242,11 +992,41 @@ static bool _deallocate_buffer_value(Value* value) {
 
 /* Tag Create and Delete Functions */
 
+/*
+v1.4.0 a tag and the storage for its current and previous values are a single block:
+[FunctionalBasicTag][current value storage][previous value storage]
+String values are max length + 1 chars, bytes values are a BufferValue followed by its buffer.
+*/
+
+static size_t _value_storage_size(SparkplugDataType datatype, size_t buffer_value_max_len) {
+  // Size of the storage for one value (current or previous) of a tag, same macro used for static tag tables
+  return BASIC_TAG_VALUE_STORAGE_SIZE(datatype, buffer_value_max_len);
+}
 
-static bool _init_functional_basic_tag(FunctionalBasicTag* tag, char* name, void* value_address, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable, size_t buffer_value_max_len) {
-  if (tag == NULL) return false; // Safety check to ensure the tag pointer is not null
+static void _layout_value_storage(BasicValue* value, uint8_t* storage, size_t buffer_value_max_len) {
+  switch (value->datatype) {
+    case spUUID:
+      buffer_value_max_len = 36;  // Override buffer max value to length of UUID
+      /* fall through */
+    case spText:
+    case spString:
+      value->value.stringValue = buffer_value_max_len > 0 ? (char*)storage : NULL;
+      if (buffer_value_max_len > 0) memset(storage, '\0', buffer_value_max_len + 1);
+      break;
+    case spBytes:
+      value->value.bytesValue = (BufferValue*)storage;
+      _layout_buffer_value(value->value.bytesValue, buffer_value_max_len);
+      break;
+    default:
+      break;
+  }
+}
 
-  if (!aliasValid(alias)) alias = getNextAlias();  // If alias is not unique, make it so
+static bool _init_functional_basic_tag(FunctionalBasicTag* tag, const char* name, void* value_address, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable, size_t buffer_value_max_len, uint8_t* value_storage, bool retain_previous) {
+  /*
+  value_storage must hold 2 * _value_storage_size(datatype, buffer_value_max_len) bytes, or 1 * without retain_previous
+  */
+  if (tag == NULL) return false; // Safety check to ensure the tag pointer is not null
 
   // Set the name, value_address, alias, and datatype
   tag->name = name;
@@ -259,72 +1039,276 @@ static bool _init_functional_basic_tag(FunctionalBasicTag* tag, char* name, void
   tag->compareFunc = DefaultCompareFn;
   tag->valueChanged = false;
   tag->lastRead = 0;
+  tag->changeMicros = 0;
   tag->onChange = NULL; // Must be set by addOnChangeCallback to keep backward compatibility
   tag->validateWrite = NULL; // Must be set by addValidateWriteCallback to keep backward compatibility
   //tag->_extra_data = NULL;  // For adding custom data to a tag, when using it to build another library and need to store additional data
+  tag->_idx = 0;
+  tag->_scan_group = 0xFF;  // Not in a scan group until readAllBasicTags rebuilds its scan plan (_SCAN_GROUP_NONE)
+  tag->_scan_slot = 0;
+  tag->_seq = 0;
+  tag->_queued = 0;
+  tag->deadband_mode = 0;  // BASIC_TAG_DEADBAND_NONE
+  tag->deadband = 0;
+  tag->min_report_interval = 0;
+  tag->_str_len = 0;
+  tag->_write_gen = 0;
+  tag->_read_gen = 0;
+  tag->writer_notifies = false;
+  tag->_zero_copy = 0;
+  tag->retain_previous = retain_previous;
+  tag->history = NULL;
+  tag->series = NULL;
+  tag->source = NULL;
+  tag->_subscribers = 0;
+#ifdef BASIC_TAG_ENABLE_STATS
+  tag->stats_compare_max_us = 0;
+  tag->stats_onchange_max_us = 0;
+#endif
+  tag->scan_period = 0;  // Read on every readDueBasicTags call
 
   // Initialize currentValue and previousValue
   tag->currentValue.timestamp = 0;
   tag->currentValue.datatype = datatype;
   tag->currentValue.isNull = true;
+  tag->currentValue.value.uint64Value = 0;
   tag->previousValue.timestamp = 0;
   tag->previousValue.datatype = datatype;
   tag->previousValue.isNull = true;
+  tag->previousValue.value.uint64Value = 0;
 
-  switch (datatype) {
-    case spUUID:
-      buffer_value_max_len = 36;  // Override buffer max value to length of UUID
-    case spText:
-    case spString:
-      // Allocate the strings for values
-      {
-      // WARNING: ASSUMES THE VALUES HAVE NOT YET BEEN ALLOCATED/INITIALIZED
-      // CALLING __init_functional_basic_tag twice on same tag will cause memory leak
-      tag->currentValue.value.stringValue = NULL;
-      tag->previousValue.value.stringValue = NULL;
-
-      _init_string_value(&(tag->currentValue.value), buffer_value_max_len);
-      _init_string_value(&(tag->previousValue.value), buffer_value_max_len);
-      }
-      break;
-    case spBytes:
-      // WARNING: ASSUMES THE VALUES HAVE NOT YET BEEN ALLOCATED/INITIALIZED
-      // CALLING __init_functional_basic_tag twice on same tag will cause memory leak
-      tag->currentValue.value.bytesValue = NULL;
-      tag->previousValue.value.bytesValue = NULL;
-      // Allocate bytes buffer
-      _init_buffer_value(&(tag->currentValue.value), buffer_value_max_len);
-      _init_buffer_value(&(tag->previousValue.value), buffer_value_max_len);
-      break;
-    default:
-      break;
+  // Point string and bytes values at their storage
+  size_t storage_size = _value_storage_size(datatype, buffer_value_max_len);
+  if (storage_size > 0) {
+    _layout_value_storage(&(tag->currentValue), value_storage, buffer_value_max_len);
+    if (retain_previous) _layout_value_storage(&(tag->previousValue), value_storage + storage_size, buffer_value_max_len);
   }
 
   return true;
 }
 
 
-FunctionalBasicTag* createTag(const char* name, void* value_address, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable, size_t buffer_value_max_len) {
-    /* 
-    handles the creation of a new tag, including adding to a tags linked list
-    This should always be used to create tags
+static bool _deallocate_functional_basic_tag(FunctionalBasicTag* tag) {
+    /*
+    The value buffers are part of the tag's block, freeing the tag frees everything
     */
+    _bt_free(tag);
+    return true;
+}
 
-    FunctionalBasicTag* newTag = (FunctionalBasicTag*)malloc(sizeof(FunctionalBasicTag));
-    if (newTag == NULL) {
-        // Handle memory allocation failure
-        return NULL;
-    }
 
-    if(!_init_functional_basic_tag(newTag, name, value_address, alias, datatype, local_writable, remote_writable, buffer_value_max_len)) {
-        free(newTag);
+static void _unqueue_tag(FunctionalBasicTag* tag);  // See Change Queue
+static void _source_detach(FunctionalBasicTag* tag);  // See Value Sources
+
+static FunctionalBasicTag* _create_tag(const char* name, void* value_address, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable, size_t buffer_value_max_len, bool zero_copy, bool retain_previous);
+static bool _retain_previous_default = true;  // See Previous Value Retention
+static bool _intern_names = false;  // See Name Prefixes
+static const char* _intern_name(const char* name);
+
+FunctionalBasicTag* createTag(const char* name, void* value_address, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable, size_t buffer_value_max_len) {
+    /* 
+    handles the creation of a new tag, including adding to the tag registry
+    This should always be used to create tags
+    */
+    return _create_tag(name, value_address, alias, datatype, local_writable, remote_writable, buffer_value_max_len, false, _retain_previous_default);
+}
+
+static size_t _bytes_source_size(BasicTagBytesSource* source);
+
+static FunctionalBasicTag* _alloc_tag(const char* name, void* value_address, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable, size_t buffer_value_max_len, bool retain_previous) {
+    // Writer lock held. The tag and its value storage in one block, not registered yet
+    size_t tag_size = _BT_ALIGN_UP(sizeof(FunctionalBasicTag));
+    size_t storage_size = (retain_previous ? 2 : 1) * _value_storage_size(datatype, buffer_value_max_len);
+    if (_intern_names && name != NULL) {
+        name = _intern_name(name);
+        if (name == NULL) return NULL;
+    }
+    uint8_t* block = (uint8_t*)_bt_alloc(tag_size + storage_size);
+    if (block == NULL) return NULL;  // Handle memory allocation failure
+    FunctionalBasicTag* tag = (FunctionalBasicTag*)block;
+    if (!_init_functional_basic_tag(tag, name, value_address, alias, datatype, local_writable, remote_writable, buffer_value_max_len, block + tag_size, retain_previous)) {
+        _bt_free(block);
         return NULL;
     }
+    return tag;
+}
 
-    _add_tag_to_list(newTag);
+static FunctionalBasicTag* _create_tag(const char* name, void* value_address, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable, size_t buffer_value_max_len, bool zero_copy, bool retain_previous) {
+    // zero_copy tags have no value storage of their own, the values point into the BasicTagBytesSource
+    if (zero_copy) buffer_value_max_len = 0;
+    _writer_lock();
+    if (!aliasValid(alias)) alias = _next_alias();  // If alias is not unique, make it so
+    FunctionalBasicTag* newTag = _alloc_tag(name, value_address, alias, datatype, local_writable, remote_writable, buffer_value_max_len, retain_previous);
+    if (newTag != NULL) {
+        if (zero_copy) {
+            // Set before the tag is registered, readers on other tasks must never see it as a plain bytes tag
+            newTag->_zero_copy = 1;
+            newTag->buffer_value_max_len = _bytes_source_size((BasicTagBytesSource*)value_address);
+        }
+        if (!_add_tag_to_registry(newTag)) {
+            _deallocate_functional_basic_tag(newTag);
+            newTag = NULL;
+        }
+    }
+    _rcu_reclaim();
+    _writer_unlock();
     return newTag;
 }
 
+size_t createTagsBatch(const BasicTagDefinition* definitions, size_t count, FunctionalBasicTag** tags_out) {
+    /*
+    Creates a tag for each definition, returns the number of tags created.
+    The whole batch is one writer lock: the registry and index are grown once, the tags are allocated into the
+    unused end of the array, then _add_tags_to_registry assigns the aliases and indexes them in one pass.
+    Nothing is created if the registry can't be grown for the batch.
+    tags_out is optional, when supplied it receives the created tag (or NULL on failure) for each definition.
+    */
+    if (definitions == NULL) return 0;
+    _writer_lock();
+    size_t first = _tags_count;
+    if (_static_table != NULL || !_grow_tags_array(first + count) || !_grow_index(first + count)) {
+        _writer_unlock();
+        if (tags_out != NULL) memset(tags_out, 0, count * sizeof(FunctionalBasicTag*));
+        return 0;
+    }
+
+    size_t created = 0;
+    for (size_t i = 0; i < count; i++) {
+        const BasicTagDefinition* def = &(definitions[i]);
+        FunctionalBasicTag* tag = _alloc_tag(def->name, def->value_address, def->alias, def->datatype, def->local_writable, def->remote_writable, def->buffer_value_max_len, _retain_previous_default);
+        if (tags_out != NULL) tags_out[i] = tag;
+        if (tag != NULL) _tags_array[first + created++] = tag;  // Past _tags_count until the batch is registered
+    }
+    _add_tags_to_registry(created);
+    _rcu_reclaim();
+    _writer_unlock();
+    return created;
+}
+
+/*
+Static Tag Tables (v1.4.0)
+The descriptors are const (flash), the tags and their values live in RAM blocks declared by the
+BASIC_TAG_STATIC_TABLE macro, so registering a table never allocates. A static table replaces the registry:
+createTag and deleteTag fail while it is registered.
+*/
+
+static void _sort_tags_by_alias(FunctionalBasicTag** tags, size_t count) {
+    // Shell sort, no allocation and no recursion
+    for (size_t gap = count / 2; gap > 0; gap /= 2) {
+        for (size_t i = gap; i < count; i++) {
+            FunctionalBasicTag* tag = tags[i];
+            size_t j = i;
+            while (j >= gap && tags[j - gap]->alias > tag->alias) {
+                tags[j] = tags[j - gap];
+                j -= gap;
+            }
+            tags[j] = tag;
+        }
+    }
+}
+
+static FunctionalBasicTag* _static_table_find_alias(int alias) {
+    BasicTagStaticTable* table = _static_table;
+    if (table->count == 0) return NULL;
+    if (table->dense_aliases) {
+        // Aliases are min_alias..min_alias + count - 1, the alias is the index
+        if (alias < table->min_alias) return NULL;
+        size_t idx = (size_t)((int64_t)alias - table->min_alias);
+        return idx < table->count ? table->alias_lookup[idx] : NULL;
+    }
+    // Binary search the tags sorted by alias
+    size_t low = 0;
+    size_t high = table->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int mid_alias = table->alias_lookup[mid]->alias;
+        if (mid_alias == alias) return table->alias_lookup[mid];
+        if (mid_alias < alias) low = mid + 1;
+        else high = mid;
+    }
+    return NULL;
+}
+
+bool registerStaticTagTable(BasicTagStaticTable* table) {
+    if (table == NULL || table->descriptors == NULL || table->tags == NULL || table->alias_lookup == NULL) return false;
+    _writer_lock();
+    if (_tags_count > 0 || _static_table != NULL) {
+        // Only allowed when there are no other tags
+        _writer_unlock();
+        return false;
+    }
+
+    // Release the heap registry, lookups go through the table from now on
+    _TS_STORE(_index_capacity, 0);
+    FunctionalBasicTag** old_array = _tags_array;
+    _TagIndexSlot* old_names = _name_index;
+    _TagIndexSlot* old_aliases = _alias_index;
+    _TS_STORE(_name_index, NULL);
+    _TS_STORE(_alias_index, NULL);
+    _TS_STORE(_tags_array, table->tags);
+    _tags_capacity = table->count;
+#ifdef BASIC_TAG_THREAD_SAFE
+    // Retired once nothing points at them any more
+    _retire(old_array, _RETIRED_MEMORY);
+    _retire(old_names, _RETIRED_MEMORY);
+    _retire(old_aliases, _RETIRED_MEMORY);
+#else
+    free(old_array);
+    free(old_names);
+    free(old_aliases);
+#endif
+    _name_shadowed = 0;
+    _max_alias = 0;
+    _max_alias_stale = false;
+
+    size_t tag_size = BASIC_TAG_ALIGN_UP(sizeof(FunctionalBasicTag));
+    for (size_t i = 0; i < table->count; i++) {
+        const BasicTagStaticDescriptor* desc = &(table->descriptors[i]);
+        const BasicTagDefinition* def = &(desc->definition);
+        FunctionalBasicTag* tag = (FunctionalBasicTag*)desc->storage;
+        _init_functional_basic_tag(tag, def->name, def->value_address, def->alias, def->datatype, def->local_writable, def->remote_writable, def->buffer_value_max_len, (uint8_t*)desc->storage + tag_size, true);
+        tag->_idx = i;
+        table->tags[i] = tag;
+        table->alias_lookup[i] = tag;
+        if (tag->alias > _max_alias) _max_alias = tag->alias;
+    }
+
+    // Sort for the alias lookup, duplicate aliases are given new aliases past the max, which keeps it sorted
+    _sort_tags_by_alias(table->alias_lookup, table->count);
+    bool duplicates = false;
+    for (size_t i = 1; i < table->count; i++) {
+        if (table->alias_lookup[i]->alias == table->alias_lookup[i - 1]->alias) duplicates = true;
+    }
+    if (duplicates) {
+        int next_alias = _max_alias + 1;
+        for (size_t i = 1; i < table->count; i++) {
+            if (table->alias_lookup[i]->alias == table->alias_lookup[i - 1]->alias) {
+                // Move the duplicate to the end
+                FunctionalBasicTag* duplicate = table->alias_lookup[i];
+                memmove(&(table->alias_lookup[i]), &(table->alias_lookup[i + 1]), (table->count - i - 1) * sizeof(FunctionalBasicTag*));
+                duplicate->alias = next_alias++;
+                table->alias_lookup[table->count - 1] = duplicate;
+                if (duplicate->alias > _max_alias) _max_alias = duplicate->alias;
+                i--;
+            }
+        }
+    }
+
+    if (table->scan_plan != NULL) setBasicTagScanPlanStorage(table->scan_plan, table->scan_plan_size);
+
+    table->min_alias = table->count > 0 ? table->alias_lookup[0]->alias : 0;
+    table->dense_aliases = table->count > 0 && (int64_t)table->alias_lookup[table->count - 1]->alias - table->min_alias + 1 == (int64_t)table->count;
+    // Published last, the alias lookup is ready by the time a reader can see it
+    _TS_STORE(_static_table, table);
+    _TS_STORE(_tags_count, table->count);
+    _TS_STORE(_scan_plan_dirty, true);
+    _TS_STORE(_schedule_dirty, true);
+    _TS_STORE(_sorted_dirty, true);
+    _rcu_reclaim();
+    _writer_unlock();
+    return true;
+}
+
 /*Create String & Buffer Types*/
 FunctionalBasicTag* createStringTag(const char* name, char* value_address, int alias, bool local_writable, bool remote_writable, size_t string_max_len) {
   return createTag(name, (void*)value_address, alias, spString, local_writable, remote_writable, string_max_len);
@@ -379,40 +1363,27 @@ FunctionalBasicTag* createBoolTag(const char* name, bool* value_address, int ali
 }
 
 
-static bool _deallocate_functional_basic_tag(FunctionalBasicTag* tag) {
-    /*
-    Deallocate any malloc'd variables before tag is deallocated
-    */
-    switch (tag->datatype) {
-        case spText:
-        case spUUID:
-        case spString:
-            // Deallocate char buffers
-            _deallocate_string_value(&(tag->currentValue.value));
-            _deallocate_string_value(&(tag->previousValue.value));
-            break;
-        case spBytes:
-            // Deallocate bytes buffer
-            _deallocate_buffer_value(&(tag->currentValue.value));
-            _deallocate_buffer_value(&(tag->previousValue.value));
-            break;
-        default:
-            break;
-    }
-
-    free(tag);
-
-    return true;
-}
-
-
 bool deleteTag(FunctionalBasicTag* tag) {
     /*
     Used for deleting a tag created by createTag
-    also handles removing from linked list
+    also handles removing from the tag registry
     */
-    if(_deallocate_functional_basic_tag(tag)) return _remove_tag_from_list(tag);
-    return false;
+    if (tag == NULL) return false;
+    _writer_lock();
+    // Tags of a static table can't be deleted
+    bool removed = _static_table == NULL && _remove_tag_from_registry(tag);
+    if (removed) {
+        _unqueue_tag(tag);  // Pending change events for the tag are skipped
+        _source_detach(tag);
+#ifdef BASIC_TAG_THREAD_SAFE
+        _retire(tag, _RETIRED_TAG);  // Freed once no reader can be using it
+#else
+        _deallocate_functional_basic_tag(tag);
+#endif
+    }
+    _rcu_reclaim();
+    _writer_unlock();
+    return removed;
 }
 
 
@@ -452,64 +1423,2497 @@ static bool _copy_buffer_value(BufferValue* reference_buf, BufferValue* target_b
     return true;
   }
 
-  size_t length = reference_buf->written_length;
-  // Check buffer length, safety check to makesure target buffer is never overflowed
-  if (length > target_buf->allocated_length) length = target_buf->allocated_length;
+  size_t length = reference_buf->written_length;
+  // Check buffer length, safety check to makesure target buffer is never overflowed
+  if (length > target_buf->allocated_length) length = target_buf->allocated_length;
+
+
+  // Copy the bytes from reference to target, v1.4.0 fixed this copying over the BufferValue struct itself
+  memcpy(target_buf->buffer, reference_buf->buffer, length);
+  target_buf->written_length = length;
+  return true;
+}
+
+static void _copyBasicValue(BasicValue* reference, BasicValue* target, size_t buffer_value_max_len) {
+    if (reference == NULL || target == NULL) return;
+
+    // Copy simple fields
+    target->timestamp = reference->timestamp;
+    target->datatype = reference->datatype;
+    target->isNull = reference->isNull;
+
+    // If it's null there's nothing else to copy
+    if (reference->isNull) return;
+
+    // Depending on the SparkplugDataType, handle the value copying
+    switch (reference->datatype) {
+      case spInt8:
+      case spInt16:
+      case spInt32:
+      case spInt64:
+      case spUInt8:
+      case spUInt16:
+      case spUInt32:
+      case spUInt64:
+      case spFloat:
+      case spDouble:
+      case spBoolean:
+      case spDateTime:
+        // For these types, direct assignment is fine
+        target->value = reference->value;
+        break;
+      case spText:  // Text is a string
+      case spUUID: // UUID is a string
+      case spString:
+        _copy_string_value(reference->value.stringValue, target->value.stringValue, buffer_value_max_len);
+        break;
+      case spBytes:
+        _copy_buffer_value(reference->value.bytesValue, target->value.bytesValue);
+        break;
+      default:
+        // For unknown types, you might not need to do anything
+        target->isNull = true;
+        break;
+    }
+}
+
+
+/*
+Scan Plan (v1.4.0)
+readAllBasicTags keeps the data it needs for numeric tags in dense per datatype arrays (the "hot" data):
+the value address, the last value and a changed flag. Everything else stays in the FunctionalBasicTag (the
+"cold" data): a scan only stores lastRead there, the rest is only touched when the value has changed. Tags that can't use the fast path (strings,
+bytes, custom compare functions, not read yet) are read with readBasicTag as a generic list.
+The plan is rebuilt by readAllBasicTags after tags have been created or deleted.
+*/
+
+#define _SCAN_GROUP_COUNT 12  // Number of datatypes with a fast path
+#define _SCAN_GROUP_NONE 0xFF  // _scan_group of a tag that isn't in a scan group
+
+typedef struct {
+  SparkplugDataType datatype;
+  size_t elem_size;
+  size_t count;
+  void** addresses;  // value_address of each tag
+  uint8_t* values;  // Raw value of each tag, elem_size each, always equal to tag->currentValue
+  uint8_t* changed;  // Mirror of tag->valueChanged, only tags flagged here need their valueChanged cleared
+  FunctionalBasicTag** tags;
+} _ScanGroup;
+
+static _ScanGroup _scan_groups[_SCAN_GROUP_COUNT];
+static FunctionalBasicTag** _scan_generic = NULL;
+static size_t _scan_generic_count = 0;
+
+typedef struct {
+  size_t* changed;  // Registry indexes of the reportable changes, optional
+  size_t max_changed;
+  uint32_t* bitmap;  // Dirty bitmap indexed by registry index, optional
+  size_t bitmap_words;
+  size_t count;  // Number of reportable changes, can be more than max_changed
+  FunctionalBasicTag** deferred;  // Parallel scan workers collect their changed tags here instead of reporting them
+  size_t deferred_count;
+} _ScanContext;  // Output of one scan
+
+static void _scan_record_change(_ScanContext* ctx, FunctionalBasicTag* tag) {
+  // Ignore tag changes for aliases below -1000
+  if (ctx == NULL || tag->alias <= -1000) return;
+  size_t idx = tag->_idx;
+  if (ctx->count < ctx->max_changed) ctx->changed[ctx->count] = idx;
+  if (idx / 32 < ctx->bitmap_words) ctx->bitmap[idx / 32] |= (uint32_t)1 << (idx % 32);
+  ctx->count++;
+}
+
+static uint8_t* _scan_plan_memory = NULL;  // Heap block holding the arrays
+static size_t _scan_plan_memory_size = 0;
+static uint8_t* _scan_plan_storage = NULL;  // Caller supplied block, used instead of the heap when big enough
+static size_t _scan_plan_storage_size = 0;
+
+// Value size of each scan group, in the order of _scan_group_index
+static const uint8_t _scan_elem_sizes[_SCAN_GROUP_COUNT] = {
+  sizeof(int8_t), sizeof(int16_t), sizeof(int32_t), sizeof(int64_t),
+  sizeof(uint8_t), sizeof(uint16_t), sizeof(uint32_t), sizeof(uint64_t),
+  sizeof(float), sizeof(double), sizeof(bool), sizeof(uint64_t)
+};
+
+static uint8_t _scan_group_index(SparkplugDataType datatype) {
+  switch (datatype) {
+    case spInt8: return 0;
+    case spInt16: return 1;
+    case spInt32: return 2;
+    case spInt64: return 3;
+    case spUInt8: return 4;
+    case spUInt16: return 5;
+    case spUInt32: return 6;
+    case spUInt64: return 7;
+    case spFloat: return 8;
+    case spDouble: return 9;
+    case spBoolean: return 10;
+    case spDateTime: return 11;
+    default: return _SCAN_GROUP_NONE;
+  }
+}
+
+static bool _can_use_fast_path(FunctionalBasicTag* tag) {
+  if (_scan_group_index(tag->datatype) == _SCAN_GROUP_NONE) return false;
+  if (tag->value_address == NULL || tag->compareFunc != DefaultCompareFn) return false;
+  // The first read always goes through readBasicTag
+  return tag->currentValue.timestamp != 0 && !tag->currentValue.isNull;
+}
+
+static void _scan_plan_sync(FunctionalBasicTag* tag) {
+  // Called by readBasicTag so the hot data always matches the tag, even when a tag is read directly
+  if (tag->_scan_group == _SCAN_GROUP_NONE || _scan_plan_dirty) return;
+  _ScanGroup* group = &(_scan_groups[tag->_scan_group]);
+  group->changed[tag->_scan_slot] = tag->valueChanged;
+  // All union members start at the same address, so the raw bytes of the value are at the start of the union
+  memcpy(group->values + tag->_scan_slot * group->elem_size, &(tag->currentValue.value), group->elem_size);
+}
+
+void invalidateBasicTagScanPlan() {
+  _TS_STORE(_scan_plan_dirty, true);
+}
+
+bool setBasicTagScanPlanStorage(void* buffer, size_t size) {
+  // Lets the scan plan live in a static buffer, so readAllBasicTags never allocates. NULL to go back to the heap
+  _scan_plan_storage = (uint8_t*)buffer;
+  _scan_plan_storage_size = buffer != NULL ? size : 0;
+  _TS_STORE(_scan_plan_dirty, true);
+  return true;
+}
+
+uint64_t getTagLastRead(FunctionalBasicTag* tag) {
+  // Same as tag->lastRead, the scan kernels stamp every tag they read
+  if (tag == NULL) return 0;
+  return tag->lastRead;
+}
+
+
+/*
+Value Snapshots (v1.4.0)
+Each tag has a sequence counter (seqlock) around every update of currentValue and previousValue: it is odd
+while the values are being written. snapshotTagValue copies currentValue and retries if the counter was odd
+or has moved, so a reader on another core or task gets a consistent copy without ever blocking the scan.
+A writer only pays two stores per changed value.
+*/
+
+#if defined(__GNUC__)
+#define _SEQ_LOAD(seq) __atomic_load_n(&(seq), __ATOMIC_ACQUIRE)
+#define _SEQ_LOAD_RELAXED(seq) __atomic_load_n(&(seq), __ATOMIC_RELAXED)
+#define _SEQ_STORE(seq, value) __atomic_store_n(&(seq), (value), __ATOMIC_RELEASE)
+#define _SEQ_STORE_RELAXED(seq, value) __atomic_store_n(&(seq), (value), __ATOMIC_RELAXED)
+#define _SEQ_FENCE_RELEASE() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define _SEQ_FENCE_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+// Single core targets only, the volatile accesses keep the compiler from reordering the counter
+#define _SEQ_LOAD(seq) (*(volatile uint32_t*)&(seq))
+#define _SEQ_LOAD_RELAXED(seq) (*(volatile uint32_t*)&(seq))
+#define _SEQ_STORE(seq, value) (*(volatile uint32_t*)&(seq) = (value))
+#define _SEQ_STORE_RELAXED(seq, value) (*(volatile uint32_t*)&(seq) = (value))
+#define _SEQ_FENCE_RELEASE()
+#define _SEQ_FENCE_ACQUIRE()
+#endif
+
+static inline void _seq_write_begin(FunctionalBasicTag* tag) {
+  _SEQ_STORE_RELAXED(tag->_seq, tag->_seq + 1);
+  // The odd counter must be visible before any of the value stores
+  _SEQ_FENCE_RELEASE();
+}
+
+static inline void _seq_write_end(FunctionalBasicTag* tag) {
+  _SEQ_STORE(tag->_seq, tag->_seq + 1);
+}
+
+bool snapshotTagValue(FunctionalBasicTag* tag, BasicValue* snapshot, void* storage, size_t storage_size) {
+  /*
+  storage holds string / bytes content and must be at least BASIC_TAG_VALUE_STORAGE_SIZE(datatype, buffer_value_max_len)
+  bytes, it can be NULL for numeric tags. snapshot points into storage after the call.
+  */
+  if (tag == NULL || snapshot == NULL) return false;
+  size_t storage_size_needed = _value_storage_size(tag->datatype, tag->buffer_value_max_len);
+  if (storage_size_needed > 0) {
+    if (storage == NULL || storage_size < storage_size_needed) return false;
+    snapshot->datatype = tag->datatype;
+    _layout_value_storage(snapshot, (uint8_t*)storage, tag->buffer_value_max_len);
+  }
+
+  while (true) {
+    uint32_t seq = _SEQ_LOAD(tag->_seq);
+    if (seq & 1) {
+      // Write in progress. Yield so a preempted writer on the same core (a lower priority scan task) can finish
+      BASIC_TAG_YIELD();
+      continue;
+    }
+    // The copy is bounded by the snapshot storage, so a torn read is only ever retried
+    _copyBasicValue(&(tag->currentValue), snapshot, tag->buffer_value_max_len);
+    _SEQ_FENCE_ACQUIRE();
+    if (_SEQ_LOAD_RELAXED(tag->_seq) == seq) return true;
+  }
+}
+
+uint32_t getTagValueVersion(FunctionalBasicTag* tag) {
+  // Goes up on every write of the tag's values (changed reads, retain previous changes, snapshot restores), lets a reader skip tags it already has
+  if (tag == NULL) return 0;
+  return _SEQ_LOAD(tag->_seq) >> 1;
+}
+
+
+/*
+Change Queue (v1.4.0)
+With a queue set by setBasicTagChangeQueue, reads don't call onChange: the change is put in a fixed size ring
+and onChange is called later by dispatchBasicTagChanges, after the scan or from another task. The scan is the
+only producer. Consumers take an event by moving the tail on with a compare and swap, which lets the producer
+move it too when it drops the oldest event, so no locks are needed on either side.
+*/
+
+#if defined(__GNUC__)
+#define _Q_LOAD(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define _Q_STORE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELEASE)
+#define _Q_CAS(var, expected, desired) __atomic_compare_exchange_n(&(var), &(expected), (desired), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#else
+// Single core targets only
+#define _Q_LOAD(var) (var)
+#define _Q_STORE(var, value) ((var) = (value))
+#define _Q_CAS(var, expected, desired) ((var) == (expected) ? ((var) = (desired), true) : ((expected) = (var), false))
+#endif
+
+static BasicTagChangeQueue* _change_queue = NULL;
+
+static size_t _dispatch_queue(BasicTagChangeQueue* queue, size_t max_events);  // See dispatchBasicTagChanges
+
+bool initBasicTagChangeQueue(BasicTagChangeQueue* queue, BasicTagChangeEvent* events, uint32_t capacity, BasicTagQueuePolicy policy) {
+  if (queue == NULL || events == NULL || capacity == 0) return false;
+  if (policy != BASIC_TAG_QUEUE_COALESCE && policy != BASIC_TAG_QUEUE_DROP_OLDEST && policy != BASIC_TAG_QUEUE_BLOCK) return false;
+  // Resetting the active queue would leave its pending tags marked as queued, so they are dispatched first
+  if (queue == _change_queue) _dispatch_queue(queue, 0);
+  queue->events = events;
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->tail = 0;
+  queue->policy = policy;
+  queue->dropped = 0;
+  queue->coalesced = 0;
+  return true;
+}
+
+bool setBasicTagChangeQueue(BasicTagChangeQueue* queue) {
+  /*
+  NULL goes back to calling onChange during the read. Events still in the previous queue are dispatched here,
+  otherwise a coalesced tag would stay marked as queued and never be reported again
+  */
+  if (queue != NULL && queue->events == NULL) return false;
+  BasicTagChangeQueue* previous = _change_queue;
+  _change_queue = queue;
+  if (previous != NULL && previous != queue) _dispatch_queue(previous, 0);
+  return true;
+}
+
+static void _queue_change(BasicTagChangeQueue* queue, FunctionalBasicTag* tag) {
+  if (queue->policy == BASIC_TAG_QUEUE_COALESCE && _Q_LOAD(tag->_queued)) {
+    // Already waiting to be dispatched, onChange will see the latest value
+    queue->coalesced += 1;
+    return;
+  }
+
+  uint32_t head = queue->head;  // Only the producer moves the head
+  while (true) {
+    uint32_t tail = _Q_LOAD(queue->tail);
+    if (head - tail < queue->capacity) break;
+    if (queue->policy == BASIC_TAG_QUEUE_DROP_OLDEST) {
+      if (_Q_CAS(queue->tail, tail, tail + 1)) queue->dropped += 1;
+      continue;
+    }
+    if (queue->policy == BASIC_TAG_QUEUE_BLOCK) {
+      // Needs another task dispatching, otherwise this never returns
+      BASIC_TAG_YIELD();
+      continue;
+    }
+    queue->dropped += 1;  // Coalesce, a queue smaller than the number of tags can still fill up
+    return;
+  }
+
+  BasicTagChangeEvent* event = &(queue->events[head % queue->capacity]);
+  event->tag = tag;
+  event->timestamp = tag->currentValue.timestamp;
+  if (queue->policy == BASIC_TAG_QUEUE_COALESCE) _Q_STORE(tag->_queued, 1);
+  _Q_STORE(queue->head, head + 1);
+}
+
+static void _notify_change(FunctionalBasicTag* tag) {
+  // Called for every changed value, onChange now or later depending on the change queue
+  if (tag->onChange == NULL) return;
+  BasicTagChangeQueue* queue = _change_queue;
+  if (queue != NULL) _queue_change(queue, tag);
+  else _STATS_TIMED(tag, onchange, tag->onChange(tag));
+}
+
+static void _unqueue_tag(FunctionalBasicTag* tag) {
+  // Called when a tag is deleted, its pending events are skipped by dispatch
+  BasicTagChangeQueue* queue = _change_queue;
+  if (queue == NULL) return;
+  for (uint32_t pos = _Q_LOAD(queue->tail); pos != queue->head; pos++) {
+    BasicTagChangeEvent* event = &(queue->events[pos % queue->capacity]);
+    if (event->tag == tag) event->tag = NULL;
+  }
+}
+
+static bool _pop_change(BasicTagChangeQueue* queue, BasicTagChangeEvent* event) {
+  while (true) {
+    uint32_t tail = _Q_LOAD(queue->tail);
+    if (tail == _Q_LOAD(queue->head)) return false;
+    *event = queue->events[tail % queue->capacity];
+    // Fails if the producer dropped this event (and maybe reused its slot) or another consumer took it
+    if (!_Q_CAS(queue->tail, tail, tail + 1)) continue;
+    if (event->tag == NULL) continue;  // Tag was deleted
+    if (queue->policy == BASIC_TAG_QUEUE_COALESCE) _Q_STORE(event->tag->_queued, 0);
+    return true;
+  }
+}
+
+bool popBasicTagChange(BasicTagChangeEvent* event) {
+  // Takes the oldest event without calling onChange, returns false when the queue is empty
+  BasicTagChangeQueue* queue = _change_queue;
+  if (queue == NULL || event == NULL) return false;
+  return _pop_change(queue, event);
+}
+
+static size_t _dispatch_queue(BasicTagChangeQueue* queue, size_t max_events) {
+  size_t dispatched = 0;
+  BasicTagChangeEvent event;
+  uint32_t token = _rcu_read_begin();
+  while ((max_events == 0 || dispatched < max_events) && _pop_change(queue, &event)) {
+    if (event.tag->onChange != NULL) _STATS_TIMED(event.tag, onchange, event.tag->onChange(event.tag));
+    dispatched++;
+  }
+  _rcu_read_end(token);
+  return dispatched;
+}
+
+size_t dispatchBasicTagChanges(size_t max_events) {
+  // Calls onChange for up to max_events queued changes (0 for all of them), returns the number dispatched
+  BasicTagChangeQueue* queue = _change_queue;
+  if (queue == NULL) return 0;
+  return _dispatch_queue(queue, max_events);
+}
+
+
+/*
+Deadband and Report Interval (v1.4.0)
+Built in report by exception applied on top of the compare function, without an extra function call. The scan
+kernels run it only for values their typed comparison found changed, so deadband tags stay on the fast path.
+A value that is held back is still compared against the last reported value, so it is reported once it moves
+far enough or the interval has passed. NaN always counts as moved.
+*/
+
+static double _value_as_double(const Value* value, SparkplugDataType datatype) {
+  switch (datatype) {
+    case spInt8: return value->int8Value;
+    case spInt16: return value->int16Value;
+    case spInt32: return value->int32Value;
+    case spInt64: return (double)value->int64Value;
+    case spUInt8: return value->uint8Value;
+    case spUInt16: return value->uint16Value;
+    case spUInt32: return value->uint32Value;
+    case spDateTime:
+    case spUInt64: return (double)value->uint64Value;
+    case spFloat: return value->floatValue;
+    case spDouble: return value->doubleValue;
+    case spBoolean: return value->boolValue ? 1.0 : 0.0;
+    default: return 0.0;
+  }
+}
+
+static inline bool _report_filtered(FunctionalBasicTag* tag) {
+  return tag->deadband_mode != BASIC_TAG_DEADBAND_NONE || tag->min_report_interval != 0;
+}
+
+static bool _report_allowed(FunctionalBasicTag* tag, double new_value, double current_value, uint64_t now) {
+  // Only called for values that have changed, false holds the change back
+  if (tag->min_report_interval != 0 && now >= tag->currentValue.timestamp && now - tag->currentValue.timestamp < tag->min_report_interval) return false;
+  double diff = new_value - current_value;
+  if (diff < 0) diff = -diff;
+  switch (tag->deadband_mode) {
+    case BASIC_TAG_DEADBAND_ABSOLUTE:
+      return !(diff <= tag->deadband);  // Written this way so NaN is reported
+    case BASIC_TAG_DEADBAND_PERCENT: {
+      double reference = current_value < 0 ? -current_value : current_value;
+      return !(diff <= reference * tag->deadband / 100.0);
+    }
+    default:
+      return true;
+  }
+}
+
+bool setTagDeadband(FunctionalBasicTag* tag, BasicTagDeadbandMode mode, double deadband) {
+  // Numeric tags only, deadband is in the tag's units or a percentage of the last reported value
+  if (tag == NULL || _value_storage_size(tag->datatype, tag->buffer_value_max_len) > 0) return false;
+  if (mode != BASIC_TAG_DEADBAND_NONE && mode != BASIC_TAG_DEADBAND_ABSOLUTE && mode != BASIC_TAG_DEADBAND_PERCENT) return false;
+  if (deadband < 0) return false;
+  tag->deadband_mode = (uint8_t)mode;
+  tag->deadband = deadband;
+  return true;
+}
+
+bool setTagMinReportInterval(FunctionalBasicTag* tag, uint32_t min_report_interval) {
+  // Milliseconds, a change is held back until this long after the last reported change. Numeric tags only
+  if (tag == NULL || _value_storage_size(tag->datatype, tag->buffer_value_max_len) > 0) return false;
+  tag->min_report_interval = min_report_interval;
+  return true;
+}
+
+
+/*
+String Reads (v1.4.0)
+String tags using DefaultCompareFn are read in one pass: the source is compared against the current value until
+the first difference, and only the rest is copied, which also gives its length. The length of the current value
+is cached, so copying it to previousValue is a memcpy. Before v1.4.0 every read did a strlen, a strcmp and, when
+changed, another strlen. The compare is bounded by the max length, a source longer than that is compared on its
+first buffer_value_max_len characters, the part that is stored.
+With writer_notifies set, string and bytes tags are only compared after notifyBasicTagWrite has been called.
+*/
+
+#if defined(__GNUC__)
+#define _GEN_LOAD(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define _GEN_BUMP(var) __atomic_fetch_add(&(var), 1, __ATOMIC_RELEASE)
+#else
+#define _GEN_LOAD(var) (var)
+#define _GEN_BUMP(var) ((var)++)
+#endif
+
+bool setTagWriterNotifies(FunctionalBasicTag* tag, bool writer_notifies) {
+  if (tag == NULL) return false;
+  if (tag->datatype != spString && tag->datatype != spText && tag->datatype != spUUID && tag->datatype != spBytes) return false;
+  tag->writer_notifies = writer_notifies;
+  return true;
+}
+
+bool notifyBasicTagWrite(FunctionalBasicTag* tag) {
+  if (tag == NULL) return false;
+  _GEN_BUMP(tag->_write_gen);
+  return true;
+}
+
+static bool _writer_unchanged(FunctionalBasicTag* tag) {
+  // True when the tag is in writer notifies mode and nothing was written since its last read
+  if (!tag->writer_notifies || tag->currentValue.timestamp == 0) return false;
+  uint32_t generation = _GEN_LOAD(tag->_write_gen);
+  if (generation == tag->_read_gen) return true;
+  tag->_read_gen = generation;  // Taken before the value is read, a write during the read is picked up next time
+  return false;
+}
+
+static bool _read_string_tag(FunctionalBasicTag* tag, uint64_t timestamp) {
+  const char* source = (const char*)(tag->value_address);
+  size_t max_len = tag->datatype == spUUID ? 36 : tag->buffer_value_max_len;
+  bool first_read = tag->currentValue.timestamp == 0;
+  bool empty = max_len < 1 || source[0] == '\0';  // Empty strings are Null, same as before v1.4.0
+  char* current = tag->currentValue.value.stringValue;
+
+  size_t diff = 0;
+  if (!first_read) {
+    if (tag->currentValue.isNull || empty) {
+      if (tag->currentValue.isNull == empty) return false;
+    } else {
+      while (diff < max_len && source[diff] == current[diff] && source[diff] != '\0') diff++;
+      if (diff == max_len || source[diff] == current[diff]) return false;  // Equal up to the terminator or the max length
+    }
+  }
+
+  _seq_write_begin(tag);
+  if (tag->retain_previous) {
+    tag->previousValue.timestamp = tag->currentValue.timestamp;
+    tag->previousValue.isNull = tag->currentValue.isNull;
+    if (!tag->currentValue.isNull && max_len > 0) memcpy(tag->previousValue.value.stringValue, current, tag->_str_len + 1);
+  }
+  tag->currentValue.timestamp = timestamp;
+  tag->currentValue.isNull = empty;
+  if (empty) {
+    tag->_str_len = 0;
+  } else {
+    // The first diff characters are already there
+    if (tag->currentValue.isNull) diff = 0;
+    size_t i = diff;
+    while (i < max_len && source[i] != '\0') {
+      current[i] = source[i];
+      i++;
+    }
+    current[i] = '\0';
+    tag->_str_len = (uint32_t)i;
+  }
+  tag->changeMicros = _clock_now_us();
+  _seq_write_end(tag);
+  return true;
+}
+
+
+/*
+Zero Copy Bytes (v1.4.0)
+A zero copy bytes tag references a BasicTagBytesSource owned by the producer instead of copying the buffer into
+currentValue and previousValue on every change. The producer writes into the buffer returned by
+beginBasicTagBytesWrite and calls publishBasicTagBytes, which flips the active buffer and bumps the generation.
+A read only compares the generation, when it has moved the tag's currentValue points at the active buffer.
+With keep_previous previousValue points at the other buffer, it is valid until the producer's next
+beginBasicTagBytesWrite. Without it previousValue stays Null and a single buffer source is enough, one copy of
+the value in RAM instead of three.
+*/
+
+static size_t _bytes_source_size(BasicTagBytesSource* source) {
+  size_t size = source->buffers[0].allocated_length;
+  if (source->buffers[1].buffer != NULL && source->buffers[1].allocated_length < size) size = source->buffers[1].allocated_length;
+  return size;
+}
+
+bool initBasicTagBytesSource(BasicTagBytesSource* source, uint8_t* buffer_a, uint8_t* buffer_b, size_t buffer_size) {
+  if (source == NULL || buffer_a == NULL || buffer_size < 1) return false;
+  source->buffers[0].buffer = buffer_a;
+  source->buffers[0].written_length = 0;
+  source->buffers[0].allocated_length = buffer_size;
+  source->buffers[1].buffer = buffer_b;
+  source->buffers[1].written_length = 0;
+  source->buffers[1].allocated_length = buffer_b != NULL ? buffer_size : 0;
+  source->generation = 0;
+  source->active = 0;
+  return true;
+}
+
+BufferValue* beginBasicTagBytesWrite(BasicTagBytesSource* source) {
+  if (source == NULL) return NULL;
+  if (source->buffers[1].buffer == NULL) return &(source->buffers[0]);  // Single buffer, written in place
+  return &(source->buffers[source->active ^ 1]);
+}
+
+bool publishBasicTagBytes(BasicTagBytesSource* source) {
+  if (source == NULL) return false;
+  if (source->buffers[1].buffer != NULL) _Q_STORE(source->active, (uint8_t)(source->active ^ 1));
+  _GEN_BUMP(source->generation);  // Release, the buffer and active are visible before the new generation
+  return true;
+}
+
+FunctionalBasicTag* createZeroCopyBytesTag(const char* name, BasicTagBytesSource* source, int alias, bool local_writable, bool remote_writable, bool keep_previous) {
+  if (source == NULL || source->buffers[0].buffer == NULL) return NULL;
+  if (keep_previous && source->buffers[1].buffer == NULL) return NULL;  // The previous value needs the second buffer
+  return _create_tag(name, (void*)source, alias, spBytes, local_writable, remote_writable, 0, true, keep_previous);
+}
+
+static bool _read_zero_copy_tag(FunctionalBasicTag* tag, uint64_t timestamp) {
+  BasicTagBytesSource* source = (BasicTagBytesSource*)(tag->value_address);
+  uint32_t generation = _GEN_LOAD(source->generation);
+  if (tag->currentValue.timestamp != 0 && generation == tag->_read_gen) return false;
+  tag->_read_gen = generation;
+  BufferValue* active = &(source->buffers[_Q_LOAD(source->active) & 1]);
+
+  _seq_write_begin(tag);
+  if (tag->retain_previous) {
+    tag->previousValue.timestamp = tag->currentValue.timestamp;
+    tag->previousValue.isNull = tag->currentValue.timestamp == 0;
+    tag->previousValue.value.bytesValue = tag->currentValue.value.bytesValue;
+  }
+  tag->currentValue.timestamp = timestamp;
+  tag->currentValue.isNull = false;
+  tag->currentValue.value.bytesValue = active;
+  tag->changeMicros = _clock_now_us();
+  _seq_write_end(tag);
+  return true;
+}
+
+static bool _write_zero_copy_tag(FunctionalBasicTag* tag, BasicValue* newValue) {
+  // Remote / local writes go through the source like any other producer
+  BufferValue* target = beginBasicTagBytesWrite((BasicTagBytesSource*)(tag->value_address));
+  if (newValue->isNull || newValue->value.bytesValue == NULL || newValue->value.bytesValue->buffer == NULL || newValue->value.bytesValue->written_length < 1) {
+    target->written_length = 0;
+  } else {
+    _copy_buffer_value(newValue->value.bytesValue, target);
+  }
+  return publishBasicTagBytes((BasicTagBytesSource*)(tag->value_address));
+}
+
+
+/*
+Previous Value Retention (v1.4.0)
+Tags created while setBasicTagRetainPrevious(false) is in effect get no storage for previousValue, which halves
+the value storage of string and bytes tags, and reads skip copying the current value into it on every change.
+previousValue stays Null with a timestamp of 0. setTagRetainPrevious can stop maintaining it on any tag, and turn
+it back on for tags that have its storage (always the case for numeric and boolean tags).
+*/
+
+bool setBasicTagRetainPrevious(bool retain_previous) {
+  _retain_previous_default = retain_previous;
+  return true;
+}
+
+bool setTagRetainPrevious(FunctionalBasicTag* tag, bool retain_previous) {
+  if (tag == NULL) return false;
+  if (retain_previous == tag->retain_previous) return true;
+  if (retain_previous) {
+    bool has_storage = true;
+    if (tag->_zero_copy) has_storage = ((BasicTagBytesSource*)(tag->value_address))->buffers[1].buffer != NULL;
+    else if (tag->datatype == spBytes) has_storage = tag->previousValue.value.bytesValue != NULL;
+    else if (tag->datatype == spString || tag->datatype == spText || tag->datatype == spUUID) has_storage = tag->previousValue.value.stringValue != NULL || tag->buffer_value_max_len < 1;
+    if (!has_storage) return false;
+  }
+  _seq_write_begin(tag);
+  tag->retain_previous = retain_previous;
+  tag->previousValue.timestamp = 0;
+  tag->previousValue.isNull = true;
+  _seq_write_end(tag);
+  return true;
+}
+
+
+/*
+Compact Tags (v1.4.0)
+For boards with little RAM (32 KB on a SAMD21) a CompactBasicTag is 24 bytes on 32 bit targets against
+FunctionalBasicTag's 184 plus allocator overhead. Compact tags live in an array supplied with
+setCompactTagStorage, so there is no per-tag allocation or registry array either. They hold a numeric or
+boolean value inline, a 16 bit alias, the flags as bits and a 32 bit timestamp relative to an epoch kept by the
+library. There is no previousValue, compareFunc or scan plan. Callbacks are kept in a side table that only has
+entries for tags that use them. Aliases are unique across compact tags and FunctionalBasicTags, and compact
+tags are kept in the same name and alias hash index, so lookups and aliasValid stay O(1). readAllBasicTags reads
+them too and writeBasicTagsBatch resolves their aliases, so a device mixing both kinds keeps a single scan and
+write path. The index is not used with a static tag table, lookups scan the compact storage then.
+The relative timestamps cover about 49 days; when that runs out the epoch is moved forward and the timestamps of
+tags that haven't changed in the last 24 days saturate at the epoch.
+Sparkplug births include them and encodeSparkplugCompactData publishes their changes, snapshots save and
+restore them. They have no registry index, so the changed index and bitmap scans, readDueBasicTags,
+subscriptions, the change queue, history and series don't cover them: use the onChange callback or the
+BASIC_TAG_COMPACT_VALUE_CHANGED flag left by the last read.
+A deleted tag's slot keeps its name, alias and value with the datatype set to _COMPACT_RETIRED until no reader can
+still be using it (thread safe builds), only then is it cleared for reuse.
+*/
+
+typedef struct {
+  CompactBasicTag* tag;
+  CompactTagFunction onChange;
+  ValidateWriteFunction validateWrite;
+} _CompactCallbacks;
+
+static int _compact_max_alias = 0;  // Included by _next_alias so new FunctionalBasicTags don't collide
+static uint64_t _compact_epoch = 0;
+static bool _compact_epoch_set = false;
+static _CompactCallbacks* _compact_callbacks = NULL;
+static size_t _compact_callbacks_count = 0;
+static size_t _compact_callbacks_capacity = 0;
+
+#define _COMPACT_MAX_RELATIVE 0xFFFFFFF0UL
+#define _COMPACT_REBASE_KEEP 0x80000000UL  // How far back the timestamps stay exact after the epoch is moved
+#define _COMPACT_RETIRED 0xFF  // datatype of a deleted tag's slot while readers may still hold it
+
+static size_t _compact_retired_count = 0;  // Slots waiting for a grace period
+
+static bool _compact_live(CompactBasicTag* tag) {
+  uint8_t datatype = _TS_LOAD(tag->datatype);
+  return datatype != 0 && datatype != _COMPACT_RETIRED;
+}
+
+static void _compact_free_slot(CompactBasicTag* tag) {
+  // Writer lock held, no reader can be using the tag any more
+  memset(tag, 0, sizeof(CompactBasicTag));  // datatype 0 marks the slot free
+  _compact_retired_count--;
+}
+
+bool setCompactTagStorage(CompactBasicTag* storage, size_t capacity) {
+  if (storage == NULL || capacity == 0 || _compact_count > 0) return false;  // Can't be changed while there are compact tags
+  _writer_lock();
+  _rcu_reclaim();
+  if (_compact_retired_count > 0) {
+    _writer_unlock();
+    return false;  // A reader still holds a deleted tag in the old storage
+  }
+  memset(storage, 0, capacity * sizeof(CompactBasicTag));
+  _compact_tags = storage;
+  _compact_capacity = capacity;
+  _writer_unlock();
+  return true;
+}
+
+static bool _compact_datatype_valid(SparkplugDataType datatype) {
+  switch (datatype) {
+    case spInt8:
+    case spInt16:
+    case spInt32:
+    case spInt64:
+    case spUInt8:
+    case spUInt16:
+    case spUInt32:
+    case spUInt64:
+    case spFloat:
+    case spDouble:
+    case spBoolean:
+    case spDateTime:
+      return true;
+    default:
+      return false;  // Strings and bytes need value storage, they stay FunctionalBasicTags
+  }
+}
+
+static CompactBasicTag* _compact_scan(const char* name, int alias) {
+  // Only used when there is no index (static tag table), name NULL matches by alias
+  for (size_t i = 0; i < _compact_capacity; i++) {
+    CompactBasicTag* tag = &(_compact_tags[i]);
+    if (!_compact_live(tag)) continue;
+    if (name == NULL ? tag->alias == alias : (tag->name != NULL && strcmp(tag->name, name) == 0)) return tag;
+  }
+  return NULL;
+}
+
+static uint32_t _compact_relative(uint64_t timestamp) {
+  // Milliseconds since the epoch, 0 is reserved for timestamps before it
+  if (!_compact_epoch_set) {
+    _compact_epoch = timestamp > 0 ? timestamp - 1 : 0;
+    _compact_epoch_set = true;
+  }
+  if (timestamp <= _compact_epoch) return 0;
+  uint64_t relative = timestamp - _compact_epoch;
+  if (relative > _COMPACT_MAX_RELATIVE) {
+    // Move the epoch forward, everything older than _COMPACT_REBASE_KEEP saturates at 0
+    uint64_t shift = relative - _COMPACT_REBASE_KEEP;
+    _compact_epoch += shift;
+    for (size_t i = 0; i < _compact_capacity; i++) {
+      CompactBasicTag* tag = &(_compact_tags[i]);
+      tag->timestamp = tag->timestamp > shift ? (uint32_t)(tag->timestamp - shift) : 0;
+    }
+    relative = _COMPACT_REBASE_KEEP;
+  }
+  return (uint32_t)relative;
+}
+
+static CompactBasicTag* _compact_create(const char* name, void* value_address, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable) {
+  // Writer lock held
+  if (!_compact_datatype_valid(datatype)) return NULL;
+  CompactBasicTag* tag = NULL;
+  for (size_t i = 0; i < _compact_capacity; i++) {
+    if (_compact_tags[i].datatype == 0) {
+      tag = &(_compact_tags[i]);
+      break;
+    }
+  }
+  if (tag == NULL) return NULL;  // No storage set or it is full
+  if (alias < INT16_MIN || alias > INT16_MAX || !aliasValid(alias)) alias = _next_alias();
+  if (alias > INT16_MAX || !_grow_index(_tags_count + 1)) return NULL;  // _grow_index adds _compact_count, the + 1 is this tag
+  tag->name = name;
+  tag->value_address = value_address;
+  tag->value.uint64Value = 0;
+  tag->timestamp = 0;
+  tag->alias = (int16_t)alias;
+  tag->flags = BASIC_TAG_COMPACT_IS_NULL;
+  if (local_writable) tag->flags |= BASIC_TAG_COMPACT_LOCAL_WRITABLE;
+  if (remote_writable) tag->flags |= BASIC_TAG_COMPACT_REMOTE_WRITABLE;
+  _TS_STORE(tag->datatype, (uint8_t)datatype);
+  if (alias > _compact_max_alias) _compact_max_alias = alias;
+  _compact_count++;
+  _registry_write_begin();
+  _index_add_compact(tag);
+  _registry_write_end();
+  return tag;
+}
+
+CompactBasicTag* createCompactTag(const char* name, void* value_address, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable) {
+  _writer_lock();
+  CompactBasicTag* tag = _compact_create(name, value_address, alias, datatype, local_writable, remote_writable);
+  _writer_unlock();
+  return tag;
+}
+
+static _CompactCallbacks* _compact_callbacks_for(CompactBasicTag* tag, bool add) {
+  if (tag->flags & BASIC_TAG_COMPACT_HAS_CALLBACKS) {
+    for (size_t i = 0; i < _compact_callbacks_count; i++) {
+      if (_compact_callbacks[i].tag == tag) return &(_compact_callbacks[i]);
+    }
+  }
+  if (!add) return NULL;
+  if (_compact_callbacks_count == _compact_callbacks_capacity) {
+    size_t new_capacity = _compact_callbacks_capacity > 0 ? _compact_callbacks_capacity * 2 : 4;
+    _CompactCallbacks* grown = realloc(_compact_callbacks, new_capacity * sizeof(_CompactCallbacks));
+    if (grown == NULL) return NULL;
+    _compact_callbacks = grown;
+    _compact_callbacks_capacity = new_capacity;
+  }
+  _CompactCallbacks* entry = &(_compact_callbacks[_compact_callbacks_count++]);
+  entry->tag = tag;
+  entry->onChange = NULL;
+  entry->validateWrite = NULL;
+  tag->flags |= BASIC_TAG_COMPACT_HAS_CALLBACKS;
+  return entry;
+}
+
+bool deleteCompactTag(CompactBasicTag* tag) {
+  if (tag == NULL) return false;
+  _writer_lock();
+  if (!_compact_live(tag)) {
+    _writer_unlock();
+    return false;
+  }
+  _CompactCallbacks* entry = _compact_callbacks_for(tag, false);
+  if (entry != NULL) *entry = _compact_callbacks[--_compact_callbacks_count];  // Swap-remove
+  _registry_write_begin();
+  _index_remove_compact(tag);
+  _registry_write_end();
+  if (tag->alias == _compact_max_alias) {
+    _compact_max_alias = 0;
+    for (size_t i = 0; i < _compact_capacity; i++) {
+      if (&(_compact_tags[i]) != tag && _compact_live(&(_compact_tags[i])) && _compact_tags[i].alias > _compact_max_alias) _compact_max_alias = _compact_tags[i].alias;
+    }
+  }
+  // Readers that looked the tag up before it left the index keep a slot that reads as deleted, it isn't reused yet
+  _TS_STORE(tag->datatype, (uint8_t)_COMPACT_RETIRED);
+  _compact_count--;
+  _compact_retired_count++;
+#ifdef BASIC_TAG_THREAD_SAFE
+  _retire(tag, _RETIRED_COMPACT);
+  _rcu_reclaim();
+#else
+  _compact_free_slot(tag);
+#endif
+  _writer_unlock();
+  return true;
+}
+
+bool addCompactOnChangeCallback(CompactBasicTag* tag, CompactTagFunction callbackFn) {
+  if (callbackFn == NULL || tag == NULL) return false;
+  _CompactCallbacks* entry = _compact_callbacks_for(tag, true);
+  if (entry == NULL) return false;
+  entry->onChange = callbackFn;
+  return true;
+}
+
+bool addCompactValidateWriteCallback(CompactBasicTag* tag, ValidateWriteFunction callbackFn) {
+  if (callbackFn == NULL || tag == NULL) return false;
+  _CompactCallbacks* entry = _compact_callbacks_for(tag, true);
+  if (entry == NULL) return false;
+  entry->validateWrite = callbackFn;
+  return true;
+}
+
+static bool _compact_load(CompactBasicTag* tag, Value* value) {
+  // Reads the value at value_address, returns true if it differs from the stored value
+  switch (tag->datatype) {
+    case spInt8:
+      value->int8Value = *(int8_t*)(tag->value_address);
+      return value->int8Value != tag->value.int8Value;
+    case spInt16:
+      value->int16Value = *(int16_t*)(tag->value_address);
+      return value->int16Value != tag->value.int16Value;
+    case spInt32:
+      value->int32Value = *(int32_t*)(tag->value_address);
+      return value->int32Value != tag->value.int32Value;
+    case spInt64:
+      value->int64Value = *(int64_t*)(tag->value_address);
+      return value->int64Value != tag->value.int64Value;
+    case spUInt8:
+      value->uint8Value = *(uint8_t*)(tag->value_address);
+      return value->uint8Value != tag->value.uint8Value;
+    case spUInt16:
+      value->uint16Value = *(uint16_t*)(tag->value_address);
+      return value->uint16Value != tag->value.uint16Value;
+    case spUInt32:
+      value->uint32Value = *(uint32_t*)(tag->value_address);
+      return value->uint32Value != tag->value.uint32Value;
+    case spDateTime:
+    case spUInt64:
+      value->uint64Value = *(uint64_t*)(tag->value_address);
+      return value->uint64Value != tag->value.uint64Value;
+    case spFloat:
+      value->floatValue = *(float*)(tag->value_address);
+      return value->floatValue != tag->value.floatValue;
+    case spDouble:
+      value->doubleValue = *(double*)(tag->value_address);
+      return value->doubleValue != tag->value.doubleValue;
+    case spBoolean:
+      value->boolValue = *(bool*)(tag->value_address);
+      return value->boolValue != tag->value.boolValue;
+    default:
+      return false;
+  }
+}
+
+bool readCompactTag(CompactBasicTag* tag, uint64_t timestamp) {
+  if (tag == NULL || !_compact_live(tag)) return false;
+  tag->flags &= ~BASIC_TAG_COMPACT_VALUE_CHANGED;
+  if (tag->value_address == NULL) return false;
+
+  Value newValue = {0};
+  bool changed = _compact_load(tag, &newValue);
+  if (tag->flags & BASIC_TAG_COMPACT_IS_NULL) changed = true;  // First read
+  if (!changed) return false;
+
+  tag->value = newValue;
+  tag->timestamp = _compact_relative(timestamp);
+  tag->flags = (uint8_t)((tag->flags & ~BASIC_TAG_COMPACT_IS_NULL) | BASIC_TAG_COMPACT_VALUE_CHANGED);
+  if (tag->flags & BASIC_TAG_COMPACT_HAS_CALLBACKS) {
+    _CompactCallbacks* entry = _compact_callbacks_for(tag, false);
+    if (entry != NULL && entry->onChange != NULL) _STATS_TIMED_UNTRACKED(onchange, entry->onChange(tag));
+  }
+  return true;
+}
+
+bool readAllCompactTags() {
+  bool changed = false;
+  uint32_t token = _rcu_read_begin();
+  _clock_sample(_clock_mode != BASIC_TAG_CLOCK_PER_TAG);
+  for (size_t i = 0; i < _compact_capacity; i++) {
+    if (_compact_live(&(_compact_tags[i])) && readCompactTag(&(_compact_tags[i]), _clock_now_ms())) changed = true;
+  }
+  _clock_sample(false);
+  _rcu_read_end(token);
+  return changed;
+}
+
+static bool _compact_write_allowed(CompactBasicTag* tag, BasicValue* newValue, uint8_t writable_flags) {
+  if (tag == NULL || newValue == NULL || tag->value_address == NULL) return false;
+  if (!(tag->flags & writable_flags)) return false;
+  if (tag->flags & BASIC_TAG_COMPACT_HAS_CALLBACKS) {
+    _CompactCallbacks* entry = _compact_callbacks_for(tag, false);
+    if (entry != NULL && entry->validateWrite != NULL && !(entry->validateWrite(newValue))) {
+      _STATS_WRITE_REJECTED();
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool _compact_store(CompactBasicTag* tag, BasicValue* newValue) {
+  switch (tag->datatype) {
+    case spInt8: *(int8_t*)(tag->value_address) = newValue->value.int8Value; break;
+    case spInt16: *(int16_t*)(tag->value_address) = newValue->value.int16Value; break;
+    case spInt32: *(int32_t*)(tag->value_address) = newValue->value.int32Value; break;
+    case spInt64: *(int64_t*)(tag->value_address) = newValue->value.int64Value; break;
+    case spUInt8: *(uint8_t*)(tag->value_address) = newValue->value.uint8Value; break;
+    case spUInt16: *(uint16_t*)(tag->value_address) = newValue->value.uint16Value; break;
+    case spUInt32: *(uint32_t*)(tag->value_address) = newValue->value.uint32Value; break;
+    case spDateTime:
+    case spUInt64: *(uint64_t*)(tag->value_address) = newValue->value.uint64Value; break;
+    case spFloat: *(float*)(tag->value_address) = newValue->value.floatValue; break;
+    case spDouble: *(double*)(tag->value_address) = newValue->value.doubleValue; break;
+    case spBoolean: *(bool*)(tag->value_address) = newValue->value.boolValue; break;
+    default: return false;
+  }
+  return true;
+}
+
+bool writeCompactTag(CompactBasicTag* tag, BasicValue* newValue) {
+  // Same rules as writeBasicTag, the value must match the tag's datatype
+  if (!_compact_write_allowed(tag, newValue, BASIC_TAG_COMPACT_LOCAL_WRITABLE | BASIC_TAG_COMPACT_REMOTE_WRITABLE)) return false;
+  return _compact_store(tag, newValue);
+}
+
+bool getCompactTagValue(CompactBasicTag* tag, BasicValue* value) {
+  // Expands the compact value into a BasicValue, with the absolute timestamp
+  if (tag == NULL || value == NULL || !_compact_live(tag)) return false;
+  value->timestamp = getCompactTagTimestamp(tag);
+  value->datatype = (SparkplugDataType)tag->datatype;
+  value->value = tag->value;
+  value->isNull = (tag->flags & BASIC_TAG_COMPACT_IS_NULL) != 0;
+  return true;
+}
+
+uint64_t getCompactTagTimestamp(CompactBasicTag* tag) {
+  if (tag == NULL || (tag->flags & BASIC_TAG_COMPACT_IS_NULL)) return 0;
+  return _compact_epoch + tag->timestamp;
+}
+
+static void* _index_lookup(bool by_name, uint32_t hash, const char* name, bool compact);  // See getTagByName
+
+CompactBasicTag* getCompactTagByName(const char* name) {
+  if (name == NULL || _compact_count == 0) return NULL;
+  if (_TS_LOAD(_index_capacity) == 0) return _compact_scan(name, 0);
+  return (CompactBasicTag*)_index_lookup(true, _hash_name(name), name, true);
+}
+
+CompactBasicTag* getCompactTagByAlias(int alias) {
+  if (_compact_count == 0) return NULL;
+  if (_TS_LOAD(_index_capacity) == 0) return _compact_scan(NULL, alias);
+  void* entry = _index_lookup(false, _hash_alias(alias), NULL, true);
+  return entry != NULL && _index_is_compact(entry) ? (CompactBasicTag*)entry : NULL;
+}
+
+size_t getCompactTagsCount() {
+  return _compact_count;
+}
+
+size_t getCompactTagsCapacity() {
+  return _TS_LOAD(_compact_capacity);
+}
+
+CompactBasicTag* getCompactTagBySlot(size_t slot) {
+  // Slots are fixed, a tag keeps its slot until it is deleted. NULL for a free slot
+  if (slot >= _TS_LOAD(_compact_capacity) || !_compact_live(&(_compact_tags[slot]))) return NULL;
+  return &(_compact_tags[slot]);
+}
+
+void iterCompactTags(CompactTagFunction tagFn) {
+  for (size_t i = 0; i < _compact_capacity; i++) {
+    if (_compact_live(&(_compact_tags[i]))) tagFn(&(_compact_tags[i]));
+  }
+}
+
+
+/*
+Remote Writes (v1.4.0)
+writeBasicTag accepts a tag with either writable flag set, it is up to the caller to know where the write came
+from. writeBasicTagRemote and writeBasicTagsBatch are for writes from the network (eg. DCMD): the tag must be
+remote_writable and the value's datatype must match the tag. The batch resolves each alias through the alias
+index, which also holds the compact tags, so a batch can mix both kinds. With BASIC_TAG_WRITE_ATOMIC every entry is checked (including validateWrite) before anything is written,
+and nothing is written if any entry fails. With BASIC_TAG_WRITE_REREAD the written tags are read straight away,
+so onChange fires without waiting for the next scan.
+*/
+
+static bool _write_value(FunctionalBasicTag* tag, BasicValue* newValue);  // See writeBasicTag
+
+static bool _remote_write_allowed(FunctionalBasicTag* tag, BasicValue* newValue) {
+  if (tag == NULL || newValue == NULL || tag->value_address == NULL || !tag->remote_writable) return false;
+  if (newValue->datatype != tag->datatype) return false;
+  if (tag->validateWrite == NULL || tag->validateWrite(newValue)) return true;
+  _STATS_WRITE_REJECTED();
+  return false;
+}
+
+bool writeBasicTagRemote(FunctionalBasicTag* tag, BasicValue* newValue) {
+  if (!_remote_write_allowed(tag, newValue)) return false;
+  return _write_value(tag, newValue);
+}
+
+static void* _alias_entry(int alias) {
+  // The FunctionalBasicTag or CompactBasicTag with an alias, a single index lookup when the index is allocated
+  if (_TS_LOAD(_index_capacity) == 0) {
+    FunctionalBasicTag* tag = getTagByAlias(alias);
+    return tag != NULL ? (void*)tag : (void*)getCompactTagByAlias(alias);
+  }
+  return _index_lookup(false, _hash_alias(alias), NULL, false);
+}
+
+static bool _entry_remote_allowed(void* entry, BasicValue* newValue) {
+  if (entry == NULL || !_index_is_compact(entry)) return _remote_write_allowed((FunctionalBasicTag*)entry, newValue);
+  CompactBasicTag* tag = (CompactBasicTag*)entry;
+  if (newValue == NULL || newValue->datatype != (SparkplugDataType)tag->datatype) return false;
+  return _compact_write_allowed(tag, newValue, BASIC_TAG_COMPACT_REMOTE_WRITABLE);
+}
+
+static bool _entry_write(void* entry, BasicValue* newValue) {
+  if (_index_is_compact(entry)) return _compact_store((CompactBasicTag*)entry, newValue);
+  return _write_value((FunctionalBasicTag*)entry, newValue);
+}
+
+#define _BATCH_LOCAL_WORDS 8  // Entries tracked on the stack for a reread without results, bigger batches allocate
+
+static void _batch_set_result(bool* results, uint32_t* accepted, size_t i, bool ok) {
+  if (results != NULL) results[i] = ok;
+  if (accepted == NULL) return;
+  if (ok) accepted[i / 32] |= (uint32_t)1 << (i % 32);
+  else accepted[i / 32] &= ~((uint32_t)1 << (i % 32));
+}
+
+static bool _batch_accepted(const bool* results, const uint32_t* accepted, size_t i) {
+  if (results != NULL) return results[i];
+  return (accepted[i / 32] >> (i % 32)) & 1;
+}
+
+size_t writeBasicTagsBatch(const int* aliases, BasicValue* values, size_t n, bool* results, uint8_t options) {
+  // Returns the number of values written, results (optional) receives the outcome of each entry
+  if (aliases == NULL || values == NULL) return 0;
+  // The reread needs the outcome of each entry, kept in a bitmap when the caller doesn't pass results
+  uint32_t local_accepted[_BATCH_LOCAL_WORDS];
+  uint32_t* accepted = NULL;
+  if ((options & BASIC_TAG_WRITE_REREAD) && results == NULL) {
+    size_t words = (n + 31) / 32;
+    accepted = words <= _BATCH_LOCAL_WORDS ? local_accepted : (uint32_t*)malloc(words * sizeof(uint32_t));
+    if (accepted == NULL) return 0;  // Nothing is written if the outcomes can't be tracked
+  }
+  uint32_t token = beginBasicTagRead();
+  size_t written = 0;
+
+  if (options & BASIC_TAG_WRITE_ATOMIC) {
+    bool all_allowed = true;
+    for (size_t i = 0; i < n; i++) {
+      bool allowed = _entry_remote_allowed(_alias_entry(aliases[i]), &(values[i]));
+      _batch_set_result(results, accepted, i, allowed);
+      all_allowed = all_allowed && allowed;
+    }
+    if (all_allowed) {
+      for (size_t i = 0; i < n; i++) {
+        if (_entry_write(_alias_entry(aliases[i]), &(values[i]))) written++;
+        else _batch_set_result(results, accepted, i, false);
+      }
+    }
+    // Otherwise nothing is written, the entries that failed are the ones left false
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      void* entry = _alias_entry(aliases[i]);
+      bool ok = _entry_remote_allowed(entry, &(values[i])) && _entry_write(entry, &(values[i]));
+      _batch_set_result(results, accepted, i, ok);
+      if (ok) written++;
+    }
+  }
+
+  if ((options & BASIC_TAG_WRITE_REREAD) && written > 0) {
+    _clock_sample(_clock_mode != BASIC_TAG_CLOCK_PER_TAG);
+    for (size_t i = 0; i < n; i++) {
+      if (!_batch_accepted(results, accepted, i)) continue;  // Only the entries that were written
+      void* entry = _alias_entry(aliases[i]);
+      if (entry == NULL) continue;
+      if (_index_is_compact(entry)) readCompactTag((CompactBasicTag*)entry, _clock_now_ms());
+      else readBasicTag((FunctionalBasicTag*)entry, _clock_now_ms());
+    }
+    _clock_sample(false);
+  }
+  endBasicTagRead(token);
+  if (accepted != local_accepted) free(accepted);
+  return written;
+}
+
+
+/*
+Tag History (v1.4.0)
+A tag with a BasicTagHistory attached appends every change to a ring of records in storage supplied by the
+caller, for store-and-forward while the uplink is down and for local trending. No allocation per sample.
+Each record is a 32 bit timestamp delta from the record before it followed by the value: the raw bytes of the
+value for numeric types (1 to 8 bytes, no union padding), a 16 bit length and the content for strings and bytes.
+Records are written byte by byte around the end of the ring, so it works as a slab for variable length values
+and none of the space is lost to wrapping. When the ring is full the oldest records are dropped.
+The history is appended to by the task reading the tag, drain it from the same task.
+*/
+
+#define _HISTORY_HEADER 4  // Timestamp delta
+#define _HISTORY_MAX_LEN 0xFFFF
+
+static size_t _history_value_size(SparkplugDataType datatype) {
+  switch (datatype) {
+    case spInt8:
+    case spUInt8:
+    case spBoolean:
+      return 1;
+    case spInt16:
+    case spUInt16:
+      return 2;
+    case spInt32:
+    case spUInt32:
+    case spFloat:
+      return 4;
+    case spInt64:
+    case spUInt64:
+    case spDouble:
+    case spDateTime:
+      return 8;
+    default:
+      return 0;  // Strings and bytes are length prefixed
+  }
+}
+
+static bool _history_variable(SparkplugDataType datatype) {
+  return datatype == spString || datatype == spText || datatype == spUUID || datatype == spBytes;
+}
+
+static uint32_t _history_wrap(BasicTagHistory* history, uint64_t offset) {
+  return (uint32_t)(offset % history->size);
+}
+
+static void _history_put(BasicTagHistory* history, uint32_t offset, const void* data, size_t size) {
+  // Copies into the ring at offset, wrapping at the end
+  size_t first = history->size - offset;
+  if (first > size) first = size;
+  memcpy(history->buffer + offset, data, first);
+  if (size > first) memcpy(history->buffer, (const uint8_t*)data + first, size - first);
+}
+
+static void _history_get(BasicTagHistory* history, uint32_t offset, void* data, size_t size) {
+  size_t first = history->size - offset;
+  if (first > size) first = size;
+  memcpy(data, history->buffer + offset, first);
+  if (size > first) memcpy((uint8_t*)data + first, history->buffer, size - first);
+}
+
+static size_t _history_record_size(BasicTagHistory* history, uint32_t offset, SparkplugDataType datatype) {
+  if (!_history_variable(datatype)) return _HISTORY_HEADER + _history_value_size(datatype);
+  uint16_t length;
+  _history_get(history, _history_wrap(history, (uint64_t)offset + _HISTORY_HEADER), &length, sizeof(length));
+  return _HISTORY_HEADER + sizeof(length) + length;
+}
+
+static void _history_drop_oldest(BasicTagHistory* history, SparkplugDataType datatype) {
+  size_t size = _history_record_size(history, history->head, datatype);
+  history->head = _history_wrap(history, (uint64_t)history->head + size);
+  history->used -= (uint32_t)size;
+  history->count--;
+  if (history->count > 0) {
+    // The new oldest record's delta was from the dropped one
+    uint32_t delta;
+    _history_get(history, history->head, &delta, sizeof(delta));
+    history->first_timestamp += delta;
+  }
+}
+
+bool attachTagHistory(FunctionalBasicTag* tag, BasicTagHistory* history, void* storage, size_t storage_size) {
+  // NULL history detaches
+  if (tag == NULL) return false;
+  if (history == NULL) {
+    tag->history = NULL;
+    return true;
+  }
+  if (storage == NULL || storage_size < _HISTORY_HEADER + 8 || storage_size > UINT32_MAX) return false;
+  history->buffer = (uint8_t*)storage;
+  history->size = (uint32_t)storage_size;
+  history->head = 0;
+  history->used = 0;
+  history->count = 0;
+  history->dropped = 0;
+  history->first_timestamp = 0;
+  history->last_timestamp = 0;
+  tag->history = history;
+  return true;
+}
+
+static void _history_append(FunctionalBasicTag* tag) {
+  BasicTagHistory* history = tag->history;
+  BasicValue* value = &(tag->currentValue);
+  bool variable = _history_variable(tag->datatype);
+  const void* content = &(value->value);
+  size_t content_size = _history_value_size(tag->datatype);
+  uint16_t length = 0;
+  if (variable) {
+    if (!value->isNull && tag->datatype == spBytes) {
+      content = value->value.bytesValue->buffer;
+      length = (uint16_t)(value->value.bytesValue->written_length > _HISTORY_MAX_LEN ? _HISTORY_MAX_LEN : value->value.bytesValue->written_length);
+    } else if (!value->isNull) {
+      content = value->value.stringValue;
+      size_t string_length = strlen(value->value.stringValue);
+      length = (uint16_t)(string_length > _HISTORY_MAX_LEN ? _HISTORY_MAX_LEN : string_length);
+    }
+    content_size = length;
+  } else if (value->isNull) {
+    return;  // Only when value_address is NULL, nothing to record
+  }
+
+  size_t record_size = _HISTORY_HEADER + (variable ? sizeof(length) : 0) + content_size;
+  if (record_size > history->size) {
+    history->dropped++;
+    return;
+  }
+  while (history->size - history->used < record_size) {
+    _history_drop_oldest(history, tag->datatype);
+    history->dropped++;
+  }
+
+  uint64_t elapsed = history->count > 0 && value->timestamp > history->last_timestamp ? value->timestamp - history->last_timestamp : 0;
+  uint32_t delta = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;  // Saturates after 49 days without a change
+  uint32_t offset = _history_wrap(history, (uint64_t)history->head + history->used);
+  _history_put(history, offset, &delta, sizeof(delta));
+  offset = _history_wrap(history, (uint64_t)offset + sizeof(delta));
+  if (variable) {
+    _history_put(history, offset, &length, sizeof(length));
+    offset = _history_wrap(history, (uint64_t)offset + sizeof(length));
+  }
+  if (content_size > 0) _history_put(history, offset, content, content_size);
+
+  if (history->count == 0) history->first_timestamp = value->timestamp;
+  history->last_timestamp = history->count == 0 ? value->timestamp : history->last_timestamp + delta;
+  history->used += (uint32_t)record_size;
+  history->count++;
+}
+
+static size_t _history_copy(FunctionalBasicTag* tag, BasicValue* values, size_t max_values, void* storage, size_t storage_size, bool remove) {
+  /*
+  Copies records, oldest first, into values. String and bytes content goes in storage: strings are null terminated,
+  bytes values are a BufferValue followed by the content. Stops when values or storage are full.
+  */
+  if (tag == NULL || tag->history == NULL || values == NULL) return 0;
+  BasicTagHistory* history = tag->history;
+  uint8_t* out = (uint8_t*)storage;
+  size_t out_used = 0;
+  uint32_t offset = history->head;
+  uint64_t timestamp = history->first_timestamp;
+  size_t copied = 0;
+
+  while (copied < max_values && copied < history->count) {
+    BasicValue* value = &(values[copied]);
+    uint32_t delta;
+    _history_get(history, offset, &delta, sizeof(delta));
+    if (copied > 0) timestamp += delta;
+    uint32_t content_offset = _history_wrap(history, (uint64_t)offset + _HISTORY_HEADER);
+    value->timestamp = timestamp;
+    value->datatype = tag->datatype;
+    value->isNull = false;
+
+    if (_history_variable(tag->datatype)) {
+      uint16_t length;
+      _history_get(history, content_offset, &length, sizeof(length));
+      content_offset = _history_wrap(history, (uint64_t)content_offset + sizeof(length));
+      if (tag->datatype == spBytes) {
+        size_t start = _BT_ALIGN_UP(out_used);
+        size_t needed = _BT_ALIGN_UP(sizeof(BufferValue)) + length;
+        if (out == NULL || start + needed > storage_size) break;
+        BufferValue* bytes = (BufferValue*)(out + start);
+        bytes->buffer = out + start + _BT_ALIGN_UP(sizeof(BufferValue));
+        bytes->written_length = length;
+        bytes->allocated_length = length;
+        _history_get(history, content_offset, bytes->buffer, length);
+        value->value.bytesValue = bytes;
+        out_used = start + needed;
+      } else if (length == 0) {
+        value->value.stringValue = NULL;  // Empty strings are Null
+        value->isNull = true;
+      } else {
+        if (out == NULL || out_used + length + 1 > storage_size) break;
+        char* string = (char*)(out + out_used);
+        _history_get(history, content_offset, string, length);
+        string[length] = '\0';
+        value->value.stringValue = string;
+        out_used += length + 1;
+      }
+    } else {
+      value->value.uint64Value = 0;
+      _history_get(history, content_offset, &(value->value), _history_value_size(tag->datatype));
+    }
+    offset = _history_wrap(history, (uint64_t)offset + _history_record_size(history, offset, tag->datatype));
+    copied++;
+  }
+
+  if (remove) {
+    for (size_t i = 0; i < copied; i++) _history_drop_oldest(history, tag->datatype);
+  }
+  return copied;
+}
+
+size_t drainTagHistory(FunctionalBasicTag* tag, BasicValue* values, size_t max_values, void* storage, size_t storage_size) {
+  return _history_copy(tag, values, max_values, storage, storage_size, true);
+}
+
+size_t peekTagHistory(FunctionalBasicTag* tag, BasicValue* values, size_t max_values, void* storage, size_t storage_size) {
+  return _history_copy(tag, values, max_values, storage, storage_size, false);
+}
+
+size_t getTagHistoryCount(FunctionalBasicTag* tag) {
+  if (tag == NULL || tag->history == NULL) return 0;
+  return tag->history->count;
+}
+
+
+/*
+Compressed Series (v1.4.0)
+Gorilla style compression of numeric tag history, encoded incrementally on every change into fixed size blocks
+of caller supplied storage (eg. PSRAM). Each block starts with the absolute timestamp and raw value of its first
+sample, the following samples are bit packed:
+- timestamps as delta-of-delta: '0' for the same interval, '10' + 7 bits, '110' + 9 bits, '1110' + 12 bits or
+  '1111' + 32 bits
+- values XOR'd with the previous value (the raw bits, left aligned to 64 so every width uses the same code):
+  '0' for the same value, '10' + the meaningful bits when they fit in the previous leading / trailing zeros,
+  '11' + 5 bits leading zeros + 6 bits length + the meaningful bits otherwise
+A slowly moving float costs 1 + ~15 bits a sample instead of 32 bytes. When all blocks are full the oldest block
+is reused.
+*/
+
+#define _SERIES_HEADER_SIZE 24  // First timestamp, first value, sample count and bits used
+
+typedef struct {
+  uint64_t first_timestamp;
+  uint64_t first_value;
+  uint32_t count;
+  uint32_t bits;
+} _SeriesBlockHeader;
+
+static uint8_t* _series_block(BasicTagSeries* series, uint32_t block) {
+  return series->storage + (size_t)block * series->block_size;
+}
+
+static void _series_write_bits(uint8_t* data, uint32_t* position, uint64_t value, uint8_t count) {
+  // Most significant bit first
+  for (uint8_t i = count; i > 0; i--) {
+    uint32_t bit = *position;
+    uint8_t mask = (uint8_t)(0x80 >> (bit & 7));
+    if ((value >> (i - 1)) & 1) data[bit >> 3] |= mask;
+    else data[bit >> 3] &= (uint8_t)~mask;
+    (*position)++;
+  }
+}
+
+static uint64_t _series_read_bits(const uint8_t* data, uint32_t* position, uint8_t count) {
+  uint64_t value = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t bit = *position;
+    value = (value << 1) | ((data[bit >> 3] >> (7 - (bit & 7))) & 1);
+    (*position)++;
+  }
+  return value;
+}
+
+static uint8_t _series_leading_zeros(uint64_t value) {
+#if defined(__GNUC__)
+  return value == 0 ? 64 : (uint8_t)__builtin_clzll(value);
+#else
+  uint8_t count = 0;
+  while (count < 64 && !(value & (1ULL << (63 - count)))) count++;
+  return count;
+#endif
+}
+
+static uint8_t _series_trailing_zeros(uint64_t value) {
+#if defined(__GNUC__)
+  return value == 0 ? 64 : (uint8_t)__builtin_ctzll(value);
+#else
+  uint8_t count = 0;
+  while (count < 64 && !(value & (1ULL << count))) count++;
+  return count;
+#endif
+}
+
+static uint64_t _series_value_bits(BasicValue* value, uint8_t width) {
+  // Raw bits of the value, left aligned so their significant bits are always at the top
+  uint64_t bits;
+  switch (width) {
+    case 8: bits = value->value.uint8Value; break;
+    case 16: bits = value->value.uint16Value; break;
+    case 32: bits = value->value.uint32Value; break;
+    default: bits = value->value.uint64Value; break;
+  }
+  return bits << (64 - width);
+}
+
+static uint8_t _dod_bits(int64_t dod) {
+  // Bits needed to encode a delta-of-delta, 0 if it doesn't fit (a new block is started)
+  if (dod == 0) return 1;
+  if (dod >= -64 && dod <= 63) return 2 + 7;
+  if (dod >= -256 && dod <= 255) return 3 + 9;
+  if (dod >= -2048 && dod <= 2047) return 4 + 12;
+  if (dod >= INT32_MIN && dod <= INT32_MAX) return 4 + 32;
+  return 0;
+}
+
+bool attachTagSeries(FunctionalBasicTag* tag, BasicTagSeries* series, void* storage, size_t storage_size, size_t block_size) {
+  // NULL series detaches, numeric and boolean tags only
+  if (tag == NULL) return false;
+  if (series == NULL) {
+    tag->series = NULL;
+    return true;
+  }
+  uint8_t width = (uint8_t)(_history_value_size(tag->datatype) * 8);
+  if (width == 0 || storage == NULL || block_size < _SERIES_HEADER_SIZE + 16 || block_size > UINT32_MAX / 8) return false;
+  if (storage_size / block_size < 1 || storage_size / block_size > UINT32_MAX) return false;
+  series->storage = (uint8_t*)storage;
+  series->block_size = (uint32_t)block_size;
+  series->block_count = (uint32_t)(storage_size / block_size);
+  series->first_block = 0;
+  series->blocks_used = 0;
+  series->samples = 0;
+  series->dropped = 0;
+  series->width = width;
+  tag->series = series;
+  return true;
+}
+
+static void _series_start_block(BasicTagSeries* series, uint64_t timestamp, uint64_t bits) {
+  if (series->blocks_used == series->block_count) {
+    // Reuse the oldest block
+    _SeriesBlockHeader oldest;
+    memcpy(&oldest, _series_block(series, series->first_block), sizeof(oldest));
+    series->samples -= oldest.count;
+    series->dropped += oldest.count;
+    series->first_block = (series->first_block + 1) % series->block_count;
+    series->blocks_used--;
+  }
+  uint32_t block = (series->first_block + series->blocks_used) % series->block_count;
+  series->blocks_used++;
+  _SeriesBlockHeader header = {timestamp, bits, 1, 0};
+  memcpy(_series_block(series, block), &header, sizeof(header));
+  series->last_timestamp = timestamp;
+  series->last_delta = 0;
+  series->last_value = bits;
+  series->last_leading = 0xFF;  // No previous leading / trailing zeros yet
+  series->last_trailing = 0;
+  series->samples++;
+}
+
+static void _series_append(FunctionalBasicTag* tag) {
+  BasicTagSeries* series = tag->series;
+  if (tag->currentValue.isNull) return;
+  uint64_t timestamp = tag->currentValue.timestamp;
+  uint64_t bits = _series_value_bits(&(tag->currentValue), series->width);
+  if (series->blocks_used == 0 || timestamp < series->last_timestamp) {
+    _series_start_block(series, timestamp, bits);
+    return;
+  }
+
+  int64_t delta = (int64_t)(timestamp - series->last_timestamp);
+  int64_t dod = delta - series->last_delta;
+  uint8_t dod_bits = _dod_bits(dod);
+
+  uint64_t xor_bits = bits ^ series->last_value;
+  uint8_t leading = _series_leading_zeros(xor_bits);
+  uint8_t trailing = _series_trailing_zeros(xor_bits);
+  if (leading > 31) leading = 31;  // 5 bits
+  bool reuse = series->last_leading != 0xFF && leading >= series->last_leading && trailing >= series->last_trailing;
+  uint32_t value_bits = xor_bits == 0 ? 1 : reuse ? 2 + (64 - series->last_leading - series->last_trailing) : 2 + 5 + 6 + (64 - leading - trailing);
+
+  uint32_t block = (series->first_block + series->blocks_used - 1) % series->block_count;
+  uint8_t* block_start = _series_block(series, block);
+  _SeriesBlockHeader header;
+  memcpy(&header, block_start, sizeof(header));
+  uint32_t capacity = (series->block_size - _SERIES_HEADER_SIZE) * 8;
+  if (dod_bits == 0 || header.bits + dod_bits + value_bits > capacity) {
+    _series_start_block(series, timestamp, bits);
+    return;
+  }
+
+  uint8_t* data = block_start + _SERIES_HEADER_SIZE;
+  uint32_t position = header.bits;
+  if (dod == 0) _series_write_bits(data, &position, 0, 1);
+  else if (dod_bits == 9) _series_write_bits(data, &position, (0x2ULL << 7) | ((uint64_t)dod & 0x7F), 9);
+  else if (dod_bits == 12) _series_write_bits(data, &position, (0x6ULL << 9) | ((uint64_t)dod & 0x1FF), 12);
+  else if (dod_bits == 16) _series_write_bits(data, &position, (0xEULL << 12) | ((uint64_t)dod & 0xFFF), 16);
+  else {
+    _series_write_bits(data, &position, 0xF, 4);
+    _series_write_bits(data, &position, (uint64_t)dod & 0xFFFFFFFFULL, 32);
+  }
+
+  if (xor_bits == 0) {
+    _series_write_bits(data, &position, 0, 1);
+  } else if (reuse) {
+    _series_write_bits(data, &position, 0x2, 2);
+    _series_write_bits(data, &position, xor_bits >> series->last_trailing, (uint8_t)(64 - series->last_leading - series->last_trailing));
+  } else {
+    uint8_t length = (uint8_t)(64 - leading - trailing);
+    _series_write_bits(data, &position, 0x3, 2);
+    _series_write_bits(data, &position, leading, 5);
+    _series_write_bits(data, &position, length & 0x3F, 6);  // 64 is stored as 0
+    _series_write_bits(data, &position, xor_bits >> trailing, length);
+    series->last_leading = leading;
+    series->last_trailing = trailing;
+  }
+
+  header.bits = position;
+  header.count++;
+  memcpy(block_start, &header, sizeof(header));
+  series->last_timestamp = timestamp;
+  series->last_delta = delta;
+  series->last_value = bits;
+  series->samples++;
+}
+
+static int64_t _sign_extend(uint64_t value, uint8_t bits) {
+  uint64_t sign = 1ULL << (bits - 1);
+  return (int64_t)((value ^ sign) - sign);
+}
+
+size_t readTagSeries(FunctionalBasicTag* tag, uint64_t from, uint64_t to, BasicValue* values, size_t max_values) {
+  // Decodes the samples with from <= timestamp <= to, oldest first, up to max_values
+  if (tag == NULL || tag->series == NULL || values == NULL) return 0;
+  BasicTagSeries* series = tag->series;
+  size_t found = 0;
+  for (uint32_t b = 0; b < series->blocks_used && found < max_values; b++) {
+    uint8_t* block_start = _series_block(series, (series->first_block + b) % series->block_count);
+    _SeriesBlockHeader header;
+    memcpy(&header, block_start, sizeof(header));
+    if (header.first_timestamp > to) break;
+    const uint8_t* data = block_start + _SERIES_HEADER_SIZE;
+
+    uint32_t position = 0;
+    uint64_t timestamp = header.first_timestamp;
+    int64_t delta = 0;
+    uint64_t bits = header.first_value;
+    uint8_t leading = 0, trailing = 0;
+    for (uint32_t i = 0; i < header.count && found < max_values; i++) {
+      if (i > 0) {
+        int64_t dod = 0;
+        if (_series_read_bits(data, &position, 1)) {
+          if (!_series_read_bits(data, &position, 1)) dod = _sign_extend(_series_read_bits(data, &position, 7), 7);
+          else if (!_series_read_bits(data, &position, 1)) dod = _sign_extend(_series_read_bits(data, &position, 9), 9);
+          else if (!_series_read_bits(data, &position, 1)) dod = _sign_extend(_series_read_bits(data, &position, 12), 12);
+          else dod = _sign_extend(_series_read_bits(data, &position, 32), 32);
+        }
+        delta += dod;
+        timestamp += (uint64_t)delta;
+        if (_series_read_bits(data, &position, 1)) {
+          if (_series_read_bits(data, &position, 1)) {
+            leading = (uint8_t)_series_read_bits(data, &position, 5);
+            uint8_t length = (uint8_t)_series_read_bits(data, &position, 6);
+            if (length == 0) length = 64;
+            trailing = (uint8_t)(64 - leading - length);
+          }
+          uint8_t length = (uint8_t)(64 - leading - trailing);
+          bits ^= _series_read_bits(data, &position, length) << trailing;
+        }
+      }
+      if (timestamp < from) continue;
+      if (timestamp > to) return found;
+      BasicValue* value = &(values[found++]);
+      value->timestamp = timestamp;
+      value->datatype = tag->datatype;
+      value->isNull = false;
+      value->value.uint64Value = 0;
+      uint64_t raw = bits >> (64 - series->width);
+      switch (series->width) {
+        case 8: value->value.uint8Value = (uint8_t)raw; break;
+        case 16: value->value.uint16Value = (uint16_t)raw; break;
+        case 32: value->value.uint32Value = (uint32_t)raw; break;
+        default: value->value.uint64Value = raw; break;
+      }
+    }
+  }
+  return found;
+}
+
+
+static void _subscriptions_mark(FunctionalBasicTag* tag);  // See Subscriptions
+
+static inline void _archive_change(FunctionalBasicTag* tag) {
+  // Called after every change, records it in the tag's history ring and compressed series and marks its subscriptions
+  if (tag->history != NULL) _history_append(tag);
+  if (tag->series != NULL) _series_append(tag);
+  if (tag->_subscribers != 0) _subscriptions_mark(tag);
+}
+
+
+/*
+Tag Snapshots (v1.4.0)
+saveBasicTagSnapshot writes the tag definitions and current values to a compact binary image (for flash, FRAM
+or an mmap'd file), so after a reset report by exception carries on from the saved values instead of the first
+scan reporting every tag as changed.
+Format, all integers little endian:
+  header: "BTSN", u16 version, u16 reserved, u32 tag count, u32 body length, u32 CRC-32 of the body
+  per tag: u16 name length (including the terminator), name, i32 alias, u8 datatype, u8 flags,
+           u32 buffer_value_max_len, u32 scan_period, u64 timestamp, value
+  value: numeric types are their 1 to 8 bytes, strings are a u16 length and the content, bytes a u32 length and
+         the content. Nothing for Null values.
+restoreBasicTagSnapshot creates the tags in one pass with the registry and index reserved up front, the value
+addresses come from a callback since they belong to the application. The names point into the snapshot, which
+has to stay valid as long as the tags do (a flash partition, an mmap'd file or a static buffer).
+restoreBasicTagValues only restores the values of tags that already exist, matched by name and datatype.
+Zero copy bytes tags aren't saved, their values belong to the producer.
+Compact tags are saved after the FunctionalBasicTags with the compact flag set (scan period and max length 0) and
+are restored as compact tags, into the storage set with setCompactTagStorage.
+*/
+
+#define _SNAPSHOT_MAGIC "BTSN"
+#define _SNAPSHOT_VERSION 1
+#define _SNAPSHOT_HEADER_SIZE 20
+#define _SNAPSHOT_LOCAL_WRITABLE 0x01
+#define _SNAPSHOT_REMOTE_WRITABLE 0x02
+#define _SNAPSHOT_IS_NULL 0x04
+#define _SNAPSHOT_RETAIN_PREVIOUS 0x08
+#define _SNAPSHOT_COMPACT 0x10
+
+uint32_t basicTagCrc32(const void* data, size_t length, uint32_t crc) {
+  // CRC-32 (IEEE, as used by zlib), a nibble table keeps it at 64 bytes of flash. Start with crc 0
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  const uint8_t* bytes = (const uint8_t*)data;
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = table[(crc ^ bytes[i]) & 0x0F] ^ (crc >> 4);
+    crc = table[(crc ^ (bytes[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+typedef struct {
+  uint8_t* buffer;  // NULL when measuring
+  size_t capacity;
+  size_t length;
+} _SnapshotWriter;
+
+static void _snapshot_put(_SnapshotWriter* w, const void* data, size_t size) {
+  if (w->buffer != NULL && w->length + size <= w->capacity) memcpy(w->buffer + w->length, data, size);
+  w->length += size;
+}
+
+static void _snapshot_put_uint(_SnapshotWriter* w, uint64_t value, size_t size) {
+  uint8_t bytes[8];
+  for (size_t i = 0; i < size; i++) bytes[i] = (uint8_t)(value >> (8 * i));
+  _snapshot_put(w, bytes, size);
+}
+
+static uint64_t _snapshot_get_uint(const uint8_t* data, size_t size) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < size; i++) value |= (uint64_t)data[i] << (8 * i);
+  return value;
+}
+
+static void _set_value_bits(Value* value, size_t size, uint64_t bits) {
+  // Stores raw bits in a 1 to 8 byte value
+  value->uint64Value = 0;
+  switch (size) {
+    case 1: value->uint8Value = (uint8_t)bits; break;
+    case 2: value->uint16Value = (uint16_t)bits; break;
+    case 4: value->uint32Value = (uint32_t)bits; break;
+    default: value->uint64Value = bits; break;
+  }
+}
+
+static void _snapshot_put_record(_SnapshotWriter* w, const char* name, int alias, SparkplugDataType datatype, uint8_t flags,
+                                 size_t buffer_value_max_len, uint32_t scan_period, BasicValue* value) {
+  size_t name_length = name != NULL ? strlen(name) + 1 : 0;
+  if (value->isNull) flags |= _SNAPSHOT_IS_NULL;
+  _snapshot_put_uint(w, name_length, 2);
+  if (name_length > 0) _snapshot_put(w, name, name_length);
+  _snapshot_put_uint(w, (uint32_t)alias, 4);
+  _snapshot_put_uint(w, (uint8_t)datatype, 1);
+  _snapshot_put_uint(w, flags, 1);
+  _snapshot_put_uint(w, buffer_value_max_len, 4);
+  _snapshot_put_uint(w, scan_period, 4);
+  _snapshot_put_uint(w, value->timestamp, 8);
+  if (value->isNull) return;
+
+  size_t size = _history_value_size(datatype);
+  if (size > 0) {
+    _snapshot_put_uint(w, _series_value_bits(value, (uint8_t)(size * 8)) >> (64 - size * 8), size);
+  } else if (datatype == spBytes) {
+    _snapshot_put_uint(w, value->value.bytesValue->written_length, 4);
+    _snapshot_put(w, value->value.bytesValue->buffer, value->value.bytesValue->written_length);
+  } else {
+    size_t length = strlen(value->value.stringValue);
+    _snapshot_put_uint(w, length, 2);
+    _snapshot_put(w, value->value.stringValue, length);
+  }
+}
+
+static void _snapshot_put_tag(_SnapshotWriter* w, FunctionalBasicTag* tag) {
+  uint8_t flags = 0;
+  if (tag->local_writable) flags |= _SNAPSHOT_LOCAL_WRITABLE;
+  if (tag->remote_writable) flags |= _SNAPSHOT_REMOTE_WRITABLE;
+  if (tag->retain_previous) flags |= _SNAPSHOT_RETAIN_PREVIOUS;
+  _snapshot_put_record(w, tag->name, tag->alias, tag->datatype, flags, tag->buffer_value_max_len, tag->scan_period, &(tag->currentValue));
+}
+
+static bool _snapshot_put_compact(_SnapshotWriter* w, CompactBasicTag* tag) {
+  // Returns false if the tag was deleted since it was looked up
+  BasicValue value;
+  if (!getCompactTagValue(tag, &value)) return false;
+  uint8_t flags = _SNAPSHOT_COMPACT;
+  if (tag->flags & BASIC_TAG_COMPACT_LOCAL_WRITABLE) flags |= _SNAPSHOT_LOCAL_WRITABLE;
+  if (tag->flags & BASIC_TAG_COMPACT_REMOTE_WRITABLE) flags |= _SNAPSHOT_REMOTE_WRITABLE;
+  _snapshot_put_record(w, tag->name, tag->alias, value.datatype, flags, 0, 0, &value);
+  return true;
+}
+
+size_t saveBasicTagSnapshot(uint8_t* buffer, size_t capacity) {
+  // Returns the snapshot length, 0 if it doesn't fit. A NULL buffer returns the size needed
+  uint32_t token = beginBasicTagRead();
+  _SnapshotWriter w = {buffer, capacity, _SNAPSHOT_HEADER_SIZE};
+  size_t tags_count = _TS_LOAD(_tags_count);
+  FunctionalBasicTag** tags_array = _TS_LOAD(_tags_array);
+  uint32_t saved = 0;
+  for (size_t i = 0; i < tags_count; i++) {
+    FunctionalBasicTag* tag = tags_array[i];
+    if (tag == NULL || tag->_zero_copy) continue;
+    _snapshot_put_tag(&w, tag);
+    saved++;
+  }
+  size_t compact_capacity = getCompactTagsCapacity();
+  for (size_t slot = 0; slot < compact_capacity; slot++) {
+    CompactBasicTag* tag = getCompactTagBySlot(slot);
+    if (tag != NULL && _snapshot_put_compact(&w, tag)) saved++;
+  }
+  endBasicTagRead(token);
+  if (buffer == NULL) return w.length;
+  if (w.length > capacity || w.length - _SNAPSHOT_HEADER_SIZE > UINT32_MAX) return 0;
+
+  uint32_t body_length = (uint32_t)(w.length - _SNAPSHOT_HEADER_SIZE);
+  _SnapshotWriter header = {buffer, capacity, 0};
+  _snapshot_put(&header, _SNAPSHOT_MAGIC, 4);
+  _snapshot_put_uint(&header, _SNAPSHOT_VERSION, 2);
+  _snapshot_put_uint(&header, 0, 2);
+  _snapshot_put_uint(&header, saved, 4);
+  _snapshot_put_uint(&header, body_length, 4);
+  _snapshot_put_uint(&header, basicTagCrc32(buffer + _SNAPSHOT_HEADER_SIZE, body_length, 0), 4);
+  return w.length;
+}
+
+typedef struct {
+  const char* name;  // Points into the snapshot
+  int alias;
+  SparkplugDataType datatype;
+  uint8_t flags;
+  size_t buffer_value_max_len;
+  uint32_t scan_period;
+  uint64_t timestamp;
+  const uint8_t* value;
+  size_t value_length;  // Content length for strings and bytes
+} _SnapshotRecord;
+
+static bool _snapshot_check(const uint8_t* data, size_t length, uint32_t* count) {
+  if (data == NULL || length < _SNAPSHOT_HEADER_SIZE || memcmp(data, _SNAPSHOT_MAGIC, 4) != 0) return false;
+  if (_snapshot_get_uint(data + 4, 2) != _SNAPSHOT_VERSION) return false;
+  uint64_t body_length = _snapshot_get_uint(data + 12, 4);
+  if (body_length > length - _SNAPSHOT_HEADER_SIZE) return false;
+  if (basicTagCrc32(data + _SNAPSHOT_HEADER_SIZE, (size_t)body_length, 0) != (uint32_t)_snapshot_get_uint(data + 16, 4)) return false;
+  *count = (uint32_t)_snapshot_get_uint(data + 8, 4);
+  return true;
+}
+
+static const uint8_t* _snapshot_next(const uint8_t* cursor, const uint8_t* end, _SnapshotRecord* record) {
+  // Parses one record, NULL if the record runs past the end. The CRC has been checked, this guards the lengths
+  if (end - cursor < 2) return NULL;
+  size_t name_length = (size_t)_snapshot_get_uint(cursor, 2);
+  cursor += 2;
+  if ((size_t)(end - cursor) < name_length + 22) return NULL;
+  record->name = name_length > 0 ? (const char*)cursor : NULL;
+  if (name_length > 0 && cursor[name_length - 1] != '\0') return NULL;
+  cursor += name_length;
+  record->alias = (int)(int32_t)_snapshot_get_uint(cursor, 4);
+  record->datatype = (SparkplugDataType)cursor[4];
+  record->flags = cursor[5];
+  record->buffer_value_max_len = (size_t)_snapshot_get_uint(cursor + 6, 4);
+  record->scan_period = (uint32_t)_snapshot_get_uint(cursor + 10, 4);
+  record->timestamp = _snapshot_get_uint(cursor + 14, 8);
+  cursor += 22;
+  record->value = cursor;
+  record->value_length = 0;
+  if (record->flags & _SNAPSHOT_IS_NULL) return cursor;
+
+  size_t size = _history_value_size(record->datatype);
+  if (size == 0) {
+    size_t prefix = record->datatype == spBytes ? 4 : 2;
+    if ((size_t)(end - cursor) < prefix) return NULL;
+    record->value_length = (size_t)_snapshot_get_uint(cursor, prefix);
+    cursor += prefix;
+    record->value = cursor;
+    size = record->value_length;
+  }
+  if ((size_t)(end - cursor) < size) return NULL;
+  return cursor + size;
+}
+
+static void _snapshot_apply_value(FunctionalBasicTag* tag, _SnapshotRecord* record) {
+  // Sets currentValue from the record, the next read compares against it instead of reporting a first read
+  BasicValue* value = &(tag->currentValue);
+  _seq_write_begin(tag);
+  value->timestamp = record->timestamp;
+  value->isNull = (record->flags & _SNAPSHOT_IS_NULL) != 0;
+  size_t size = _history_value_size(tag->datatype);
+  if (value->isNull) {
+    tag->_str_len = 0;
+  } else if (size > 0) {
+    _set_value_bits(&(value->value), size, _snapshot_get_uint(record->value, size));
+  } else if (tag->datatype == spBytes) {
+    BufferValue* bytes = value->value.bytesValue;
+    size_t length = record->value_length < bytes->allocated_length ? record->value_length : bytes->allocated_length;
+    if (length > 0) memcpy(bytes->buffer, record->value, length);
+    bytes->written_length = length;
+  } else {
+    size_t max_len = tag->datatype == spUUID ? 36 : tag->buffer_value_max_len;
+    size_t length = record->value_length < max_len ? record->value_length : max_len;
+    if (value->value.stringValue == NULL || length == 0) {
+      value->isNull = true;
+    } else {
+      memcpy(value->value.stringValue, record->value, length);
+      value->value.stringValue[length] = '\0';
+      tag->_str_len = (uint32_t)length;
+    }
+  }
+  _seq_write_end(tag);
+  _scan_plan_sync(tag);
+}
+
+static void _snapshot_apply_compact(CompactBasicTag* tag, _SnapshotRecord* record) {
+  // Compact records only hold numeric and boolean values
+  if (record->flags & _SNAPSHOT_IS_NULL) {
+    tag->flags |= BASIC_TAG_COMPACT_IS_NULL;
+    return;
+  }
+  size_t size = _history_value_size((SparkplugDataType)tag->datatype);
+  _set_value_bits(&(tag->value), size, _snapshot_get_uint(record->value, size));
+  tag->timestamp = _compact_relative(record->timestamp);
+  tag->flags &= ~BASIC_TAG_COMPACT_IS_NULL;
+}
+
+size_t restoreBasicTagSnapshot(const uint8_t* data, size_t length, BasicTagAddressFunction resolve, void* arg) {
+  /*
+  Creates a tag for every record resolve returns a value address for, returns the number created, 0 if the
+  snapshot is invalid. The snapshot must stay valid as long as the tags, their names point into it.
+  The registry is built in one pass under the writer lock: the array and index are grown once for every record,
+  the tags are allocated into the unused end of the array and then indexed and published together, so the scan
+  plan and schedule are only invalidated once. resolve is called with the writer lock held, it can look tags up but
+  must not create or delete them
+  */
+  uint32_t count;
+  if (resolve == NULL || !_snapshot_check(data, length, &count)) return 0;
+  const uint8_t* cursor = data + _SNAPSHOT_HEADER_SIZE;
+  const uint8_t* end = cursor + _snapshot_get_uint(data + 12, 4);
+  if (count > (size_t)(end - cursor) / 24) count = (uint32_t)((end - cursor) / 24);  // Smallest record, guards the reserve
+
+  _writer_lock();
+  size_t first = _tags_count;
+  if (_static_table != NULL || !_grow_tags_array(first + count) || !_grow_index(first + count)) {
+    _writer_unlock();
+    return 0;
+  }
+  size_t created = 0;
+  size_t compact_created = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    _SnapshotRecord record;
+    cursor = _snapshot_next(cursor, end, &record);
+    if (cursor == NULL) break;
+    void* value_address = resolve(record.name, record.alias, record.datatype, arg);
+    if (value_address == NULL) continue;  // The application no longer has this tag
+    if (record.flags & _SNAPSHOT_COMPACT) {
+      CompactBasicTag* compact = _compact_create(record.name, value_address, record.alias, record.datatype, (record.flags & _SNAPSHOT_LOCAL_WRITABLE) != 0,
+                                                 (record.flags & _SNAPSHOT_REMOTE_WRITABLE) != 0);
+      if (compact == NULL) continue;  // No compact storage or it is full
+      _snapshot_apply_compact(compact, &record);
+      compact_created++;
+      continue;
+    }
+    FunctionalBasicTag* tag = _alloc_tag(record.name, value_address, record.alias, record.datatype, (record.flags & _SNAPSHOT_LOCAL_WRITABLE) != 0,
+                                         (record.flags & _SNAPSHOT_REMOTE_WRITABLE) != 0, record.buffer_value_max_len, (record.flags & _SNAPSHOT_RETAIN_PREVIOUS) != 0);
+    if (tag == NULL) continue;
+    tag->scan_period = record.scan_period;
+    _snapshot_apply_value(tag, &record);
+    _tags_array[first + created] = tag;  // Past _tags_count, readers don't see it until _add_tags_to_registry
+    created++;
+  }
+  _add_tags_to_registry(created);
+  _rcu_reclaim();
+  _writer_unlock();
+  return created + compact_created;
+}
+
+size_t restoreBasicTagValues(const uint8_t* data, size_t length) {
+  // Restores the values of existing tags with the same name and datatype, returns the number restored
+  uint32_t count;
+  if (!_snapshot_check(data, length, &count)) return 0;
+  const uint8_t* cursor = data + _SNAPSHOT_HEADER_SIZE;
+  const uint8_t* end = cursor + _snapshot_get_uint(data + 12, 4);
+  size_t restored = 0;
+  uint32_t token = beginBasicTagRead();
+  for (uint32_t i = 0; i < count; i++) {
+    _SnapshotRecord record;
+    cursor = _snapshot_next(cursor, end, &record);
+    if (cursor == NULL) break;
+    if (record.flags & _SNAPSHOT_COMPACT) {
+      CompactBasicTag* compact = getCompactTagByName(record.name);
+      if (compact == NULL || compact->datatype != record.datatype) continue;
+      _snapshot_apply_compact(compact, &record);
+      restored++;
+      continue;
+    }
+    FunctionalBasicTag* tag = getTagByName(record.name);
+    if (tag == NULL || tag->datatype != record.datatype || tag->_zero_copy) continue;
+    _snapshot_apply_value(tag, &record);
+    restored++;
+  }
+  endBasicTagRead(token);
+  return restored;
+}
+
+
+/*
+Value Sources (v1.4.0)
+A BasicTagSource is one block of memory shared by a group of tags, each tag's value_address is an offset into it.
+The block can be a Modbus register image, a DMA buffer, a copy of an SPI peripheral's registers or an mmap'd
+shared memory segment. Before a scan, fetch is called once for the span of the block the tags cover, so a scan
+costs one bus transaction per source instead of one per tag, and the tags are then read from the block by the
+normal scan plan. readDueBasicTags only fetches the sources of the tags that are due.
+fetch has to leave the values in native byte order (eg. swap the words of a big endian register image). Sources
+without a fetch function are read in place, for memory that is updated by DMA or another process.
+Writes to a tag are written to the block, then store is called with the span of the tag's value.
+Sources are in the scan's list while they have tags.
+*/
+
+static BasicTagSource* _sources = NULL;
+static uint32_t _source_stamp = 0;  // Bumped every scan, a source is fetched once per stamp
+
+bool initBasicTagSource(BasicTagSource* source, void* block, size_t size, BasicTagSourceFunction fetch, BasicTagSourceFunction store, void* arg) {
+  if (source == NULL || block == NULL || size == 0) return false;
+  memset(source, 0, sizeof(BasicTagSource));
+  source->block = (uint8_t*)block;
+  source->size = size;
+  source->fetch = fetch;
+  source->store = store;
+  source->arg = arg;
+  return true;
+}
+
+static size_t _source_value_size(SparkplugDataType datatype, size_t buffer_value_max_len) {
+  // Bytes of the block a tag's value uses, 0 for datatypes that can't be in a source
+  switch (datatype) {
+    case spString:
+    case spText:
+      return buffer_value_max_len + 1;
+    case spUUID:
+      return 37;
+    default:
+      return _history_value_size(datatype);  // 0 for bytes, they need a BufferValue
+  }
+}
+
+static void _source_fetch(BasicTagSource* source) {
+  source->_stamp = _source_stamp;
+  if (source->fetch == NULL || source->_fetch_end <= source->_fetch_start) return;
+  size_t start = source->_fetch_start;
+  if (source->fetch(source->arg, source->block + start, start, source->_fetch_end - start)) {
+    source->fetches++;
+  } else {
+    source->errors++;  // The tags keep the values from the last fetch
+  }
+}
+
+static void _fetch_sources() {
+  _source_stamp++;
+  for (BasicTagSource* source = _TS_LOAD(_sources); source != NULL; source = _TS_LOAD(source->_next)) _source_fetch(source);
+}
+
+static inline void _fetch_tag_source(FunctionalBasicTag* tag) {
+  // Fetches the source of a tag if it hasn't been this scan, readDueBasicTags only fetches what's due
+  if (tag->source != NULL && tag->source->_stamp != _source_stamp) _source_fetch(tag->source);
+}
+
+bool fetchBasicTagSources() {
+  // Called by the scans, for reading tags with readBasicTag. Returns false if a fetch failed
+  bool ok = true;
+  _source_stamp++;
+  for (BasicTagSource* source = _TS_LOAD(_sources); source != NULL; source = _TS_LOAD(source->_next)) {
+    uint32_t errors = source->errors;
+    _source_fetch(source);
+    if (source->errors != errors) ok = false;
+  }
+  return ok;
+}
+
+static void _source_attach(BasicTagSource* source, size_t offset, size_t size) {
+  // Widens the fetched span, called with the writer lock held
+  if (source->tags == 0 || offset < source->_fetch_start) source->_fetch_start = offset;
+  if (source->tags == 0 || offset + size > source->_fetch_end) source->_fetch_end = offset + size;
+  if (source->tags++ > 0) return;
+  source->_next = _sources;
+  _TS_STORE(_sources, source);
+}
+
+static void _source_detach(FunctionalBasicTag* tag) {
+  // Called with the writer lock held. A scan walking the list can still follow the removed source's _next
+  BasicTagSource* source = tag->source;
+  if (source == NULL || --source->tags > 0) return;
+  BasicTagSource** link = &_sources;
+  while (*link != NULL && *link != source) link = &((*link)->_next);
+  if (*link != NULL) _TS_STORE(*link, source->_next);
+}
+
+static void _source_store(FunctionalBasicTag* tag) {
+  BasicTagSource* source = tag->source;
+  if (source->store == NULL) return;
+  size_t offset = (uint8_t*)(tag->value_address) - source->block;
+  if (!source->store(source->arg, (uint8_t*)(tag->value_address), offset, _source_value_size(tag->datatype, tag->buffer_value_max_len))) source->errors++;
+}
+
+FunctionalBasicTag* createSourceTag(const char* name, BasicTagSource* source, size_t offset, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable, size_t buffer_value_max_len) {
+  /*
+  Creates a tag whose value is at offset in the source's block. Numeric values must be aligned to their size,
+  strings are NUL terminated char arrays of buffer_value_max_len + 1 bytes
+  */
+  if (source == NULL) return NULL;
+  size_t size = _source_value_size(datatype, buffer_value_max_len);
+  if (size == 0 || offset > source->size || size > source->size - offset) return NULL;
+  uint8_t* address = source->block + offset;
+  size_t align = size < sizeof(void*) ? size : sizeof(void*);
+  if (_history_value_size(datatype) > 0 && (uintptr_t)address % align != 0) return NULL;
+
+  FunctionalBasicTag* tag = createTag(name, address, alias, datatype, local_writable, remote_writable, buffer_value_max_len);
+  if (tag == NULL) return NULL;
+  _writer_lock();
+  _source_attach(source, offset, size);
+  tag->source = source;
+  _writer_unlock();
+  return tag;
+}
+
+
+/*
+Name Prefixes (v1.4.0)
+Sparkplug style names are paths (Motor1/Current, Motor1/Temp). iterTagsWithPrefix uses an array of the tags
+sorted by name, tags sharing a prefix are next to each other in it, so a lookup is a binary search plus the
+matches. The array is rebuilt on the first prefix lookup after tags are created or deleted.
+internBasicTagName keeps one copy of each name in a string pool, with setBasicTagInternNames createTag interns
+every name, so names built in a temporary buffer (snprintf) don't need storage of their own and repeated names
+are only stored once. The pool comes from the library allocator and is never freed, names are expected to
+outlive their tags.
+*/
+
+#define _NAME_POOL_CHUNK 512
+
+typedef struct _NamePoolChunk {
+  struct _NamePoolChunk* next;
+  size_t used;
+  size_t size;
+  char data[];
+} _NamePoolChunk;
+
+typedef struct {
+  uint32_t hash;
+  const char* name;
+} _InternSlot;
+
+typedef struct {
+  size_t count;
+  FunctionalBasicTag* tags[];
+} _SortedTags;  // The count is part of the array, a reader always has the count of the array it loaded
+
+static _SortedTags* _sorted_tags = NULL;
+static _NamePoolChunk* _name_pool = NULL;
+static _InternSlot* _intern_table = NULL;
+static size_t _intern_capacity = 0;
+static size_t _intern_count = 0;
+static size_t _intern_bytes = 0;
+
+static bool _intern_grow() {
+  size_t capacity = _intern_capacity > 0 ? _intern_capacity * 2 : 64;
+  _InternSlot* table = calloc(capacity, sizeof(_InternSlot));
+  if (table == NULL) return false;
+  for (size_t i = 0; i < _intern_capacity; i++) {
+    if (_intern_table[i].name == NULL) continue;
+    size_t pos = _intern_table[i].hash & (capacity - 1);
+    while (table[pos].name != NULL) pos = (pos + 1) & (capacity - 1);
+    table[pos] = _intern_table[i];
+  }
+  free(_intern_table);
+  _intern_table = table;
+  _intern_capacity = capacity;
+  return true;
+}
+
+static const char* _intern_name(const char* name) {
+  // Called with the writer lock held, returns the pooled copy of name, NULL if it couldn't be allocated
+  uint32_t hash = _hash_name(name);
+  if (_intern_capacity > 0) {
+    for (size_t pos = hash & (_intern_capacity - 1); _intern_table[pos].name != NULL; pos = (pos + 1) & (_intern_capacity - 1)) {
+      if (_intern_table[pos].hash == hash && strcmp(_intern_table[pos].name, name) == 0) return _intern_table[pos].name;
+    }
+  }
+  if ((_intern_count + 1) * 2 > _intern_capacity && !_intern_grow()) return NULL;  // Kept at most half full
+
+  size_t length = strlen(name) + 1;
+  if (_name_pool == NULL || _name_pool->size - _name_pool->used < length) {
+    size_t size = length > _NAME_POOL_CHUNK ? length : _NAME_POOL_CHUNK;
+    _NamePoolChunk* chunk = (_NamePoolChunk*)_bt_alloc(sizeof(_NamePoolChunk) + size);
+    if (chunk == NULL) return NULL;
+    chunk->next = _name_pool;
+    chunk->used = 0;
+    chunk->size = size;
+    _name_pool = chunk;
+  }
+  char* copy = _name_pool->data + _name_pool->used;
+  memcpy(copy, name, length);
+  _name_pool->used += length;
+  _intern_bytes += length;
+
+  size_t pos = hash & (_intern_capacity - 1);
+  while (_intern_table[pos].name != NULL) pos = (pos + 1) & (_intern_capacity - 1);
+  _intern_table[pos].hash = hash;
+  _intern_table[pos].name = copy;
+  _intern_count++;
+  return copy;
+}
+
+const char* internBasicTagName(const char* name) {
+  if (name == NULL) return NULL;
+  _writer_lock();
+  const char* interned = _intern_name(name);
+  _writer_unlock();
+  return interned;
+}
+
+void setBasicTagInternNames(bool intern) {
+  _intern_names = intern;
+}
+
+size_t getInternedNamesSize() {
+  // Bytes of names in the pool
+  return _intern_bytes;
+}
+
+static int _compare_tag_names(const void* a, const void* b) {
+  return strcmp((*(FunctionalBasicTag* const*)a)->name, (*(FunctionalBasicTag* const*)b)->name);
+}
+
+static bool _rebuild_sorted_tags() {
+  // Sorted copy of the registry, tags without a name are left out
+  _writer_lock();
+  if (!_TS_LOAD(_sorted_dirty)) {
+    _writer_unlock();
+    return true;  // Another task rebuilt it first
+  }
+  size_t tags_count = _tags_count;
+  _SortedTags* sorted = malloc(sizeof(_SortedTags) + tags_count * sizeof(FunctionalBasicTag*));
+  if (sorted == NULL) {
+    _writer_unlock();
+    return false;
+  }
+  sorted->count = 0;
+  for (size_t i = 0; i < tags_count; i++) {
+    if (_tags_array[i] != NULL && _tags_array[i]->name != NULL) sorted->tags[sorted->count++] = _tags_array[i];
+  }
+  qsort(sorted->tags, sorted->count, sizeof(FunctionalBasicTag*), _compare_tag_names);
+  _SortedTags* old_sorted = _sorted_tags;
+  _TS_STORE(_sorted_tags, sorted);
+#ifdef BASIC_TAG_THREAD_SAFE
+  if (old_sorted != NULL) _retire(old_sorted, _RETIRED_MEMORY);
+  _rcu_reclaim();
+#else
+  free(old_sorted);
+#endif
+  _TS_STORE(_sorted_dirty, false);
+  _writer_unlock();
+  return true;
+}
+
+static size_t _prefix_lower_bound(FunctionalBasicTag** sorted, size_t count, const char* prefix) {
+  // First tag whose name is not less than prefix
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (strcmp(sorted[mid]->name, prefix) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+#define _PREFIX_BATCH 16  // Matches iterTagsWithPrefix keeps on the stack before it allocates
+
+static size_t _prefix_matches(const char* prefix, FunctionalBasicTag** tags, size_t max_tags) {
+  // Writes up to max_tags matches in name order to tags (may be NULL), returns the number of matches
+  if (prefix == NULL) return 0;
+  uint32_t token;
+  while (true) {
+    // Rebuilt outside the read section, _retire can wait for readers when it is out of memory
+    if (_TS_LOAD(_sorted_dirty) && !_rebuild_sorted_tags()) return 0;
+    token = _rcu_read_begin();
+    if (!_TS_LOAD(_sorted_dirty)) break;  // Otherwise a tag in the array may have been deleted before the read section
+    _rcu_read_end(token);
+  }
+  // The array stays valid for the read section even if another task rebuilds it
+  _SortedTags* sorted = _TS_LOAD(_sorted_tags);
+  size_t prefix_length = strlen(prefix);
+  size_t matches = 0;
+  for (size_t i = _prefix_lower_bound(sorted->tags, sorted->count, prefix); i < sorted->count; i++) {
+    FunctionalBasicTag* tag = sorted->tags[i];
+    if (strncmp(tag->name, prefix, prefix_length) != 0) break;
+    if (tags != NULL && matches < max_tags) tags[matches] = tag;
+    matches++;
+  }
+  _rcu_read_end(token);
+  return matches;
+}
+
+size_t iterTagsWithPrefix(const char* prefix, TagFunction tagFn) {
+  /*
+  Calls tagFn on every tag whose name starts with prefix, in name order. Returns the number of tags, 0 if there
+  are more than _PREFIX_BATCH and the copy can't be allocated.
+  The matches are copied first and tagFn is called after the read section, so tagFn may delete the tag it is called
+  with: deleting can wait for readers (_retire out of memory), which would deadlock inside one. Like
+  getTagsWithPrefix, wrap it in beginBasicTagRead when another task may delete the tags (tagFn must not delete then)
+  */
+  FunctionalBasicTag* batch[_PREFIX_BATCH];
+  size_t matches = _prefix_matches(prefix, batch, _PREFIX_BATCH);
+  if (tagFn == NULL || matches == 0) return matches;
+  FunctionalBasicTag** tags = batch;
+  size_t capacity = _PREFIX_BATCH;
+  while (matches > capacity) {
+    // Tags may be created between the count and the copy, until the copy holds every match
+    if (tags != batch) free(tags);
+    capacity = matches;
+    tags = malloc(capacity * sizeof(FunctionalBasicTag*));
+    if (tags == NULL) return 0;
+    matches = _prefix_matches(prefix, tags, capacity);
+  }
+  for (size_t i = 0; i < matches; i++) tagFn(tags[i]);
+  if (tags != batch) free(tags);
+  return matches;
+}
+
+size_t getTagsWithPrefix(const char* prefix, FunctionalBasicTag** tags, size_t max_tags) {
+  // Writes the first max_tags matches in name order, returns the number of matches
+  return _prefix_matches(prefix, tags, max_tags);
+}
+
+
+/*
+Subscriptions (v1.4.0)
+valueChanged only says whether the last read changed the tag. A BasicTagSubscription has its own dirty bitmap
+(bit idx % 32 of word idx / 32, as readAllBasicTagsBitmap), and every change of a subscribed tag sets its bit,
+so each consumer (a cloud publisher, a local HMI) drains the tags that changed since it last looked at its own
+rate. Each tag has a mask of its subscriptions, a change costs one OR per subscription and nothing for tags
+without any. The bits are set with atomics, consumers can drain from another task while the scan runs.
+When a tag is deleted the bit of the tag swapped into its index is moved with it.
+*/
+
+#if defined(__GNUC__)
+#define _SUB_OR(var, bits) __atomic_fetch_or(&(var), (bits), __ATOMIC_RELAXED)
+#define _SUB_AND(var, bits) __atomic_fetch_and(&(var), (bits), __ATOMIC_RELAXED)
+#define _SUB_TAKE(var) __atomic_exchange_n(&(var), 0, __ATOMIC_ACQUIRE)
+#else
+// Single core targets only
+#define _SUB_OR(var, bits) ((var) |= (bits))
+#define _SUB_AND(var, bits) ((var) &= (bits))
+#define _SUB_TAKE(var) _sub_take(&(var))
+static uint32_t _sub_take(uint32_t* var) {
+  uint32_t bits = *var;
+  *var = 0;
+  return bits;
+}
+#endif
+
+static BasicTagSubscription* _subscriptions[BASIC_TAG_MAX_SUBSCRIPTIONS];
+
+static inline bool _subscription_valid(BasicTagSubscription* subscription) {
+  return subscription != NULL && subscription->_id < BASIC_TAG_MAX_SUBSCRIPTIONS && _TS_LOAD(_subscriptions[subscription->_id]) == subscription;
+}
+
+static inline void _subscription_set(BasicTagSubscription* subscription, size_t idx) {
+  if (idx / 32 < subscription->words) _SUB_OR(subscription->dirty[idx / 32], (uint32_t)1 << (idx % 32));
+}
+
+static inline void _subscription_clear(BasicTagSubscription* subscription, size_t idx) {
+  if (idx / 32 < subscription->words) _SUB_AND(subscription->dirty[idx / 32], ~((uint32_t)1 << (idx % 32)));
+}
+
+static void _subscriptions_mark(FunctionalBasicTag* tag) {
+  // Called for every change of a tag with subscriptions
+  uint32_t mask = tag->_subscribers;
+  while (mask != 0) {
+    unsigned int id = _lowest_bit(mask);
+    mask &= mask - 1;
+    BasicTagSubscription* subscription = _subscriptions[id];
+    if (subscription != NULL) _subscription_set(subscription, tag->_idx);
+  }
+}
+
+static void _subscriptions_move(FunctionalBasicTag* tag, FunctionalBasicTag* last, size_t idx, size_t last_idx) {
+  // Called by _remove_tag_from_registry with the writer lock held, last is moving from last_idx into idx
+  uint32_t mask = tag->_subscribers | last->_subscribers;
+  while (mask != 0) {
+    unsigned int id = _lowest_bit(mask);
+    mask &= mask - 1;
+    BasicTagSubscription* subscription = _subscriptions[id];
+    if (subscription == NULL) continue;
+    bool last_dirty = last_idx / 32 < subscription->words && (subscription->dirty[last_idx / 32] & ((uint32_t)1 << (last_idx % 32)));
+    _subscription_clear(subscription, idx);
+    _subscription_clear(subscription, last_idx);
+    if (last_dirty && last != tag) _subscription_set(subscription, idx);
+  }
+  tag->_subscribers = 0;
+}
+
+bool createBasicTagSubscription(BasicTagSubscription* subscription, uint32_t* dirty, size_t words) {
+  // dirty has a bit for each tag index, tags with an index past words * 32 can't be subscribed
+  if (subscription == NULL || dirty == NULL || words == 0) return false;
+  _writer_lock();
+  uint8_t id = 0;
+  while (id < BASIC_TAG_MAX_SUBSCRIPTIONS && _subscriptions[id] != NULL) id++;
+  if (id == BASIC_TAG_MAX_SUBSCRIPTIONS) {
+    _writer_unlock();
+    return false;
+  }
+  memset(dirty, 0, words * sizeof(uint32_t));
+  subscription->dirty = dirty;
+  subscription->words = words;
+  subscription->_id = id;
+  _TS_STORE(_subscriptions[id], subscription);
+  _writer_unlock();
+  return true;
+}
 
+bool deleteBasicTagSubscription(BasicTagSubscription* subscription) {
+  if (!_subscription_valid(subscription)) return false;
+  _writer_lock();
+  uint32_t keep = ~((uint32_t)1 << subscription->_id);
+  for (size_t i = 0; i < _tags_count; i++) {
+    if (_tags_array[i] != NULL) _SUB_AND(_tags_array[i]->_subscribers, keep);
+  }
+  _TS_STORE(_subscriptions[subscription->_id], NULL);
+  _writer_unlock();
+  return true;
+}
 
-  // Copy string from reference to target
-  memcpy(target_buf, reference_buf, length);
-  target_buf->written_length = length;
+static bool _subscribe_tag(BasicTagSubscription* subscription, FunctionalBasicTag* tag) {
+  // Writer lock held. A tag that has been read is marked dirty straight away, so the subscriber starts with its current value
+  if (tag->_idx / 32 >= subscription->words) return false;
+  _SUB_OR(tag->_subscribers, (uint32_t)1 << subscription->_id);
+  if (tag->currentValue.timestamp != 0) _subscription_set(subscription, tag->_idx);
   return true;
 }
 
-static void _copyBasicValue(BasicValue* reference, BasicValue* target, size_t buffer_value_max_len) {
-    if (reference == NULL || target == NULL) return;
+bool subscribeTag(BasicTagSubscription* subscription, FunctionalBasicTag* tag) {
+  if (tag == NULL || !_subscription_valid(subscription)) return false;
+  _writer_lock();
+  bool ok = _subscribe_tag(subscription, tag);
+  _writer_unlock();
+  return ok;
+}
 
-    // Copy simple fields
-    target->timestamp = reference->timestamp;
-    target->datatype = reference->datatype;
-    target->isNull = reference->isNull;
+bool unsubscribeTag(BasicTagSubscription* subscription, FunctionalBasicTag* tag) {
+  if (tag == NULL || !_subscription_valid(subscription)) return false;
+  _writer_lock();
+  _SUB_AND(tag->_subscribers, ~((uint32_t)1 << subscription->_id));
+  _subscription_clear(subscription, tag->_idx);
+  _writer_unlock();
+  return true;
+}
 
-    // If it's null there's nothing else to copy
-    if (reference->isNull) return;
+size_t subscribeTagsWithPrefix(BasicTagSubscription* subscription, const char* prefix) {
+  /*
+  Subscribes every tag whose name starts with prefix, returns the number subscribed.
+  The sorted array is walked with the writer lock held instead of in a read section: subscribing takes the lock,
+  which would deadlock against a writer waiting in _rcu_synchronize for this reader. Tags can't be deleted while
+  the lock is held, so the matches stay valid
+  */
+  if (prefix == NULL || !_subscription_valid(subscription)) return 0;
+  while (true) {
+    if (_TS_LOAD(_sorted_dirty) && !_rebuild_sorted_tags()) return 0;
+    _writer_lock();
+    if (!_sorted_dirty) break;  // A tag was created or deleted since the rebuild
+    _writer_unlock();
+  }
+  _SortedTags* sorted = _sorted_tags;
+  size_t prefix_length = strlen(prefix);
+  size_t subscribed = 0;
+  for (size_t i = _prefix_lower_bound(sorted->tags, sorted->count, prefix); i < sorted->count; i++) {
+    FunctionalBasicTag* tag = sorted->tags[i];
+    if (strncmp(tag->name, prefix, prefix_length) != 0) break;
+    if (_subscribe_tag(subscription, tag)) subscribed++;
+  }
+  _writer_unlock();
+  return subscribed;
+}
 
-    // Depending on the SparkplugDataType, handle the value copying
-    switch (reference->datatype) {
-      case spInt8:
-      case spInt16:
-      case spInt32:
-      case spInt64:
-      case spUInt8:
-      case spUInt16:
-      case spUInt32:
-      case spUInt64:
-      case spFloat:
-      case spDouble:
-      case spBoolean:
-      case spDateTime:
-        // For these types, direct assignment is fine
-        target->value = reference->value;
-        break;
-      case spText:  // Text is a string
-      case spUUID: // UUID is a string
-      case spString:
-        _copy_string_value(reference->value.stringValue, target->value.stringValue, buffer_value_max_len);
-        break;
-      case spBytes:
-        _copy_buffer_value(reference->value.bytesValue, target->value.bytesValue);
-        break;
-      default:
-        // For unknown types, you might not need to do anything
-        target->isNull = true;
-        break;
+size_t drainBasicTagSubscription(BasicTagSubscription* subscription, FunctionalBasicTag** tags, size_t max_tags) {
+  /*
+  Takes up to max_tags changed tags in index order and clears their bits, returns the number taken.
+  Tags that don't fit stay dirty for the next call
+  */
+  if (tags == NULL || !_subscription_valid(subscription)) return 0;
+  size_t taken = 0;
+  uint32_t token = beginBasicTagRead();
+  size_t tags_count = _TS_LOAD(_tags_count);
+  FunctionalBasicTag** tags_array = _TS_LOAD(_tags_array);
+  for (size_t w = 0; w < subscription->words && taken < max_tags; w++) {
+    if (subscription->dirty[w] == 0) continue;
+    uint32_t bits = _SUB_TAKE(subscription->dirty[w]);
+    while (bits != 0 && taken < max_tags) {
+      size_t idx = w * 32 + _lowest_bit(bits);
+      bits &= bits - 1;
+      if (idx < tags_count && tags_array[idx] != NULL) tags[taken++] = tags_array[idx];
     }
+    if (bits != 0) _SUB_OR(subscription->dirty[w], bits);  // Put back the ones that didn't fit
+  }
+  endBasicTagRead(token);
+  return taken;
+}
+
+size_t getBasicTagSubscriptionPending(BasicTagSubscription* subscription) {
+  // Number of dirty tags
+  if (subscription == NULL) return 0;
+  size_t pending = 0;
+  for (size_t w = 0; w < subscription->words; w++) {
+    for (uint32_t bits = subscription->dirty[w]; bits != 0; bits &= bits - 1) pending++;
+  }
+  return pending;
 }
 
 
 /* Tag read/write Functions */
 
-bool readBasicTag(FunctionalBasicTag* tag, uint64_t timestamp) {
+static bool _read_basic_tag(FunctionalBasicTag* tag, uint64_t timestamp, bool notify) {
+  // notify is false for the parallel scan, which calls onChange itself after the workers have finished
   if (tag == NULL) return false; // Safety check
   
   tag->lastRead = timestamp;
@@ -522,6 +3926,27 @@ bool readBasicTag(FunctionalBasicTag* tag, uint64_t timestamp) {
     return true;
   }
 
+  if (tag->_zero_copy) {
+    tag->valueChanged = _read_zero_copy_tag(tag, timestamp);
+    if (tag->valueChanged) _archive_change(tag);
+    _scan_plan_sync(tag);
+    if (tag->valueChanged && notify) _notify_change(tag);
+    return tag->valueChanged;
+  }
+  if (_writer_unchanged(tag)) {
+    tag->valueChanged = false;
+    _scan_plan_sync(tag);
+    return false;
+  }
+  bool is_string = tag->datatype == spString || tag->datatype == spText || tag->datatype == spUUID;
+  if (is_string && tag->compareFunc == DefaultCompareFn) {
+    tag->valueChanged = _read_string_tag(tag, timestamp);
+    if (tag->valueChanged) _archive_change(tag);
+    _scan_plan_sync(tag);
+    if (tag->valueChanged && notify) _notify_change(tag);
+    return tag->valueChanged;
+  }
+
   switch (tag->datatype) {
     case spInt8: // Handle Int8 type
         newValue.value.int8Value = *((int8_t*)(tag->value_address));
@@ -584,27 +4009,53 @@ bool readBasicTag(FunctionalBasicTag* tag, uint64_t timestamp) {
     valueChanged = tag->currentValue.isNull != newValue.isNull;
   } else if (tag->compareFunc != NULL) {
     // compare func, returns if the value should be considered changed or not (the compare Function handles any deadband, etc)
-    valueChanged = tag->compareFunc(&(tag->currentValue), &newValue);
+    _STATS_TIMED(tag, compare, valueChanged = tag->compareFunc(&(tag->currentValue), &newValue));
+  }
+  if (valueChanged && tag->currentValue.timestamp != 0 && !tag->currentValue.isNull && !newValue.isNull && _report_filtered(tag)) {
+    valueChanged = _report_allowed(tag, _value_as_double(&(newValue.value), tag->datatype), _value_as_double(&(tag->currentValue.value), tag->datatype), timestamp);
   }
   tag->valueChanged = valueChanged;
-  if (!valueChanged) return false;
+  if (!valueChanged) {
+    _scan_plan_sync(tag);
+    return false;
+  }
 
   // Update the current and previous values only if the value is considered changed
-  _copyBasicValue(&(tag->currentValue), &(tag->previousValue), tag->buffer_value_max_len);
+  bool first_read = tag->currentValue.timestamp == 0;
+  _seq_write_begin(tag);
+  if (tag->retain_previous) _copyBasicValue(&(tag->currentValue), &(tag->previousValue), tag->buffer_value_max_len);
   _copyBasicValue(&newValue, &(tag->currentValue), tag->buffer_value_max_len);
+  if (is_string && !tag->currentValue.isNull) tag->_str_len = (uint32_t)strlen(tag->currentValue.value.stringValue);  // Custom compareFunc, keep the cached length right
+  tag->changeMicros = _clock_now_us();
+  _seq_write_end(tag);
+  _archive_change(tag);
+  _scan_plan_sync(tag);
+  // A numeric tag moves to the fast path on the rebuild after its first timestamped read
+  if (first_read && tag->_scan_group == _SCAN_GROUP_NONE && _can_use_fast_path(tag)) _TS_STORE(_scan_plan_dirty, true);
 
-  if (tag->onChange != NULL) tag->onChange(tag);
+  if (notify) _notify_change(tag);
   return true;
 }
 
+bool readBasicTag(FunctionalBasicTag* tag, uint64_t timestamp) {
+  return _read_basic_tag(tag, timestamp, true);
+}
+
 bool writeBasicTag(FunctionalBasicTag* tag, BasicValue* newValue) {
   /* It is up to the user to validate if the write is remote or local.
   User must correctly set the newValue to match the datatype of the tag, otherwise errors can occur */
   if (tag->value_address == NULL) return false;
   if (!tag->local_writable && !tag->remote_writable) return false;
   // New in v1.3.0, validateWrite function
-  if (tag->validateWrite != NULL && !(tag->validateWrite(newValue))) return false;
+  if (tag->validateWrite != NULL && !(tag->validateWrite(newValue))) {
+    _STATS_WRITE_REJECTED();
+    return false;
+  }
+  return _write_value(tag, newValue);
+}
 
+static bool _write_value(FunctionalBasicTag* tag, BasicValue* newValue) {
+  // Writes newValue to value_address, the writable flags and validateWrite have been checked by the caller
   switch (tag->datatype) {
     case spInt8:
       *(int8_t*)(tag->value_address) = newValue->value.int8Value;
@@ -652,10 +4103,13 @@ bool writeBasicTag(FunctionalBasicTag* tag, BasicValue* newValue) {
       _copy_string_value(newValue->value.stringValue, (char*)(tag->value_address), tag->buffer_value_max_len);
       break;
     case spBytes:
+      if (tag->_zero_copy) return _write_zero_copy_tag(tag, newValue);
       // NULL checks
       if (newValue->isNull || newValue->value.bytesValue == NULL || newValue->value.bytesValue->buffer == NULL || newValue->value.bytesValue->allocated_length < 1 || newValue->value.bytesValue->written_length < 1) {
-        // set the value at tag->value_address to null according to the max length
-        memset(tag->value_address, 0x0, tag->buffer_value_max_len);
+        // v1.4.0 clear the buffer, not the BufferValue struct at value_address
+        BufferValue* target = (BufferValue*)(tag->value_address);
+        if (target->buffer != NULL) memset(target->buffer, 0x0, target->allocated_length);
+        target->written_length = 0;
         break;
       }
       _copy_buffer_value(newValue->value.bytesValue, (BufferValue*)(tag->value_address));
@@ -665,6 +4119,7 @@ bool writeBasicTag(FunctionalBasicTag* tag, BasicValue* newValue) {
       return false;
     }
 
+  if (tag->source != NULL) _source_store(tag);
   return true;
 }
 
@@ -680,17 +4135,19 @@ bool addOnChangeCallback(FunctionalBasicTag* tag, onValueChangeFunction callback
 }
 
 
-// Linked list functionality
+// Registry search functionality
 
 FunctionalBasicTag* findTag(TagFindFunction matcherFn, void* arg) {
-  /* Returns the first tag found for which the mathcherFn returns true */
-  if (_head == NULL || matcherFn == NULL) return NULL;  // If there are no tags return right away
-  FunctionalBasicTagNode* current = _head;
-  while (current != NULL) {
-      if (matcherFn(current->tag_ptr, arg)) return current->tag_ptr;
-      current = current->next_node;
+  /* Returns the first tag found for which the mathcherFn returns true, searching the most recently created first */
+  if (matcherFn == NULL) return NULL;
+  FunctionalBasicTag* found = NULL;
+  uint32_t token = _rcu_read_begin();
+  for (size_t i = _TS_LOAD(_tags_count); i > 0 && found == NULL; i--) {
+      FunctionalBasicTag* tag = _TS_LOAD(_tags_array)[i - 1];
+      if (tag != NULL && matcherFn(tag, arg)) found = tag;
   }
-  return NULL;
+  _rcu_read_end(token);
+  return found;
 }
 
 static bool _tag_has_alias(FunctionalBasicTag* tag, void* arg) {
@@ -698,18 +4155,30 @@ static bool _tag_has_alias(FunctionalBasicTag* tag, void* arg) {
 }
 
 bool aliasValid(int alias) {
-  return findTag(_tag_has_alias, (void*)&alias) == NULL;
+  // v1.4.0 uses the alias index when it is allocated, O(1) on average. Compact tags are in the same index
+  if (_TS_LOAD(_index_capacity) == 0) return getTagByAlias(alias) == NULL && getCompactTagByAlias(alias) == NULL;
+  return _index_lookup(false, _hash_alias(alias), NULL, false) == NULL;
 }
 
-int getNextAlias() {
-  if (_head == NULL) return 1;  // If there are no tags start aliases at 1
-  int max = 0;
-  FunctionalBasicTagNode* current = _head;
-  while (current != NULL) {
-      if (current->tag_ptr->alias > max) max = current->tag_ptr->alias;
-      current = current->next_node;
+static int _next_alias() {
+  // Writer lock held
+  if (_tags_count == 0) return _compact_max_alias + 1;  // If there are no tags start aliases at 1
+  if (_max_alias_stale) {
+    // Only needed after the tag with the max alias was deleted
+    _max_alias = 0;
+    for (size_t i = 0; i < _tags_count; i++) {
+        if (_tags_array[i]->alias > _max_alias) _max_alias = _tags_array[i]->alias;
+    }
+    _max_alias_stale = false;
   }
-  return max + 1;
+  return (_max_alias > _compact_max_alias ? _max_alias : _compact_max_alias) + 1;
+}
+
+int getNextAlias() {
+  _writer_lock();
+  int alias = _next_alias();
+  _writer_unlock();
+  return alias;
 }
 
 
@@ -719,22 +4188,43 @@ New Functions for Version 1.2.0
 
 static bool _tag_has_name(FunctionalBasicTag* tag, void* arg) {
   const char* tagName = (char*)arg;
-  return strcmp(tag->name, tagName) == 0;
+  return tag->name != NULL && strcmp(tag->name, tagName) == 0;
+}
+
+static void* _index_lookup(bool by_name, uint32_t hash, const char* name, bool compact) {
+  // Retries while a thread safe writer is changing the index, a single pass otherwise. The alias table holds both kinds
+  void* found = NULL;
+  uint32_t token = _rcu_read_begin();
+  uint32_t seq;
+  do {
+    seq = _registry_read_begin();
+    size_t capacity = _TS_LOAD(_index_capacity);
+    _TagIndexSlot* table = by_name ? _TS_LOAD(_name_index) : _TS_LOAD(_alias_index);
+    _TagIndexSlot* slot = capacity > 0 ? _index_find_slot(table, capacity, hash, name, compact) : NULL;
+    found = slot != NULL ? slot->tag : NULL;
+  } while (_registry_read_retry(seq));
+  _rcu_read_end(token);
+  return found;
 }
 
 FunctionalBasicTag* getTagByName(const char* name) {
   // Returns the first tag that has a given name
-  return findTag(_tag_has_name, (void*)name);
+  if (name == NULL) return NULL;
+  if (_TS_LOAD(_index_capacity) == 0) return findTag(_tag_has_name, (void*)name);  // No index allocated yet
+  return (FunctionalBasicTag*)_index_lookup(true, _hash_name(name), name, false);
 }
 
 FunctionalBasicTag* getTagByAlias(int alias) {
   // Returns the first tag that has a given alias
-  return findTag(_tag_has_alias, (void*)&alias);
+  if (_TS_LOAD(_static_table) != NULL) return _static_table_find_alias(alias);
+  if (_TS_LOAD(_index_capacity) == 0) return findTag(_tag_has_alias, (void*)&alias);  // No index allocated yet
+  void* entry = _index_lookup(false, _hash_alias(alias), NULL, false);
+  return entry != NULL && !_index_is_compact(entry) ? (FunctionalBasicTag*)entry : NULL;
 }
 
 FunctionalBasicTag* getTagByIdx(size_t idx) {
   // idx is bigger than arraylen
-  if (idx < _NodeCount) return _tags_array[idx];
+  if (idx < _TS_LOAD(_tags_count)) return _TS_LOAD(_tags_array)[idx];
   return NULL;
 }
 
@@ -743,32 +4233,743 @@ FunctionalBasicTag* getTagByIdx(size_t idx) {
 New Functions for Version 1.3.0
 */
 
+bool setCompareFunction(FunctionalBasicTag* tag, CompareFunction compareFn) {
+  // NULL means every read is considered a change. Changing compareFunc moves the tag in or out of the scan fast path
+  if (tag == NULL) return false;
+  tag->compareFunc = compareFn;
+  _TS_STORE(_scan_plan_dirty, true);
+  return true;
+}
+
 bool addValidateWriteCallback(FunctionalBasicTag* tag, ValidateWriteFunction callbackFn) {
   if (callbackFn == NULL || tag == NULL) return false;
   tag->validateWrite = callbackFn;
   return true;
 }
 
-static uint64_t _timestamp() {
-  if (_timestamp_function == NULL) return 0;
-  return _timestamp_function();
-}
-
 bool setBasicTagTimestampFunction(TimestampFunction fn) {
   if (fn == NULL) return false;
   _timestamp_function = fn;
+  return true;
+}
+
+static uint8_t* _plan_take(uint8_t** cursor, size_t size) {
+  // Every array starts on a cache line, see Parallel Scan
+  uint8_t* block = *cursor;
+  *cursor += BASIC_TAG_CACHE_ALIGN_UP(size);
+  return block;
+}
+
+static bool _rebuild_scan_plan() {
+  size_t counts[_SCAN_GROUP_COUNT] = {0};
+  size_t generic_count = 0;
+  // Cleared first, so a tag created while the plan is being built marks it dirty again
+  _TS_STORE(_scan_plan_dirty, false);
+  size_t tags_count = _TS_LOAD(_tags_count);
+  FunctionalBasicTag** tags_array = _TS_LOAD(_tags_array);
+
+  for (size_t i = 0; i < tags_count; i++) {
+    FunctionalBasicTag* tag = tags_array[i];
+    if (tag == NULL) continue;
+    tag->_scan_group = _SCAN_GROUP_NONE;
+    if (_can_use_fast_path(tag)) counts[_scan_group_index(tag->datatype)] += 1;
+    else generic_count += 1;
+  }
+
+  // Size all the arrays, then carve them from one block. The extra line is for aligning the start of the block
+  size_t size = BASIC_TAG_CACHE_LINE + BASIC_TAG_CACHE_ALIGN_UP(generic_count * sizeof(FunctionalBasicTag*));
+  for (uint8_t g = 0; g < _SCAN_GROUP_COUNT; g++) {
+    size += 2 * BASIC_TAG_CACHE_ALIGN_UP(counts[g] * sizeof(void*)) + BASIC_TAG_CACHE_ALIGN_UP(counts[g] * _scan_elem_sizes[g]) + BASIC_TAG_CACHE_ALIGN_UP(counts[g]);
+  }
+
+  uint8_t* memory = NULL;
+  if (_scan_plan_storage != NULL && size <= _scan_plan_storage_size) {
+    memory = _scan_plan_storage;
+  } else {
+    if (size > _scan_plan_memory_size) {
+      free(_scan_plan_memory);
+      _scan_plan_memory = malloc(size);
+      _scan_plan_memory_size = _scan_plan_memory != NULL ? size : 0;
+    }
+    memory = _scan_plan_memory;
+  }
+  if (memory == NULL && size > 0) {
+    _TS_STORE(_scan_plan_dirty, true);
+    return false;
+  }
+
+  uint8_t* cursor = memory + (BASIC_TAG_CACHE_LINE - (uintptr_t)memory % BASIC_TAG_CACHE_LINE) % BASIC_TAG_CACHE_LINE;
+  _scan_generic = (FunctionalBasicTag**)_plan_take(&cursor, generic_count * sizeof(FunctionalBasicTag*));
+  _scan_generic_count = 0;
+  for (uint8_t g = 0; g < _SCAN_GROUP_COUNT; g++) {
+    _ScanGroup* group = &(_scan_groups[g]);
+    group->count = 0;
+    group->addresses = (void**)_plan_take(&cursor, counts[g] * sizeof(void*));
+    group->tags = (FunctionalBasicTag**)_plan_take(&cursor, counts[g] * sizeof(FunctionalBasicTag*));
+    group->values = _plan_take(&cursor, counts[g] * _scan_elem_sizes[g]);
+    group->changed = _plan_take(&cursor, counts[g]);
+  }
+
+  for (size_t i = 0; i < tags_count; i++) {
+    FunctionalBasicTag* tag = tags_array[i];
+    if (tag == NULL) continue;
+    if (!_can_use_fast_path(tag)) {
+      _scan_generic[_scan_generic_count++] = tag;
+      continue;
+    }
+    uint8_t g = _scan_group_index(tag->datatype);
+    _ScanGroup* group = &(_scan_groups[g]);
+    size_t slot = group->count++;
+    group->datatype = tag->datatype;
+    group->elem_size = _scan_elem_sizes[g];
+    group->addresses[slot] = tag->value_address;
+    group->tags[slot] = tag;
+    group->changed[slot] = tag->valueChanged;
+    memcpy(group->values + slot * group->elem_size, &(tag->currentValue.value), group->elem_size);
+    tag->_scan_group = g;
+    tag->_scan_slot = slot;
+  }
+
+  return true;
+}
+
+/*
+Change Detection (v1.4.0)
+Compare up to 64 new values against the last values and return a bitmask of the ones that changed.
+8, 16 and 32 bit values use SSE2/AVX2 on x86 and 16/32 bit values use NEON on ARM when the compiler targets
+them, everything else (and targets without those, eg. Cortex-M or Xtensa) uses the scalar loop, which the
+compiler is free to auto-vectorize. Float compares use the same
+!= semantics as DefaultCompareFn, so NaN is always considered changed.
+*/
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define _BT_NEON 1
+#endif
+
+#define _SCAN_BLOCK 64
+
+#define _SCALAR_CHANGED_MASK(fn_name, ctype) \
+static inline uint64_t fn_name(const ctype* fresh, const ctype* values, size_t i, size_t n) { \
+  uint64_t mask = 0; \
+  for (; i < n; i++) mask |= (uint64_t)(fresh[i] != values[i]) << i; \
+  return mask; \
+}
+
+_SCALAR_CHANGED_MASK(_changed_mask_scalar_u8, uint8_t)
+_SCALAR_CHANGED_MASK(_changed_mask_scalar_u16, uint16_t)
+_SCALAR_CHANGED_MASK(_changed_mask_scalar_u32, uint32_t)
+_SCALAR_CHANGED_MASK(_changed_mask_scalar_f32, float)
+_SCALAR_CHANGED_MASK(_changed_mask_u64, uint64_t)
+_SCALAR_CHANGED_MASK(_changed_mask_f64, double)
+_SCALAR_CHANGED_MASK(_changed_mask_bool, bool)
+
+#if defined(_BT_NEON)
+static inline uint32_t _neon_mask_u32(uint32x4_t not_equal) {
+  // One bit per lane
+  static const uint32_t weights[4] = {1, 2, 4, 8};
+  uint32x4_t bits = vandq_u32(not_equal, vld1q_u32(weights));
+#if defined(__aarch64__)
+  return vaddvq_u32(bits);
+#else
+  uint32x2_t sum = vpadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+  return vget_lane_u32(vpadd_u32(sum, sum), 0);
+#endif
+}
+#endif
+
+static inline uint64_t _changed_mask_u8(const uint8_t* fresh, const uint8_t* values, size_t n) {
+  uint64_t mask = 0;
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(fresh + i)), _mm_loadu_si128((const __m128i*)(values + i)));
+    mask |= (uint64_t)(~_mm_movemask_epi8(equal) & 0xFFFF) << i;
+  }
+#endif
+  return mask | _changed_mask_scalar_u8(fresh, values, i, n);
+}
+
+static inline uint64_t _changed_mask_u16(const uint16_t* fresh, const uint16_t* values, size_t n) {
+  uint64_t mask = 0;
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 8 <= n; i += 8) {
+    __m128i equal = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(fresh + i)), _mm_loadu_si128((const __m128i*)(values + i)));
+    // Pack the 16 bit lanes to bytes so movemask gives one bit per value
+    equal = _mm_packs_epi16(equal, _mm_setzero_si128());
+    mask |= (uint64_t)(~_mm_movemask_epi8(equal) & 0xFF) << i;
+  }
+#elif defined(_BT_NEON)
+  for (; i + 4 <= n; i += 4) {
+    uint32x4_t a = vmovl_u16(vld1_u16(fresh + i));
+    uint32x4_t b = vmovl_u16(vld1_u16(values + i));
+    mask |= (uint64_t)_neon_mask_u32(vmvnq_u32(vceqq_u32(a, b))) << i;
+  }
+#endif
+  return mask | _changed_mask_scalar_u16(fresh, values, i, n);
+}
+
+static inline uint64_t _changed_mask_u32(const uint32_t* fresh, const uint32_t* values, size_t n) {
+  uint64_t mask = 0;
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 8 <= n; i += 8) {
+    __m256i equal = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(fresh + i)), _mm256_loadu_si256((const __m256i*)(values + i)));
+    mask |= (uint64_t)(~_mm256_movemask_ps(_mm256_castsi256_ps(equal)) & 0xFF) << i;
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 4 <= n; i += 4) {
+    __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(fresh + i)), _mm_loadu_si128((const __m128i*)(values + i)));
+    mask |= (uint64_t)(~_mm_movemask_ps(_mm_castsi128_ps(equal)) & 0xF) << i;
+  }
+#elif defined(_BT_NEON)
+  for (; i + 4 <= n; i += 4) {
+    uint32x4_t equal = vceqq_u32(vld1q_u32(fresh + i), vld1q_u32(values + i));
+    mask |= (uint64_t)_neon_mask_u32(vmvnq_u32(equal)) << i;
+  }
+#endif
+  return mask | _changed_mask_scalar_u32(fresh, values, i, n);
+}
+
+static inline uint64_t _changed_mask_f32(const float* fresh, const float* values, size_t n) {
+  uint64_t mask = 0;
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 8 <= n; i += 8) {
+    __m256 not_equal = _mm256_cmp_ps(_mm256_loadu_ps(fresh + i), _mm256_loadu_ps(values + i), _CMP_NEQ_UQ);
+    mask |= (uint64_t)_mm256_movemask_ps(not_equal) << i;
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 4 <= n; i += 4) {
+    __m128 not_equal = _mm_cmpneq_ps(_mm_loadu_ps(fresh + i), _mm_loadu_ps(values + i));
+    mask |= (uint64_t)_mm_movemask_ps(not_equal) << i;
+  }
+#elif defined(_BT_NEON)
+  for (; i + 4 <= n; i += 4) {
+    uint32x4_t equal = vceqq_f32(vld1q_f32(fresh + i), vld1q_f32(values + i));
+    mask |= (uint64_t)_neon_mask_u32(vmvnq_u32(equal)) << i;
+  }
+#endif
+  return mask | _changed_mask_scalar_f32(fresh, values, i, n);
+}
+
+static inline uint64_t _changed_mask_wide_u64(const uint64_t* fresh, const uint64_t* values, size_t n) {
+  return _changed_mask_u64(fresh, values, 0, n);
+}
+static inline uint64_t _changed_mask_wide_f64(const double* fresh, const double* values, size_t n) {
+  return _changed_mask_f64(fresh, values, 0, n);
+}
+static inline uint64_t _changed_mask_wide_bool(const bool* fresh, const bool* values, size_t n) {
+  return _changed_mask_bool(fresh, values, 0, n);
+}
+
+
+/*
+Scan Kernels (v1.4.0)
+One loop per datatype, generated by _SCAN_KERNEL. Loads, compares and copies are typed, so there is no
+datatype switch and no call through compareFunc (the fast path only has tags using DefaultCompareFn).
+Values are gathered into a block of up to 64, the change detection above gives a mask of the changed ones
+and only those are updated.
+*/
+
+static inline void _commit_fast_change(FunctionalBasicTag* tag, _ScanGroup* group, size_t i, _ScanContext* ctx) {
+  // The new value has already been stored, finish the update the same way readBasicTag does
+  uint64_t timestamp = _clock_now_ms();
+  tag->lastRead = timestamp;
+  tag->currentValue.timestamp = timestamp;
+  tag->changeMicros = _clock_now_us();
+  _seq_write_end(tag);  // Started by the kernel before previousValue was written
+  _archive_change(tag);
+  tag->valueChanged = true;
+  group->changed[i] = true;
+  if (ctx->deferred != NULL) {
+    ctx->deferred[ctx->deferred_count++] = tag;
+    return;
+  }
+  _notify_change(tag);
+  _scan_record_change(ctx, tag);
+}
+
+#define _SCAN_KERNEL(kernel_name, ctype, member, mask_type, mask_fn) \
+static void kernel_name(_ScanGroup* group, size_t begin, size_t end, _ScanContext* ctx) { \
+  ctype* values = (ctype*)(group->values); \
+  void** addresses = group->addresses; \
+  FunctionalBasicTag** tags = group->tags; \
+  uint64_t stamp = _clock_now_ms();  /* One timestamp for the group, lastRead stays current for every tag */ \
+  ctype fresh[_SCAN_BLOCK]; \
+  for (size_t base = begin; base < end; base += _SCAN_BLOCK) { \
+    size_t n = end - base < _SCAN_BLOCK ? end - base : _SCAN_BLOCK; \
+    for (size_t j = 0; j < n; j++) { \
+      if (group->changed[base + j]) { \
+        /* Changed on the previous scan, the flag is set every time the tag is read */ \
+        group->changed[base + j] = false; \
+        tags[base + j]->valueChanged = false; \
+      } \
+      tags[base + j]->lastRead = stamp; \
+      fresh[j] = *(ctype*)(addresses[base + j]); \
+    } \
+    uint64_t mask = mask_fn((const mask_type*)fresh, (const mask_type*)(values + base), n); \
+    while (mask != 0) { \
+      size_t i = base + _lowest_bit(mask); \
+      ctype newValue = fresh[i - base]; \
+      mask &= mask - 1; \
+      FunctionalBasicTag* tag = group->tags[i]; \
+      /* Held back by the deadband or report interval, values[i] keeps the last reported value */ \
+      if (_report_filtered(tag) && !_report_allowed(tag, (double)newValue, (double)values[i], _clock_now_ms())) continue; \
+      _seq_write_begin(tag); \
+      if (tag->retain_previous) tag->previousValue = tag->currentValue; \
+      tag->currentValue.value.member = newValue; \
+      values[i] = newValue; \
+      _commit_fast_change(tag, group, i, ctx); \
+    } \
+  } \
+}
+
+// Integers compare their raw bits, which is the same as comparing their values
+_SCAN_KERNEL(_scan_int8, int8_t, int8Value, uint8_t, _changed_mask_u8)
+_SCAN_KERNEL(_scan_int16, int16_t, int16Value, uint16_t, _changed_mask_u16)
+_SCAN_KERNEL(_scan_int32, int32_t, int32Value, uint32_t, _changed_mask_u32)
+_SCAN_KERNEL(_scan_int64, int64_t, int64Value, uint64_t, _changed_mask_wide_u64)
+_SCAN_KERNEL(_scan_uint8, uint8_t, uint8Value, uint8_t, _changed_mask_u8)
+_SCAN_KERNEL(_scan_uint16, uint16_t, uint16Value, uint16_t, _changed_mask_u16)
+_SCAN_KERNEL(_scan_uint32, uint32_t, uint32Value, uint32_t, _changed_mask_u32)
+_SCAN_KERNEL(_scan_uint64, uint64_t, uint64Value, uint64_t, _changed_mask_wide_u64)
+_SCAN_KERNEL(_scan_float, float, floatValue, float, _changed_mask_f32)
+_SCAN_KERNEL(_scan_double, double, doubleValue, double, _changed_mask_wide_f64)
+_SCAN_KERNEL(_scan_bool, bool, boolValue, bool, _changed_mask_wide_bool)
+
+typedef void (*_ScanKernel)(_ScanGroup* group, size_t begin, size_t end, _ScanContext* ctx);  // Scans slots begin..end - 1
+
+// In the order of _scan_group_index, DateTime is a uint64
+static const _ScanKernel _scan_kernels[_SCAN_GROUP_COUNT] = {
+  _scan_int8, _scan_int16, _scan_int32, _scan_int64,
+  _scan_uint8, _scan_uint16, _scan_uint32, _scan_uint64,
+  _scan_float, _scan_double, _scan_bool, _scan_uint64
+};
+
+static void _scan_all(_ScanContext* ctx) {
+  // The whole scan is one read section, tags deleted meanwhile stay valid until it ends
+  _STATS_SCAN_BEGIN(ctx);
+  uint32_t token = _rcu_read_begin();
+  _fetch_sources();
+  bool use_plan = !_TS_LOAD(_scan_plan_dirty) || _rebuild_scan_plan();
+  bool per_group = _clock_mode == BASIC_TAG_CLOCK_PER_GROUP;
+  _clock_sample(_clock_mode != BASIC_TAG_CLOCK_PER_TAG);
+
+  if (!use_plan) {
+    // Plan couldn't be allocated, read every tag directly
+    size_t tags_count = _TS_LOAD(_tags_count);
+    FunctionalBasicTag** tags_array = _TS_LOAD(_tags_array);
+    for (size_t i = 0; i < tags_count; i++) {
+      FunctionalBasicTag* currentTag = tags_array[i];
+      if (currentTag != NULL && readBasicTag(currentTag, _clock_now_ms())) _scan_record_change(ctx, currentTag);
+    }
+    _clock_sample(false);
+    _rcu_read_end(token);
+    _STATS_SCAN_END(ctx);
+    return;
+  }
+
+  bool sampled = true;  // The first group uses the sample taken for the scan
+  for (uint8_t g = 0; g < _SCAN_GROUP_COUNT; g++) {
+    if (_scan_groups[g].count == 0) continue;
+    if (per_group && !sampled) _clock_sample(true);
+    sampled = false;
+    _scan_kernels[g](&(_scan_groups[g]), 0, _scan_groups[g].count, ctx);
+  }
+  if (per_group && !sampled && _scan_generic_count > 0) _clock_sample(true);
+  for (size_t i = 0; i < _scan_generic_count; i++) {
+    FunctionalBasicTag* currentTag = _scan_generic[i];
+    if (readBasicTag(currentTag, _clock_now_ms())) _scan_record_change(ctx, currentTag);
+  }
+  _clock_sample(false);
+  _rcu_read_end(token);
+  _STATS_SCAN_END(ctx);
 }
 
 bool readAllBasicTags() {
-  bool valuesChanged = false;
-  for (size_t i = 0; i < getTagsCount(); i++) {
-    FunctionalBasicTag* currentTag = getTagByIdx(i);
-    if (readBasicTag(currentTag, _timestamp())) {
-      // Ignore tag changes for aliases below -1000
-      if (currentTag->alias > -1000) valuesChanged = true;
+  _ScanContext ctx = {NULL, 0, NULL, 0, 0, NULL, 0};
+  _scan_all(&ctx);
+  // v1.4.0 compact tags are read too. They have no registry index, so the Changed / Bitmap variants read them
+  // without counting them, the changes are left in their flags (see encodeSparkplugCompactData)
+  bool compact_changed = _compact_count > 0 && readAllCompactTags();
+  return ctx.count > 0 || compact_changed;
+}
+
+size_t readAllBasicTagsChanged(size_t* changed_indexes, size_t max_changes) {
+  // Returns the number of reportable changes, only the first max_changes indexes are written if there are more
+  _ScanContext ctx = {changed_indexes, changed_indexes != NULL ? max_changes : 0, NULL, 0, 0, NULL, 0};
+  _scan_all(&ctx);
+  if (_compact_count > 0) readAllCompactTags();
+  return ctx.count;
+}
+
+size_t readAllBasicTagsBitmap(uint32_t* bitmap, size_t bitmap_words) {
+  // Bit idx % 32 of word idx / 32 is set for each reportable change, returns the number of changes
+  if (bitmap != NULL) memset(bitmap, 0, bitmap_words * sizeof(uint32_t));
+  _ScanContext ctx = {NULL, 0, bitmap, bitmap != NULL ? bitmap_words : 0, 0, NULL, 0};
+  _scan_all(&ctx);
+  if (_compact_count > 0) readAllCompactTags();
+  return ctx.count;
+}
+
+
+/*
+Parallel Scan (v1.4.0)
+readAllBasicTagsParallel splits the scan plan between worker threads. The groups and the generic list are laid
+end to end, each padded to a multiple of _SCAN_BLOCK slots, and every worker gets a contiguous range starting on
+a block boundary. Every array of the plan starts on a BASIC_TAG_CACHE_LINE boundary and a block of 64 slots is a
+whole number of lines for every element size, so no two workers write to the same cache line of the hot arrays.
+Workers collect their changed tags instead of reporting them, each in its own cache line aligned slice. Once they have all finished, the calling thread
+calls onChange and builds the changed list in partition order, which is the order readAllBasicTags uses.
+Workers are pthreads on Linux/macOS and FreeRTOS tasks on ESP32, other targets run the partitions in turn.
+The workers are started for each call, which costs tens of microseconds per worker (more on FreeRTOS), so the
+parallel scan only pays off when a partition takes clearly longer than that, ie. tens of thousands of fast path
+tags. Below that readAllBasicTags is faster.
+*/
+
+#define _DEFERRED_PER_LINE (BASIC_TAG_CACHE_LINE / sizeof(FunctionalBasicTag*) > 0 ? BASIC_TAG_CACHE_LINE / sizeof(FunctionalBasicTag*) : 1)
+
+#ifndef BASIC_TAG_MAX_WORKERS
+#define BASIC_TAG_MAX_WORKERS 16
+#endif
+
+#ifndef BASIC_TAG_WORKER_STACK_SIZE
+#define BASIC_TAG_WORKER_STACK_SIZE 4096  // FreeRTOS worker task stack
+#endif
+
+#if defined(BASIC_TAG_NO_THREADS)
+#define _BT_WORKERS_INLINE
+#elif defined(ESP_PLATFORM)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#define _BT_WORKERS_FREERTOS
+#elif defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define _BT_WORKERS_PTHREAD
+#else
+#define _BT_WORKERS_INLINE
+#endif
+
+typedef struct {
+  size_t begin;  // Range in the padded slot space
+  size_t end;
+  FunctionalBasicTag** deferred;
+  size_t deferred_count;
+  bool started;
+#if defined(_BT_WORKERS_PTHREAD)
+  pthread_t thread;
+#elif defined(_BT_WORKERS_FREERTOS)
+  SemaphoreHandle_t done;
+#endif
+} _ScanWorker;
+
+static FunctionalBasicTag** _parallel_deferred = NULL;  // One slot per tag, shared out between the workers
+static size_t _parallel_deferred_capacity = 0;
+
+static size_t _padded_count(size_t count) {
+  return (count + _SCAN_BLOCK - 1) / _SCAN_BLOCK * _SCAN_BLOCK;
+}
+
+static size_t _range_tag_count(size_t range_begin, size_t range_end) {
+  // Number of real (not padding) slots in a range of the padded slot space
+  size_t count = 0;
+  size_t offset = 0;
+  for (uint8_t g = 0; g <= _SCAN_GROUP_COUNT; g++) {
+    size_t group_count = g < _SCAN_GROUP_COUNT ? _scan_groups[g].count : _scan_generic_count;
+    size_t begin = range_begin > offset ? range_begin - offset : 0;
+    size_t end = range_end > offset ? (range_end - offset < group_count ? range_end - offset : group_count) : 0;
+    if (begin < end) count += end - begin;
+    offset += _padded_count(group_count);
+  }
+  return count;
+}
+
+static void _scan_partition(_ScanWorker* worker) {
+  _ScanContext ctx = {NULL, 0, NULL, 0, 0, worker->deferred, 0};
+  size_t offset = 0;
+  for (uint8_t g = 0; g < _SCAN_GROUP_COUNT && offset < worker->end; g++) {
+    _ScanGroup* group = &(_scan_groups[g]);
+    size_t begin = worker->begin > offset ? worker->begin - offset : 0;
+    size_t end = worker->end - offset < group->count ? worker->end - offset : group->count;
+    if (begin < end) _scan_kernels[g](group, begin, end, &ctx);
+    offset += _padded_count(group->count);
+  }
+  if (worker->end > offset) {
+    size_t begin = worker->begin > offset ? worker->begin - offset : 0;
+    size_t end = worker->end - offset < _scan_generic_count ? worker->end - offset : _scan_generic_count;
+    for (size_t i = begin; i < end; i++) {
+      FunctionalBasicTag* tag = _scan_generic[i];
+      if (_read_basic_tag(tag, _clock_now_ms(), false)) ctx.deferred[ctx.deferred_count++] = tag;
+    }
+  }
+  worker->deferred_count = ctx.deferred_count;
+}
+
+#if defined(_BT_WORKERS_PTHREAD)
+static void* _scan_worker_main(void* arg) {
+  _scan_partition((_ScanWorker*)arg);
+  return NULL;
+}
+
+static bool _scan_worker_start(_ScanWorker* worker) {
+  return pthread_create(&(worker->thread), NULL, _scan_worker_main, worker) == 0;
+}
+
+static void _scan_worker_join(_ScanWorker* worker) {
+  pthread_join(worker->thread, NULL);
+}
+#elif defined(_BT_WORKERS_FREERTOS)
+static void _scan_worker_main(void* arg) {
+  _ScanWorker* worker = (_ScanWorker*)arg;
+  _scan_partition(worker);
+  xSemaphoreGive(worker->done);
+  vTaskDelete(NULL);
+}
+
+static bool _scan_worker_start(_ScanWorker* worker) {
+  worker->done = xSemaphoreCreateBinary();
+  if (worker->done == NULL) return false;
+  if (xTaskCreate(_scan_worker_main, "BasicTagScan", BASIC_TAG_WORKER_STACK_SIZE, worker, uxTaskPriorityGet(NULL), NULL) == pdPASS) return true;
+  vSemaphoreDelete(worker->done);
+  return false;
+}
+
+static void _scan_worker_join(_ScanWorker* worker) {
+  xSemaphoreTake(worker->done, portMAX_DELAY);
+  vSemaphoreDelete(worker->done);
+}
+#else
+static bool _scan_worker_start(_ScanWorker* worker) {
+  (void)worker;
+  return false;  // Run by the calling thread
+}
+
+static void _scan_worker_join(_ScanWorker* worker) {
+  (void)worker;
+}
+#endif
+
+static void _scan_parallel(unsigned int workers, _ScanContext* ctx) {
+  if (workers > BASIC_TAG_MAX_WORKERS) workers = BASIC_TAG_MAX_WORKERS;
+  uint32_t token = _rcu_read_begin();
+  if (workers <= 1 || (_TS_LOAD(_scan_plan_dirty) && !_rebuild_scan_plan())) {
+    // _scan_all reads every tag directly if the plan couldn't be allocated
+    _rcu_read_end(token);
+    _scan_all(ctx);
+    return;
+  }
+  _STATS_SCAN_BEGIN(ctx);  // A fallback below is recorded by _scan_all instead
+  _fetch_sources();  // Once on the calling thread, before the workers start
+  size_t slots = 0;
+  size_t tags_in_plan = _scan_generic_count;
+  for (uint8_t g = 0; g < _SCAN_GROUP_COUNT; g++) {
+    slots += _padded_count(_scan_groups[g].count);
+    tags_in_plan += _scan_groups[g].count;
+  }
+  slots += _padded_count(_scan_generic_count);
+  // Each worker's slice is rounded up to whole cache lines, plus a line to align the start
+  size_t deferred_needed = tags_in_plan + (workers + 1) * _DEFERRED_PER_LINE;
+  if (deferred_needed > _parallel_deferred_capacity) {
+    free(_parallel_deferred);
+    _parallel_deferred = (FunctionalBasicTag**)malloc(deferred_needed * sizeof(FunctionalBasicTag*));
+    _parallel_deferred_capacity = _parallel_deferred != NULL ? deferred_needed : 0;
+    if (_parallel_deferred == NULL) {
+      _rcu_read_end(token);
+      _scan_all(ctx);
+      return;
+    }
+  }
+
+  // The clock is only sampled here, workers never call the timestamp function
+  _clock_sample(true);
+
+  _ScanWorker pool[BASIC_TAG_MAX_WORKERS];
+  size_t per_worker = _padded_count((slots + workers - 1) / workers);
+  size_t deferred_offset = (BASIC_TAG_CACHE_LINE - (uintptr_t)_parallel_deferred % BASIC_TAG_CACHE_LINE) % BASIC_TAG_CACHE_LINE / sizeof(FunctionalBasicTag*);
+  for (unsigned int w = 0; w < workers; w++) {
+    pool[w].begin = w * per_worker < slots ? w * per_worker : slots;
+    pool[w].end = pool[w].begin + per_worker < slots ? pool[w].begin + per_worker : slots;
+    // A range can never change more tags than it holds
+    pool[w].deferred = _parallel_deferred + deferred_offset;
+    pool[w].deferred_count = 0;
+    deferred_offset += (_range_tag_count(pool[w].begin, pool[w].end) + _DEFERRED_PER_LINE - 1) / _DEFERRED_PER_LINE * _DEFERRED_PER_LINE;
+  }
+  // The calling thread scans the first partition
+  for (unsigned int w = 1; w < workers; w++) {
+    pool[w].started = pool[w].begin < pool[w].end && _scan_worker_start(&(pool[w]));
+  }
+  _scan_partition(&(pool[0]));
+  for (unsigned int w = 1; w < workers; w++) {
+    if (pool[w].started) _scan_worker_join(&(pool[w]));
+    else if (pool[w].begin < pool[w].end) _scan_partition(&(pool[w]));
+  }
+  _clock_sample(false);
+
+  // Deferred onChange callbacks and the changed list, in partition order
+  for (unsigned int w = 0; w < workers; w++) {
+    for (size_t i = 0; i < pool[w].deferred_count; i++) {
+      FunctionalBasicTag* tag = pool[w].deferred[i];
+      _notify_change(tag);
+      _scan_record_change(ctx, tag);
+    }
+  }
+  _rcu_read_end(token);
+  _STATS_SCAN_END(ctx);
+}
+
+bool readAllBasicTagsParallel(unsigned int workers) {
+  _ScanContext ctx = {NULL, 0, NULL, 0, 0, NULL, 0};
+  _scan_parallel(workers, &ctx);
+  bool compact_changed = _compact_count > 0 && readAllCompactTags();  // On the calling thread
+  return ctx.count > 0 || compact_changed;
+}
+
+size_t readAllBasicTagsParallelChanged(unsigned int workers, size_t* changed_indexes, size_t max_changes) {
+  _ScanContext ctx = {changed_indexes, changed_indexes != NULL ? max_changes : 0, NULL, 0, 0, NULL, 0};
+  _scan_parallel(workers, &ctx);
+  if (_compact_count > 0) readAllCompactTags();
+  return ctx.count;
+}
+
+
+/*
+Deadline Scheduler (v1.4.0)
+A min-heap of (deadline, tag) for readDueBasicTags, so a call only costs O(due tags * log n). Due tags are
+popped to the end of the heap array, read, then pushed back with their next deadline. The heap is rebuilt
+from getTagLastRead + scan_period after tags are created or deleted, or a scan period is changed.
+*/
+
+typedef struct {
+  uint64_t deadline;
+  FunctionalBasicTag* tag;
+} _ScheduleEntry;
+
+static _ScheduleEntry* _schedule = NULL;
+static size_t _schedule_count = 0;
+static size_t _schedule_capacity = 0;
+
+static void _schedule_sift_down(size_t pos, size_t count) {
+  _ScheduleEntry entry = _schedule[pos];
+  while (true) {
+    size_t child = 2 * pos + 1;
+    if (child >= count) break;
+    if (child + 1 < count && _schedule[child + 1].deadline < _schedule[child].deadline) child++;
+    if (_schedule[child].deadline >= entry.deadline) break;
+    _schedule[pos] = _schedule[child];
+    pos = child;
+  }
+  _schedule[pos] = entry;
+}
+
+static void _schedule_sift_up(size_t pos) {
+  _ScheduleEntry entry = _schedule[pos];
+  while (pos > 0) {
+    size_t parent = (pos - 1) / 2;
+    if (_schedule[parent].deadline <= entry.deadline) break;
+    _schedule[pos] = _schedule[parent];
+    pos = parent;
+  }
+  _schedule[pos] = entry;
+}
+
+static bool _rebuild_schedule() {
+  _TS_STORE(_schedule_dirty, false);
+  size_t tags_count = _TS_LOAD(_tags_count);
+  FunctionalBasicTag** tags_array = _TS_LOAD(_tags_array);
+  if (tags_count > _schedule_capacity) {
+    _ScheduleEntry* grown = realloc(_schedule, tags_count * sizeof(_ScheduleEntry));
+    if (grown == NULL) {
+      _TS_STORE(_schedule_dirty, true);
+      return false;
     }
+    _schedule = grown;
+    _schedule_capacity = tags_count;
+  }
+  _schedule_count = 0;
+  for (size_t i = 0; i < tags_count; i++) {
+    FunctionalBasicTag* tag = tags_array[i];
+    if (tag == NULL) continue;
+    uint64_t last_read = getTagLastRead(tag);
+    // Never read tags are due straight away
+    _schedule[_schedule_count].deadline = last_read == 0 ? 0 : last_read + tag->scan_period;
+    _schedule[_schedule_count].tag = tag;
+    _schedule_count++;
+  }
+  for (size_t i = _schedule_count / 2; i > 0; i--) _schedule_sift_down(i - 1, _schedule_count);
+  return true;
+}
+
+static void _read_due(uint64_t now, _ScanContext* ctx) {
+  _STATS_SCAN_BEGIN(ctx);
+  uint32_t token = _rcu_read_begin();
+  if (_TS_LOAD(_schedule_dirty) && !_rebuild_schedule()) {
+    _rcu_read_end(token);
+    _STATS_SCAN_END(ctx);  // Recorded as a scan that read nothing
+    return;
+  }
+
+  // Pop every due tag to the end of the array
+  size_t heap_count = _schedule_count;
+  while (heap_count > 0 && _schedule[0].deadline <= now) {
+    heap_count--;
+    _ScheduleEntry due = _schedule[0];
+    _schedule[0] = _schedule[heap_count];
+    _schedule[heap_count] = due;
+    _schedule_sift_down(0, heap_count);
+  }
+
+  // Read them and push them back with their next deadline. now is passed to every read, the sample is for changeMicros
+  _clock_sample(_clock_mode != BASIC_TAG_CLOCK_PER_TAG);
+  _source_stamp++;
+  for (size_t i = heap_count; i < _schedule_count; i++) {
+    FunctionalBasicTag* tag = _schedule[i].tag;
+    _fetch_tag_source(tag);
+    if (readBasicTag(tag, now)) _scan_record_change(ctx, tag);
+    _schedule[i].deadline = now + tag->scan_period;
+    _schedule_sift_up(i);
   }
-  return valuesChanged;
+  _clock_sample(false);
+  _rcu_read_end(token);
+  _STATS_SCAN_END(ctx);
+}
+
+bool setTagScanPeriod(FunctionalBasicTag* tag, uint32_t scan_period) {
+  if (tag == NULL) return false;
+  tag->scan_period = scan_period;
+  _TS_STORE(_schedule_dirty, true);
+  return true;
+}
+
+bool readDueBasicTags(uint64_t now) {
+  _ScanContext ctx = {NULL, 0, NULL, 0, 0, NULL, 0};
+  _read_due(now, &ctx);
+  return ctx.count > 0;
+}
+
+size_t readDueBasicTagsChanged(uint64_t now, size_t* changed_indexes, size_t max_changes) {
+  _ScanContext ctx = {changed_indexes, changed_indexes != NULL ? max_changes : 0, NULL, 0, 0, NULL, 0};
+  _read_due(now, &ctx);
+  return ctx.count;
+}
+
+uint64_t getNextBasicTagDeadline() {
+  // Earliest deadline of all tags, UINT64_MAX when there are no tags
+  uint32_t token = _rcu_read_begin();
+  uint64_t deadline = 0;
+  if (!_TS_LOAD(_schedule_dirty) || _rebuild_schedule()) deadline = _schedule_count > 0 ? _schedule[0].deadline : UINT64_MAX;
+  _rcu_read_end(token);
+  return deadline;
 }
 
 
@@ -776,7 +4977,7 @@ bool readAllBasicTags() {
 
 bool allocateStringValue(BasicValue* value, size_t max_str_length) {
   if (value == NULL) return false;
-  _init_string_value(&(value->value), max_str_length);
+  return _init_string_value(&(value->value), max_str_length);
 }
 bool deallocateStringValue(BasicValue* value) {
   if (value == NULL) return false;
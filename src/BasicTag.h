@@ -29,9 +29,22 @@ extern "C" {
 /* Data structures definitions */
 
 typedef uint64_t (*TimestampFunction)();  // Function that returns a uint64_t millisecond timestamp
+typedef uint64_t (*MicrosFunction)();  // New in v1.4.0, optional monotonic microsecond clock (e.g. micros()) used for changeMicros
+
+typedef enum {
+  BASIC_TAG_CLOCK_PER_TAG = 0,  // Default, readAllBasicTags calls the timestamp function for every tag
+  BASIC_TAG_CLOCK_PER_SCAN = 1,  // The clocks are sampled once per readAllBasicTags / readDueBasicTags call
+  BASIC_TAG_CLOCK_PER_GROUP = 2  // The clocks are sampled once per datatype group of the scan
+} BasicTagClockMode;  // New in v1.4.0
 
 typedef struct FunctionalBasicTag FunctionalBasicTag; // Forward declaration
 
+typedef enum {
+  BASIC_TAG_DEADBAND_NONE = 0,
+  BASIC_TAG_DEADBAND_ABSOLUTE = 1,  // Report when the value moves more than deadband from the last reported value
+  BASIC_TAG_DEADBAND_PERCENT = 2  // Same, deadband is a percentage of the last reported value
+} BasicTagDeadbandMode;  // New in v1.4.0
+
 typedef enum {
   // Indexes of Data Types matching the Sparkplug 3 specification
   // Unimplemented Datatypes are commented out
@@ -84,6 +97,13 @@ typedef struct {
   size_t allocated_length;
 } BufferValue;  // Size 12 bytes + length of buffer
 
+// New in v1.4.0, a producer owned bytes value referenced by a zero copy bytes tag, see createZeroCopyBytesTag
+typedef struct {
+  BufferValue buffers[2];  // Ping-pong buffers, buffers[1].buffer is NULL for a single buffer written in place
+  uint32_t generation;  // Bumped by publishBasicTagBytes
+  uint8_t active;  // Index of the buffer the tag reads
+} BasicTagBytesSource;
+
 
 // Union to accommodate various data types
 typedef union {
@@ -115,6 +135,103 @@ typedef bool (*CompareFunction)(BasicValue* previousValue, BasicValue* newValue)
 typedef void (*onValueChangeFunction)(FunctionalBasicTag* tag);  // Optional function that can be registered for a tag that is triggered be read, when the value has changed. Called after tag values have been updated, before returning
 typedef bool (*ValidateWriteFunction)(BasicValue* newValue);
 
+// New in v1.4.0, CompactBasicTag flags
+#define BASIC_TAG_COMPACT_LOCAL_WRITABLE 0x01
+#define BASIC_TAG_COMPACT_REMOTE_WRITABLE 0x02
+#define BASIC_TAG_COMPACT_VALUE_CHANGED 0x04
+#define BASIC_TAG_COMPACT_IS_NULL 0x08
+#define BASIC_TAG_COMPACT_HAS_CALLBACKS 0x10  // Has an entry in the callback side table
+
+// New in v1.4.0, a small tag for numeric and boolean values on memory constrained boards, see createCompactTag
+typedef struct {
+  const char* name;
+  void* value_address;
+  Value value;  // Current value, stored inline
+  uint32_t timestamp;  // Milliseconds since the compact tag epoch, see getCompactTagTimestamp
+  int16_t alias;
+  uint8_t datatype;  // SparkplugDataType, 0 for a free slot
+  uint8_t flags;  // BASIC_TAG_COMPACT_ flags
+} CompactBasicTag;  // Size is 24 bytes (32 bytes on 64 bit)
+
+typedef void (*CompactTagFunction)(CompactBasicTag* tag);
+
+// New in v1.4.0, a ring of past values in caller supplied storage, see attachTagHistory
+typedef struct {
+  uint8_t* buffer;
+  uint32_t size;
+  uint32_t head;  // Offset of the oldest record
+  uint32_t used;  // Bytes in use
+  uint32_t count;  // Records in the ring
+  uint32_t dropped;  // Records dropped to make room before they were drained
+  uint64_t first_timestamp;  // Timestamp of the oldest record
+  uint64_t last_timestamp;  // Timestamp of the newest record
+} BasicTagHistory;
+
+// New in v1.4.0, compressed history of a numeric tag in caller supplied blocks, see attachTagSeries
+typedef struct {
+  uint8_t* storage;
+  uint32_t block_size;
+  uint32_t block_count;
+  uint32_t first_block;  // Oldest block
+  uint32_t blocks_used;
+  uint32_t samples;  // Samples in the blocks
+  uint32_t dropped;  // Samples lost when the oldest block was reused
+  uint64_t last_timestamp;  // Encoder state for the newest block
+  int64_t last_delta;
+  uint64_t last_value;
+  uint8_t last_leading;
+  uint8_t last_trailing;
+  uint8_t width;  // Bits of the value, 8 to 64
+} BasicTagSeries;
+
+#ifdef BASIC_TAG_ENABLE_STATS
+// New in v1.4.0, scan and callback counters, see getBasicTagStats. Times are in micros function units
+typedef struct {
+  uint32_t scans;  // readAllBasicTags*, readAllBasicTagsParallel* and readDueBasicTags* calls
+  uint32_t scan_last_us;
+  uint32_t scan_min_us;
+  uint32_t scan_max_us;
+  uint32_t scan_avg_us;
+  uint64_t scan_total_us;
+  uint32_t changes_last_scan;  // Reportable changes
+  uint32_t changes_max_scan;
+  uint64_t changes_total;
+  uint64_t compare_total_us;  // compareFunc calls of the generic read path, the typed scan kernels compare inline
+  uint32_t compare_calls;
+  uint64_t onchange_total_us;
+  uint32_t onchange_calls;
+  uint32_t callback_max_us;  // Longest compareFunc or onChange call
+  int callback_max_alias;  // Alias of the tag that made it
+  uint32_t write_rejections;  // Writes refused by validateWrite
+} BasicTagStats;
+#endif
+
+// New in v1.4.0, a consumer's own record of the tags that changed since it last drained them, see createBasicTagSubscription
+typedef struct {
+  uint32_t* dirty;  // Bit idx % 32 of word idx / 32 for each changed tag
+  size_t words;
+  uint8_t _id;
+} BasicTagSubscription;
+
+// New in v1.4.0, fetches length bytes at offset into data (block + offset), or stores them for writes. Returns false on a bus error
+typedef bool (*BasicTagSourceFunction)(void* arg, uint8_t* data, size_t offset, size_t length);
+
+// New in v1.4.0, a block of memory shared by a group of tags, fetched once per scan, see createSourceTag
+typedef struct BasicTagSource {
+  uint8_t* block;
+  size_t size;
+  BasicTagSourceFunction fetch;  // NULL for memory that is read in place (DMA, mmap)
+  BasicTagSourceFunction store;  // Optional, called after a write to one of the tags
+  void* arg;
+  uint32_t fetches;
+  uint32_t errors;  // Failed fetches and stores
+  size_t tags;  // Number of tags using the source
+  size_t _fetch_start;  // Span of the block used by the tags, managed internally
+  size_t _fetch_end;
+  uint32_t _stamp;
+  struct BasicTagSource* _next;
+} BasicTagSource;
+
 struct FunctionalBasicTag {
   const char* name;
   int alias;
@@ -123,6 +240,7 @@ struct FunctionalBasicTag {
   bool remote_writable;
   bool valueChanged;  // Set every time read is called
   uint64_t lastRead;
+  uint64_t changeMicros;  // New addition for v1.4.0, micros function value when the value last changed, 0 without a micros function
   size_t buffer_value_max_len;
   SparkplugDataType datatype;
   BasicValue currentValue;
@@ -131,14 +249,169 @@ struct FunctionalBasicTag {
   onValueChangeFunction onChange;
   ValidateWriteFunction validateWrite;  // New addition for v1.3.0
   /*void* _extra_data; // New addition for v1.3.0 Unsure if this will be added or not */
-};  // Size is 112 bytes + bytes / char values
+  size_t _idx;  // New addition for v1.4.0, index in the tag registry (getTagByIdx), managed internally
+  uint32_t _scan_slot;  // New addition for v1.4.0, position in the readAllBasicTags scan plan, managed internally
+  uint32_t scan_period;  // New addition for v1.4.0, milliseconds between reads for readDueBasicTags, set with setTagScanPeriod
+  uint32_t _seq;  // New addition for v1.4.0, odd while currentValue / previousValue are being written, see snapshotTagValue
+  uint32_t min_report_interval;  // New addition for v1.4.0, set with setTagMinReportInterval
+  uint32_t _str_len;  // New addition for v1.4.0, length of the current string value, managed internally
+  double deadband;  // New addition for v1.4.0, set with setTagDeadband
+  uint32_t _write_gen;  // New addition for v1.4.0, bumped by notifyBasicTagWrite
+  uint32_t _read_gen;  // New addition for v1.4.0, _write_gen when the tag was last read
+  BasicTagHistory* history;  // New addition for v1.4.0, set with attachTagHistory
+  BasicTagSeries* series;  // New addition for v1.4.0, set with attachTagSeries
+  BasicTagSource* source;  // New addition for v1.4.0, set for tags created with createSourceTag
+  uint32_t _subscribers;  // New addition for v1.4.0, bit per BasicTagSubscription the tag is in, managed internally
+#ifdef BASIC_TAG_ENABLE_STATS
+  uint32_t stats_compare_max_us;  // New addition for v1.4.0, longest compareFunc call
+  uint32_t stats_onchange_max_us;  // New addition for v1.4.0, longest onChange call
+#endif
+  uint8_t deadband_mode;  // New addition for v1.4.0, BasicTagDeadbandMode
+  uint8_t _scan_group;
+  uint8_t _queued;  // New addition for v1.4.0, set while a change event for the tag is in a BASIC_TAG_QUEUE_COALESCE queue
+  bool writer_notifies;  // New addition for v1.4.0, set with setTagWriterNotifies
+  uint8_t _zero_copy;  // New addition for v1.4.0, set for tags created with createZeroCopyBytesTag
+  bool retain_previous;  // New addition for v1.4.0, previousValue is kept up to date, set with setTagRetainPrevious
+};  // Size is 184 bytes on 32 bit targets (240 on 64 bit) + bytes / char values
 
 
 typedef struct {
   FunctionalBasicTag* tag_ptr;
   void* next_node;
   // void* previous_node; TODO implement later
-} FunctionalBasicTagNode;  // Linked List Wrapper for FunctionalBasicTag
+} FunctionalBasicTagNode;  // Linked List Wrapper for FunctionalBasicTag. No longer used internally since v1.4.0, kept for source compatibility
+
+
+typedef struct {
+  const char* name;
+  void* value_address;
+  int alias;
+  SparkplugDataType datatype;
+  bool local_writable;
+  bool remote_writable;
+  size_t buffer_value_max_len;
+} BasicTagDefinition;  // New in v1.4.0, arguments of createTag as a struct, used by createTagsBatch
+
+
+typedef struct {
+  uint8_t* buffer;  // Caller supplied memory, aligned by initBasicTagArena
+  size_t capacity;
+  size_t used;  // Bytes carved so far, only reclaimed when the most recent block is freed
+  size_t high_water;  // Max value of used, use this to size the arena
+  size_t allocations;  // Number of live blocks carved from this arena
+  size_t failed_allocations;
+} BasicTagArena;  // New in v1.4.0, bump allocator for tags and values
+
+
+typedef struct {
+  size_t allocations;  // Live blocks allocated by the library (heap and arena)
+  size_t total_allocations;  // Blocks allocated since startup
+  size_t bytes_in_use;  // Including the per block header
+  size_t high_water;  // Max value of bytes_in_use
+  size_t failed_allocations;
+} BasicTagAllocStats;  // New in v1.4.0, counts tag and value allocations, the registry and index are not included
+
+
+typedef struct {
+  BasicTagDefinition definition;
+  void* storage;  // RAM block for the tag and its values, BASIC_TAG_STATIC_STORAGE_SIZE bytes, 8 byte aligned
+} BasicTagStaticDescriptor;  // New in v1.4.0
+
+
+typedef struct {
+  const BasicTagStaticDescriptor* descriptors;
+  size_t count;
+  FunctionalBasicTag** tags;  // count entries, used as the registry array
+  FunctionalBasicTag** alias_lookup;  // count entries, tags sorted by alias, set by registerStaticTagTable
+  int min_alias;
+  bool dense_aliases;  // Aliases are min_alias..min_alias + count - 1, getTagByAlias is a direct index
+  void* scan_plan;  // BASIC_TAG_SCAN_PLAN_SIZE(count) bytes, used by readAllBasicTags so it never allocates
+  size_t scan_plan_size;
+} BasicTagStaticTable;  // New in v1.4.0, declare with BASIC_TAG_STATIC_TABLE
+
+
+typedef enum {
+  BASIC_TAG_QUEUE_COALESCE = 0,  // At most one event per tag is queued, onChange sees the latest value
+  BASIC_TAG_QUEUE_DROP_OLDEST = 1,  // When full the oldest event is dropped
+  BASIC_TAG_QUEUE_BLOCK = 2  // When full the scan waits for another task to dispatch
+} BasicTagQueuePolicy;  // New in v1.4.0
+
+typedef struct {
+  FunctionalBasicTag* tag;
+  uint64_t timestamp;  // Value timestamp when the change was queued
+} BasicTagChangeEvent;  // New in v1.4.0
+
+typedef struct {
+  BasicTagChangeEvent* events;  // capacity entries
+  uint32_t capacity;
+  uint32_t head;  // Managed internally
+  uint32_t tail;  // Managed internally
+  BasicTagQueuePolicy policy;
+  uint32_t dropped;  // Events lost to a full queue
+  uint32_t coalesced;  // Changes merged into an event that was already queued
+} BasicTagChangeQueue;  // New in v1.4.0, deferred onChange dispatch, see setBasicTagChangeQueue
+
+
+/*
+Static Tag Table Macros (v1.4.0)
+Storage sizes match what createTag allocates, so the same tag can come from the heap, an arena or a static table
+*/
+
+#define BASIC_TAG_ALIGN 8
+#define BASIC_TAG_ALIGN_UP(size) (((size) + BASIC_TAG_ALIGN - 1) & ~((size_t)BASIC_TAG_ALIGN - 1))
+
+// Storage for one value (current or previous) of a tag, strings are max length + 1, bytes are a BufferValue and its buffer
+#define BASIC_TAG_VALUE_STORAGE_SIZE(datatype, max_len) \
+  ((datatype) == spUUID ? BASIC_TAG_ALIGN_UP(37) : \
+  ((datatype) == spString || (datatype) == spText) ? ((max_len) > 0 ? BASIC_TAG_ALIGN_UP((size_t)(max_len) + 1) : 0) : \
+  (datatype) == spBytes ? BASIC_TAG_ALIGN_UP(sizeof(BufferValue)) + BASIC_TAG_ALIGN_UP((size_t)(max_len)) : 0)
+
+// Each scan plan array starts on a cache line so parallel scan workers never share one. Only targets with worker
+// threads pay for the padding, define BASIC_TAG_CACHE_LINE to override
+#ifndef BASIC_TAG_CACHE_LINE
+#if !defined(BASIC_TAG_NO_THREADS) && (defined(__unix__) || defined(__APPLE__) || defined(ESP_PLATFORM))
+#define BASIC_TAG_CACHE_LINE 64
+#else
+#define BASIC_TAG_CACHE_LINE BASIC_TAG_ALIGN
+#endif
+#endif
+#define BASIC_TAG_CACHE_ALIGN_UP(size) (((size) + BASIC_TAG_CACHE_LINE - 1) & ~((size_t)BASIC_TAG_CACHE_LINE - 1))
+
+// Memory needed by the readAllBasicTags scan plan for count tags, see setBasicTagScanPlanStorage
+// The padding covers the start of the block and the 49 arrays of the plan (generic list and 4 per scan group)
+#define BASIC_TAG_SCAN_PLAN_SIZE(count) ((size_t)(count) * (2 * sizeof(void*) + sizeof(uint64_t) + 1) + 50 * BASIC_TAG_CACHE_LINE)
+
+// Storage for a tag and both of its values
+#define BASIC_TAG_STATIC_STORAGE_SIZE(datatype, max_len) \
+  (BASIC_TAG_ALIGN_UP(sizeof(FunctionalBasicTag)) + 2 * BASIC_TAG_VALUE_STORAGE_SIZE(datatype, max_len))
+
+/*
+Declares a static tag table from an X macro list, each entry is:
+  TAG(id, name, value_address, alias, datatype, local_writable, remote_writable, buffer_value_max_len)
+eg.
+  #define MY_TAGS(TAG) \
+    TAG(motorCurrent, "Motor1/Current", &current, 1, spFloat, false, false, 0) \
+    TAG(firmware, "Firmware", firmwareVersion, 2, spString, false, false, 32)
+  BASIC_TAG_STATIC_TABLE(myTags, MY_TAGS);
+  registerStaticTagTable(&myTags);
+BASIC_TAG_STATIC_TAG(id) is the FunctionalBasicTag* of an entry, valid once the table is registered
+*/
+#define BASIC_TAG_STATIC_TAG(id) ((FunctionalBasicTag*)(void*)(id##_basic_tag_storage))
+
+#define _BASIC_TAG_STATIC_STORAGE(id, name, value_address, alias, datatype, local_writable, remote_writable, max_len) \
+  static uint64_t id##_basic_tag_storage[BASIC_TAG_STATIC_STORAGE_SIZE(datatype, max_len) / sizeof(uint64_t)];
+
+#define _BASIC_TAG_STATIC_DESCRIPTOR(id, name, value_address, alias, datatype, local_writable, remote_writable, max_len) \
+  { { name, (void*)(value_address), alias, datatype, local_writable, remote_writable, max_len }, (void*)(id##_basic_tag_storage) },
+
+#define BASIC_TAG_STATIC_TABLE(table, TAG_LIST) \
+  TAG_LIST(_BASIC_TAG_STATIC_STORAGE) \
+  static const BasicTagStaticDescriptor table##_descriptors[] = { TAG_LIST(_BASIC_TAG_STATIC_DESCRIPTOR) }; \
+  static FunctionalBasicTag* table##_tags[sizeof(table##_descriptors) / sizeof(BasicTagStaticDescriptor)]; \
+  static FunctionalBasicTag* table##_alias_lookup[sizeof(table##_descriptors) / sizeof(BasicTagStaticDescriptor)]; \
+  static uint64_t table##_scan_plan[BASIC_TAG_SCAN_PLAN_SIZE(sizeof(table##_descriptors) / sizeof(BasicTagStaticDescriptor)) / sizeof(uint64_t)]; \
+  BasicTagStaticTable table = { table##_descriptors, sizeof(table##_descriptors) / sizeof(BasicTagStaticDescriptor), table##_tags, table##_alias_lookup, 0, false, \
+    table##_scan_plan, sizeof(table##_scan_plan) }
 
 
 /* Functions definitions */
@@ -194,8 +467,8 @@ bool addOnChangeCallback(FunctionalBasicTag* tag, onValueChangeFunction callback
 typedef bool (*TagFindFunction)(FunctionalBasicTag* tag, void* arg); // Returns true if the tag matches a certain criterea set out in the function
 FunctionalBasicTag* findTag(TagFindFunction matcherFn, void* arg); // Returns pointer to first tag for which the matcherFn returns true, returns NULL of no match found
 
-bool aliasValid(int alias); // Iterate through tags, check if alias has already been used or not
-int getNextAlias(); // Iterate through tags, get the max alias and return max_alias + 1
+bool aliasValid(int alias); // Check if alias has already been used or not, O(1) using the alias index since v1.4.0
+int getNextAlias(); // Get the max alias and return max_alias + 1, the max alias is tracked by the registry since v1.4.0
 
 /*
 New Functions for Version 1.2.0
@@ -214,6 +487,8 @@ bool addValidateWriteCallback(FunctionalBasicTag* tag, ValidateWriteFunction cal
 
 
 bool setBasicTagTimestampFunction(TimestampFunction fn);
+bool setBasicTagMicrosFunction(MicrosFunction fn);  // New in v1.4.0
+bool setBasicTagClockMode(BasicTagClockMode mode);  // New in v1.4.0
 
 bool readAllBasicTags(); // Read all tags, return if true if any values have changed, otherwise false
 
@@ -224,6 +499,146 @@ bool deallocateStringValue(BasicValue* value);
 bool allocateBufferValue(BasicValue* value, size_t buffer_size);
 bool deallocateBufferValue(BasicValue* value);
 
+/*
+New Functions for Version 1.4.0
+*/
+
+// Scan plan used by readAllBasicTags, numeric tags are read from dense per datatype arrays
+bool setCompareFunction(FunctionalBasicTag* tag, CompareFunction compareFn);  // Use this instead of setting compareFunc directly, so the scan plan is updated
+void invalidateBasicTagScanPlan();  // Call after changing compareFunc or value_address of a tag directly
+bool setBasicTagScanPlanStorage(void* buffer, size_t size);  // Static memory for the scan plan (BASIC_TAG_SCAN_PLAN_SIZE), NULL to use the heap
+uint64_t getTagLastRead(FunctionalBasicTag* tag);  // Timestamp the tag was last read, same as tag->lastRead
+
+// Read all tags and report which changed, only changes of tags with an alias above -1000 are reported. Both return the number of changes
+size_t readAllBasicTagsChanged(size_t* changed_indexes, size_t max_changes);  // Fills changed_indexes with getTagByIdx indexes, up to max_changes
+size_t readAllBasicTagsBitmap(uint32_t* bitmap, size_t bitmap_words);  // Clears and sets bit idx % 32 of bitmap[idx / 32] for each changed tag
+
+// Report by exception without a custom compare function, numeric tags only. Runs in the readAllBasicTags fast path
+bool setTagDeadband(FunctionalBasicTag* tag, BasicTagDeadbandMode mode, double deadband);
+bool setTagMinReportInterval(FunctionalBasicTag* tag, uint32_t min_report_interval);  // Milliseconds between reported changes
+
+// Writer notifies mode for string / bytes tags, the value is only compared after the application calls notifyBasicTagWrite
+bool setTagWriterNotifies(FunctionalBasicTag* tag, bool writer_notifies);
+bool notifyBasicTagWrite(FunctionalBasicTag* tag);  // Call after changing the value, safe from another task
+
+// Zero copy bytes tags, the tag references the producer's buffers and changes are detected by generation
+bool initBasicTagBytesSource(BasicTagBytesSource* source, uint8_t* buffer_a, uint8_t* buffer_b, size_t buffer_size);  // buffer_b is optional
+BufferValue* beginBasicTagBytesWrite(BasicTagBytesSource* source);  // The buffer to write the next value into
+bool publishBasicTagBytes(BasicTagBytesSource* source);  // Makes the written buffer the tag's value
+FunctionalBasicTag* createZeroCopyBytesTag(const char* name, BasicTagBytesSource* source, int alias, bool local_writable, bool remote_writable, bool keep_previous);
+
+// Skip storing and updating previousValue, setBasicTagRetainPrevious applies to tags created after the call
+bool setBasicTagRetainPrevious(bool retain_previous);
+bool setTagRetainPrevious(FunctionalBasicTag* tag, bool retain_previous);
+
+// Tag history, every change is appended to the ring, oldest records are dropped when it is full. String / bytes content of the
+// copied values goes in storage
+bool attachTagHistory(FunctionalBasicTag* tag, BasicTagHistory* history, void* storage, size_t storage_size);  // NULL history detaches
+size_t drainTagHistory(FunctionalBasicTag* tag, BasicValue* values, size_t max_values, void* storage, size_t storage_size);  // Oldest first, removes them
+size_t peekTagHistory(FunctionalBasicTag* tag, BasicValue* values, size_t max_values, void* storage, size_t storage_size);  // Same without removing
+size_t getTagHistoryCount(FunctionalBasicTag* tag);
+
+// Compressed series, delta-of-delta timestamps and XOR'd values in blocks of block_size bytes. Numeric and boolean tags
+bool attachTagSeries(FunctionalBasicTag* tag, BasicTagSeries* series, void* storage, size_t storage_size, size_t block_size);  // NULL series detaches
+size_t readTagSeries(FunctionalBasicTag* tag, uint64_t from, uint64_t to, BasicValue* values, size_t max_values);  // Samples from <= timestamp <= to, oldest first
+
+// Name prefixes, tags whose names start with a prefix (eg. "Motor1/") in name order, and interned names
+size_t iterTagsWithPrefix(const char* prefix, TagFunction tagFn);  // Returns the number of tags, tagFn may delete the tag it is given
+size_t getTagsWithPrefix(const char* prefix, FunctionalBasicTag** tags, size_t max_tags);  // Returns the number of matches, writes the first max_tags
+const char* internBasicTagName(const char* name);  // Pooled copy of name, the same pointer for the same name. NULL if out of memory
+void setBasicTagInternNames(bool intern);  // createTag interns every name, so names can be built in temporary buffers
+size_t getInternedNamesSize();  // Bytes used by interned names
+
+#ifdef BASIC_TAG_ENABLE_STATS
+// Scan statistics, compiled in with BASIC_TAG_ENABLE_STATS. The durations need setBasicTagMicrosFunction
+bool getBasicTagStats(BasicTagStats* stats);
+void resetBasicTagStats();
+size_t createBasicTagStatsTags();  // Creates UInt32 tags for the main counters at aliases -1001 to -1008
+#endif
+
+// Subscriptions, up to 32 consumers each draining the changes of their tags independently
+#define BASIC_TAG_MAX_SUBSCRIPTIONS 32  // One bit of FunctionalBasicTag._subscribers each
+bool createBasicTagSubscription(BasicTagSubscription* subscription, uint32_t* dirty, size_t words);  // words * 32 tag indexes
+bool deleteBasicTagSubscription(BasicTagSubscription* subscription);
+bool subscribeTag(BasicTagSubscription* subscription, FunctionalBasicTag* tag);  // Marked dirty straight away if it has been read
+bool unsubscribeTag(BasicTagSubscription* subscription, FunctionalBasicTag* tag);
+size_t subscribeTagsWithPrefix(BasicTagSubscription* subscription, const char* prefix);  // Returns the number subscribed
+size_t drainBasicTagSubscription(BasicTagSubscription* subscription, FunctionalBasicTag** tags, size_t max_tags);  // Takes up to max_tags changed tags
+size_t getBasicTagSubscriptionPending(BasicTagSubscription* subscription);
+
+// Value sources, groups of tags in one block of memory that is fetched once per scan (register images, DMA buffers, mmap)
+bool initBasicTagSource(BasicTagSource* source, void* block, size_t size, BasicTagSourceFunction fetch, BasicTagSourceFunction store, void* arg);
+FunctionalBasicTag* createSourceTag(const char* name, BasicTagSource* source, size_t offset, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable, size_t buffer_value_max_len);
+bool fetchBasicTagSources();  // The scans call it, only needed before readBasicTag. Returns false if a fetch failed
+
+// Snapshots of the tag definitions and values for a warm start, a CRC-32 protected binary image (see the README)
+typedef void* (*BasicTagAddressFunction)(const char* name, int alias, SparkplugDataType datatype, void* arg);  // Returns the value address for a restored tag, NULL to skip it
+size_t saveBasicTagSnapshot(uint8_t* buffer, size_t capacity);  // Returns the length, 0 if it doesn't fit. NULL buffer returns the size needed
+size_t restoreBasicTagSnapshot(const uint8_t* data, size_t length, BasicTagAddressFunction resolve, void* arg);  // Creates the tags, data must stay valid as long as they do
+size_t restoreBasicTagValues(const uint8_t* data, size_t length);  // Values of existing tags only, matched by name and datatype
+uint32_t basicTagCrc32(const void* data, size_t length, uint32_t crc);  // CRC-32 (IEEE), crc is 0 or the result of the previous chunk
+
+// Writes from the network (eg. DCMD), the tag must be remote_writable and the value's datatype must match
+#define BASIC_TAG_WRITE_ATOMIC 0x01  // Check every entry first, write nothing if any fails
+#define BASIC_TAG_WRITE_REREAD 0x02  // Read the written tags straight away, onChange fires before returning
+bool writeBasicTagRemote(FunctionalBasicTag* tag, BasicValue* newValue);
+size_t writeBasicTagsBatch(const int* aliases, BasicValue* values, size_t n, bool* results, uint8_t options);  // Returns the number written
+
+// Compact tags, numeric and boolean only, stored in an array supplied with setCompactTagStorage. Included in scans,
+// batch writes, snapshots and Sparkplug births, not in readDueBasicTags, subscriptions, the change queue or history
+bool setCompactTagStorage(CompactBasicTag* storage, size_t capacity);  // Only before the first compact tag is created
+CompactBasicTag* createCompactTag(const char* name, void* value_address, int alias, SparkplugDataType datatype, bool local_writable, bool remote_writable);
+bool deleteCompactTag(CompactBasicTag* tag);  // The slot is reused once no reader can still hold the tag
+bool readCompactTag(CompactBasicTag* tag, uint64_t timestamp);  // Returns true if the value changed
+bool readAllCompactTags();  // Every readAllBasicTags* variant reads the compact tags as well, the counts and indexes are FunctionalBasicTags only
+bool writeCompactTag(CompactBasicTag* tag, BasicValue* newValue);
+bool getCompactTagValue(CompactBasicTag* tag, BasicValue* value);  // Expanded value with the absolute timestamp
+uint64_t getCompactTagTimestamp(CompactBasicTag* tag);
+CompactBasicTag* getCompactTagByName(const char* name);
+CompactBasicTag* getCompactTagByAlias(int alias);
+size_t getCompactTagsCount();
+size_t getCompactTagsCapacity();
+CompactBasicTag* getCompactTagBySlot(size_t slot);  // slot < getCompactTagsCapacity(), NULL for a free slot
+void iterCompactTags(CompactTagFunction tagFn);
+bool addCompactOnChangeCallback(CompactBasicTag* tag, CompactTagFunction callbackFn);
+bool addCompactValidateWriteCallback(CompactBasicTag* tag, ValidateWriteFunction callbackFn);
+
+// Parallel scan, the scan plan is split between worker threads (pthreads, or FreeRTOS tasks on ESP32). onChange is called after the workers finish
+bool readAllBasicTagsParallel(unsigned int workers);  // Returns true if any values have changed
+size_t readAllBasicTagsParallelChanged(unsigned int workers, size_t* changed_indexes, size_t max_changes);  // Same order as readAllBasicTagsChanged
+
+// Scan classes, readDueBasicTags only reads the tags whose scan period has elapsed. now is the millisecond timestamp used for the reads
+bool setTagScanPeriod(FunctionalBasicTag* tag, uint32_t scan_period);  // 0 (default) reads the tag on every readDueBasicTags call
+bool readDueBasicTags(uint64_t now);  // Returns true if any values have changed
+size_t readDueBasicTagsChanged(uint64_t now, size_t* changed_indexes, size_t max_changes);  // Same as readAllBasicTagsChanged for the due tags
+uint64_t getNextBasicTagDeadline();  // When the next tag is due, UINT64_MAX if there are no tags
+
+// Consistent copy of currentValue for readers on another core or task, never blocks the scan. storage holds string / bytes content
+bool snapshotTagValue(FunctionalBasicTag* tag, BasicValue* snapshot, void* storage, size_t storage_size);  // storage_size from BASIC_TAG_VALUE_STORAGE_SIZE
+uint32_t getTagValueVersion(FunctionalBasicTag* tag);  // Increases on every write of the values, not only on changes
+
+// Change queue, onChange is called by dispatchBasicTagChanges instead of during the read
+bool initBasicTagChangeQueue(BasicTagChangeQueue* queue, BasicTagChangeEvent* events, uint32_t capacity, BasicTagQueuePolicy policy);
+bool setBasicTagChangeQueue(BasicTagChangeQueue* queue);  // NULL to go back to calling onChange during the read, the previous queue is dispatched
+size_t dispatchBasicTagChanges(size_t max_events);  // 0 dispatches everything queued, returns the number dispatched
+bool popBasicTagChange(BasicTagChangeEvent* event);  // Takes the oldest event without calling onChange
+
+// Thread safe registry, only needed when built with BASIC_TAG_THREAD_SAFE (no-ops otherwise)
+uint32_t beginBasicTagRead();  // Tags looked up before endBasicTagRead stay valid even if another task deletes them
+void endBasicTagRead(uint32_t token);
+bool reclaimBasicTagMemory();  // Frees deleted tags and old arrays no reader is using, returns true when nothing is left
+
+size_t createTagsBatch(const BasicTagDefinition* definitions, size_t count, FunctionalBasicTag** tags_out); // Create a tag per definition, returns number created. tags_out is optional
+// Arena allocation, each tag and its value storage is a single block carved from the arena
+bool initBasicTagArena(BasicTagArena* arena, void* buffer, size_t capacity);
+bool setBasicTagArena(BasicTagArena* arena);  // Use the arena for all following allocations, NULL to go back to malloc
+BasicTagArena* getBasicTagArena();
+bool getBasicTagAllocStats(BasicTagAllocStats* stats);
+
+bool registerStaticTagTable(BasicTagStaticTable* table);  // Use a static table as the registry, only allowed when no tags exist. Never allocates
+
+bool reserveTags(size_t count); // Grow the tag registry and hash index to hold at least count tags, so creating them never reallocates or rehashes
+
 #ifdef __cplusplus
 }
 #endif
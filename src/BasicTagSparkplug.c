@@ -0,0 +1,323 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "BasicTagSparkplug.h"
+
+/*
+Protobuf writer
+Every metric is written twice: once with a NULL buffer to measure it, so its length prefix can be written
+first, then for real. Measuring is only arithmetic, the value itself is only copied once.
+*/
+
+// Sparkplug B Payload and Metric field numbers
+#define _SP_PAYLOAD_TIMESTAMP 1
+#define _SP_PAYLOAD_METRICS 2
+#define _SP_PAYLOAD_SEQ 3
+#define _SP_METRIC_NAME 1
+#define _SP_METRIC_ALIAS 2
+#define _SP_METRIC_TIMESTAMP 3
+#define _SP_METRIC_DATATYPE 4
+#define _SP_METRIC_IS_NULL 7
+#define _SP_METRIC_INT_VALUE 10
+#define _SP_METRIC_LONG_VALUE 11
+#define _SP_METRIC_FLOAT_VALUE 12
+#define _SP_METRIC_DOUBLE_VALUE 13
+#define _SP_METRIC_BOOLEAN_VALUE 14
+#define _SP_METRIC_STRING_VALUE 15
+#define _SP_METRIC_BYTES_VALUE 16
+
+// Protobuf wire types
+#define _SP_VARINT 0
+#define _SP_FIXED64 1
+#define _SP_LEN 2
+#define _SP_FIXED32 5
+
+typedef struct {
+  uint8_t* buffer;  // NULL when measuring
+  size_t capacity;
+  size_t length;
+  bool overflow;
+} _SpWriter;
+
+static void _sp_write(_SpWriter* w, const void* data, size_t size) {
+  if (w->buffer != NULL) {
+    if (w->overflow || w->length + size > w->capacity) {
+      w->overflow = true;
+      return;
+    }
+    memcpy(w->buffer + w->length, data, size);
+  }
+  w->length += size;
+}
+
+static size_t _sp_varint_size(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static void _sp_varint(_SpWriter* w, uint64_t value) {
+  uint8_t bytes[10];
+  size_t n = 0;
+  while (value >= 0x80) {
+    bytes[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  bytes[n++] = (uint8_t)value;
+  _sp_write(w, bytes, n);
+}
+
+static void _sp_key(_SpWriter* w, uint32_t field, uint8_t wire_type) {
+  _sp_varint(w, ((uint64_t)field << 3) | wire_type);
+}
+
+static void _sp_fixed(_SpWriter* w, uint64_t value, size_t size) {
+  // Little endian regardless of the target
+  uint8_t bytes[8];
+  for (size_t i = 0; i < size; i++) bytes[i] = (uint8_t)(value >> (8 * i));
+  _sp_write(w, bytes, size);
+}
+
+static void _sp_len(_SpWriter* w, uint32_t field, const void* data, size_t size) {
+  _sp_key(w, field, _SP_LEN);
+  _sp_varint(w, size);
+  _sp_write(w, data, size);
+}
+
+static void _sp_value(_SpWriter* w, BasicValue* value) {
+  // Signed values up to 32 bits are sign extended into int_value, same as the Sparkplug reference implementations
+  uint32_t bits32;
+  uint64_t bits64;
+  switch (value->datatype) {
+    case spInt8:
+      _sp_key(w, _SP_METRIC_INT_VALUE, _SP_VARINT);
+      _sp_varint(w, (uint32_t)(int32_t)value->value.int8Value);
+      break;
+    case spInt16:
+      _sp_key(w, _SP_METRIC_INT_VALUE, _SP_VARINT);
+      _sp_varint(w, (uint32_t)(int32_t)value->value.int16Value);
+      break;
+    case spInt32:
+      _sp_key(w, _SP_METRIC_INT_VALUE, _SP_VARINT);
+      _sp_varint(w, (uint32_t)value->value.int32Value);
+      break;
+    case spUInt8:
+      _sp_key(w, _SP_METRIC_INT_VALUE, _SP_VARINT);
+      _sp_varint(w, value->value.uint8Value);
+      break;
+    case spUInt16:
+      _sp_key(w, _SP_METRIC_INT_VALUE, _SP_VARINT);
+      _sp_varint(w, value->value.uint16Value);
+      break;
+    case spUInt32:
+      _sp_key(w, _SP_METRIC_INT_VALUE, _SP_VARINT);
+      _sp_varint(w, value->value.uint32Value);
+      break;
+    case spInt64:
+      _sp_key(w, _SP_METRIC_LONG_VALUE, _SP_VARINT);
+      _sp_varint(w, (uint64_t)value->value.int64Value);
+      break;
+    case spDateTime:
+    case spUInt64:
+      _sp_key(w, _SP_METRIC_LONG_VALUE, _SP_VARINT);
+      _sp_varint(w, value->value.uint64Value);
+      break;
+    case spFloat:
+      memcpy(&bits32, &(value->value.floatValue), sizeof(bits32));
+      _sp_key(w, _SP_METRIC_FLOAT_VALUE, _SP_FIXED32);
+      _sp_fixed(w, bits32, 4);
+      break;
+    case spDouble:
+      memcpy(&bits64, &(value->value.doubleValue), sizeof(bits64));
+      _sp_key(w, _SP_METRIC_DOUBLE_VALUE, _SP_FIXED64);
+      _sp_fixed(w, bits64, 8);
+      break;
+    case spBoolean:
+      _sp_key(w, _SP_METRIC_BOOLEAN_VALUE, _SP_VARINT);
+      _sp_varint(w, value->value.boolValue ? 1 : 0);
+      break;
+    case spText:
+    case spUUID:
+    case spString:
+      _sp_len(w, _SP_METRIC_STRING_VALUE, value->value.stringValue, strlen(value->value.stringValue));
+      break;
+    case spBytes:
+      _sp_len(w, _SP_METRIC_BYTES_VALUE, value->value.bytesValue->buffer, value->value.bytesValue->written_length);
+      break;
+    default:
+      break;
+  }
+}
+
+static void _sp_metric_body(_SpWriter* w, const char* name, int alias, BasicValue* value, bool birth) {
+  // Aliases below 0 should never be used (see Alias Namespace), those metrics are always sent by name
+  bool use_alias = alias >= 0;
+  if ((birth || !use_alias) && name != NULL) _sp_len(w, _SP_METRIC_NAME, name, strlen(name));
+  if (use_alias) {
+    _sp_key(w, _SP_METRIC_ALIAS, _SP_VARINT);
+    _sp_varint(w, (uint64_t)alias);
+  }
+  if (value->timestamp != 0) {
+    _sp_key(w, _SP_METRIC_TIMESTAMP, _SP_VARINT);
+    _sp_varint(w, value->timestamp);
+  }
+  if (birth) {
+    _sp_key(w, _SP_METRIC_DATATYPE, _SP_VARINT);
+    _sp_varint(w, (uint32_t)value->datatype);
+  }
+  if (value->isNull) {
+    _sp_key(w, _SP_METRIC_IS_NULL, _SP_VARINT);
+    _sp_varint(w, 1);
+    return;
+  }
+  _sp_value(w, value);
+}
+
+static bool _sp_metric(_SpWriter* w, const char* name, int alias, BasicValue* value, bool birth) {
+  // Writes the metric only if all of it fits, returns false (leaving w unchanged) otherwise
+  _SpWriter measure = {NULL, 0, 0, false};
+  _sp_metric_body(&measure, name, alias, value, birth);
+  size_t total = 1 + _sp_varint_size(measure.length) + measure.length;
+  if (w->buffer != NULL && w->length + total > w->capacity) return false;
+  _sp_key(w, _SP_PAYLOAD_METRICS, _SP_LEN);
+  _sp_varint(w, measure.length);
+  _sp_metric_body(w, name, alias, value, birth);
+  return true;
+}
+
+static bool _sp_tag_metric(_SpWriter* w, FunctionalBasicTag* tag, bool birth) {
+  BasicValue value = tag->currentValue;
+  value.datatype = tag->datatype;
+  return _sp_metric(w, tag->name, tag->alias, &value, birth);
+}
+
+static bool _sp_compact_metric(_SpWriter* w, CompactBasicTag* tag, bool birth) {
+  // The compact value expanded to a BasicValue with its absolute timestamp
+  BasicValue value;
+  if (!getCompactTagValue(tag, &value)) return true;  // Deleted since it was looked up, nothing to send
+  return _sp_metric(w, tag->name, tag->alias, &value, birth);
+}
+
+static bool _sp_header(_SpWriter* w, uint64_t timestamp, uint64_t seq) {
+  _sp_key(w, _SP_PAYLOAD_TIMESTAMP, _SP_VARINT);
+  _sp_varint(w, timestamp);
+  _sp_key(w, _SP_PAYLOAD_SEQ, _SP_VARINT);
+  _sp_varint(w, seq);
+  return !w->overflow;
+}
+
+
+/*
+Payload Functions
+*/
+
+size_t encodeSparkplugBirth(uint8_t* buffer, size_t capacity, uint64_t timestamp, uint64_t seq) {
+  _SpWriter w = {buffer, capacity, 0, false};
+  if (!_sp_header(&w, timestamp, seq)) return 0;
+
+  uint32_t token = beginBasicTagRead();
+  size_t count = getTagsCount();
+  bool complete = true;
+  for (size_t i = 0; i < count && complete; i++) {
+    FunctionalBasicTag* tag = getTagByIdx(i);
+    if (tag != NULL) complete = _sp_tag_metric(&w, tag, true);
+  }
+  // Compact tags are part of the birth too, they share the alias namespace
+  size_t slots = getCompactTagsCapacity();
+  for (size_t slot = 0; slot < slots && complete; slot++) {
+    CompactBasicTag* tag = getCompactTagBySlot(slot);
+    if (tag != NULL) complete = _sp_compact_metric(&w, tag, true);
+  }
+  endBasicTagRead(token);
+  return complete ? w.length : 0;  // A birth has to describe every tag, a partial one is useless
+}
+
+size_t encodeSparkplugData(uint8_t* buffer, size_t capacity, uint64_t timestamp, uint64_t seq, const size_t* changed_indexes, size_t count, size_t* encoded) {
+  if (encoded != NULL) *encoded = 0;
+  if (changed_indexes == NULL && count > 0) return 0;
+  _SpWriter w = {buffer, capacity, 0, false};
+  if (!_sp_header(&w, timestamp, seq)) return 0;
+
+  uint32_t token = beginBasicTagRead();
+  size_t done = 0;
+  for (; done < count; done++) {
+    FunctionalBasicTag* tag = getTagByIdx(changed_indexes[done]);
+    if (tag != NULL && !_sp_tag_metric(&w, tag, false)) break;  // Deleted tags are skipped
+  }
+  endBasicTagRead(token);
+  if (encoded != NULL) *encoded = done;
+  return done > 0 || count == 0 ? w.length : 0;
+}
+
+size_t encodeSparkplugDataBitmap(uint8_t* buffer, size_t capacity, uint64_t timestamp, uint64_t seq, const uint32_t* bitmap, size_t bitmap_words, size_t* next_idx) {
+  if (bitmap == NULL || next_idx == NULL) return 0;
+  _SpWriter w = {buffer, capacity, 0, false};
+  if (!_sp_header(&w, timestamp, seq)) return 0;
+
+  uint32_t token = beginBasicTagRead();
+  size_t idx = *next_idx;
+  size_t end = bitmap_words * 32;
+  size_t metrics = 0;
+  bool complete = true;
+  while (idx < end && complete) {
+    uint32_t word = bitmap[idx / 32] >> (idx % 32);
+    if (word == 0) {
+      idx = (idx / 32 + 1) * 32;  // Rest of the word is clear
+      continue;
+    }
+    while ((word & 1) == 0) {
+      word >>= 1;
+      idx++;
+    }
+    FunctionalBasicTag* tag = getTagByIdx(idx);
+    if (tag != NULL) {
+      complete = _sp_tag_metric(&w, tag, false);
+      if (!complete) break;
+      metrics++;
+    }
+    idx++;
+  }
+  endBasicTagRead(token);
+  if (idx > end) idx = end;
+  *next_idx = idx;
+  return metrics > 0 || complete ? w.length : 0;
+}
+
+size_t encodeSparkplugCompactData(uint8_t* buffer, size_t capacity, uint64_t timestamp, uint64_t seq, size_t* next_slot) {
+  // The compact tags don't have registry indexes, their last read leaves BASIC_TAG_COMPACT_VALUE_CHANGED set instead
+  if (next_slot == NULL) return 0;
+  _SpWriter w = {buffer, capacity, 0, false};
+  if (!_sp_header(&w, timestamp, seq)) return 0;
+
+  uint32_t token = beginBasicTagRead();
+  size_t slot = *next_slot;
+  size_t end = getCompactTagsCapacity();
+  size_t metrics = 0;
+  bool complete = true;
+  for (; slot < end; slot++) {
+    CompactBasicTag* tag = getCompactTagBySlot(slot);
+    if (tag == NULL || !(tag->flags & BASIC_TAG_COMPACT_VALUE_CHANGED)) continue;
+    complete = _sp_compact_metric(&w, tag, false);
+    if (!complete) break;
+    metrics++;
+  }
+  endBasicTagRead(token);
+  *next_slot = slot;
+  return metrics > 0 ? w.length : 0;  // Nothing changed, no payload to publish
+}
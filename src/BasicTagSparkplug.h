@@ -0,0 +1,55 @@
+/*
+Copyright 2024 Michael Keras
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef BASIC_TAG_SPARKPLUG_H
+#define BASIC_TAG_SPARKPLUG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "BasicTag.h"
+
+/*
+Sparkplug B Payload Encoder (v1.4.0)
+Serialises tags straight into a caller supplied buffer as a Sparkplug B protobuf Payload, no allocations.
+Birth payloads carry every tag with its name, alias and datatype. Data payloads carry only the changed tags,
+by alias alone when the alias is 0 or greater (see Alias Namespace), by name otherwise.
+All functions return the payload length, or 0 if nothing could be encoded in capacity bytes.
+A NULL buffer returns the size the payload needs.
+*/
+
+// NBIRTH / DBIRTH, every tag and compact tag (including aliases of -1000 and below, eg. bdSeq). Returns 0 if it doesn't all fit
+size_t encodeSparkplugBirth(uint8_t* buffer, size_t capacity, uint64_t timestamp, uint64_t seq);
+
+// NDATA / DDATA from readAllBasicTagsChanged indexes. encoded receives how many of the changes fit, send the payload
+// and call again with changed_indexes + encoded for the rest
+size_t encodeSparkplugData(uint8_t* buffer, size_t capacity, uint64_t timestamp, uint64_t seq, const size_t* changed_indexes, size_t count, size_t* encoded);
+
+// Same from a readAllBasicTagsBitmap bitmap. Starts at tag index *next_idx and sets it to the first index not encoded,
+// bitmap_words * 32 once the whole bitmap is done
+size_t encodeSparkplugDataBitmap(uint8_t* buffer, size_t capacity, uint64_t timestamp, uint64_t seq, const uint32_t* bitmap, size_t bitmap_words, size_t* next_idx);
+
+// Same for the compact tags changed by their last read (BASIC_TAG_COMPACT_VALUE_CHANGED), they have no registry index.
+// Starts at slot *next_slot and sets it to the first slot not encoded, getCompactTagsCapacity() once all are done.
+// Returns 0 when none of them changed
+size_t encodeSparkplugCompactData(uint8_t* buffer, size_t capacity, uint64_t timestamp, uint64_t seq, size_t* next_slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BASIC_TAG_SPARKPLUG_H